@@ -5,478 +5,2651 @@
  *
  */
 
-#define _POSIX_C_SOURCE 199309L
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>   // assert
+#include <errno.h>    // errno, EINTR
+#include <limits.h>   // INT_MAX
+#include <pthread.h>  // pthread_create, pthread_join
+#include <signal.h>   // sigaction, signal
+#include <stdio.h>    // printf
+#include <stdlib.h>   // malloc
+#include <string.h>   // memcpy, memset, strerror
+#include <time.h>     // time, nanosleep
+#include <unistd.h>   // fork, getppid, _exit
+
+#include <sys/resource.h>  // getrusage
+#include <sys/wait.h>      // waitpid
+
+#include "adaptive-migration.h"
+#include "bisect.h"
+#include "bitarray.h"
+#include "crossover.h"
+#include "GAA-sw.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "genome-pool.h"
+#include "graph-parser.h"
+#include "large-alloc.h"
+#include "local-search.h"
+#include "mem-track.h"
+#include "mergesort.h"
+#include "migrant-ring.h"
+#include "packed-genome.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "selection.h"
+#include "sweep.h"
+
+
+// set by handle_stop_signal() to the signal that asked the GA to stop
+static volatile sig_atomic_t stop_signal = 0;
+
+static void handle_stop_signal(int sig) {
+    stop_signal = sig;
+    signal(sig, SIG_DFL);
+}
+
+// with ISLAND_PROCESSES, the process that started the islands' processes;
+// they stop if it is gone
+static pid_t coordinator = 0;
+
+// how often the main thread checks on the islands' progress
+#define MONITOR_INTERVAL_NS 10000000L
+
+/*
+ * With NUM_WORKERS, the islands are evolved by the tasks of a work-stealing
+ * scheduler rather than a thread each. Each generation of island isl is a
+ * task for each child pair k, ISLAND_TASK(isl, k), which makes and evaluates
+ * the pair, and the island's step, ISLAND_TASK(isl, POP_SIZE/2), between
+ * generations. The step spawns the generation's pair tasks, and the
+ * last of those to finish runs the next step itself, as the continuation of
+ * the generation, so no worker ever waits for a generation to complete. A
+ * steady-state generation makes its children in order, so it is a single
+ * step that spawns the next.
+ */
+#define TASKS_PER_ISLAND    (POP_SIZE/2 + 1)
+#define ISLAND_TASK(isl, k) ((isl)*TASKS_PER_ISLAND + (k))
+
+static Scheduler scheduler;
+static TaskContext* task_contexts;  // scratch memory of each worker
+
+static void run_task(void* arg, int task, int worker);
+
+// the most pairs in a pipeline batch: at least two batches a generation, so
+// that the stages overlap
+static int pipeline_max_batch(void) {
+    return PIPELINE_BATCH ? MIN(PIPELINE_BATCH, POP_SIZE/2)
+                          : MAX(1, POP_SIZE/4);
+}
+
+
+int main(int argc, char** argv) {
+
+    Graph* graph;
+    char* graph_file;
+
+    // read the GA parameters, and the graph file, from the command line
+    if (!parse_ga_params(argc, argv, &graph_file)) {
+        exit(1);
+    }
+    set_memory_limit((long)(MAX_MEMORY * (1 << 20)));
+    printf("GA parameters changed from their defaults:\n");
+    if (!print_ga_params(stdout, 1))
+        printf("\tnone\n");
+
+    // allocate memory for a graph struct
+    graph = tracked_malloc(MEM_GRAPH, sizeof(Graph));
+    CHECK_MALLOC_ERR(graph);
+
+    // parse graph from file specified on command line
+    if (!parse_graph_from_file(graph_file, graph)) {
+        tracked_free(graph);
+        exit(1);
+    }
+
+    if (SWEEP_FILE[0]) {
+        if (!run_sweep(graph, SWEEP_FILE))
+            exit(1);
+    }
+    else if (NUM_PARTS > 2) {
+        if (!run_bisection(graph))
+            exit(1);
+    }
+    else {
+        GAResult result;
+        bitarray_t* partition = NULL;
+
+        if (PARTS_FILE[0]) {
+            partition = tracked_malloc(MEM_IO,
+                                       RESERVE_BITS(graph->v)
+                                       * sizeof(bitarray_t));
+            CHECK_MALLOC_ERR(partition);
+        }
+
+        run_ga(graph, &result, partition);
+
+        if (partition) {
+            int* parts = tracked_malloc(MEM_IO, graph->v * sizeof(int));
+            CHECK_MALLOC_ERR(parts);
+            for (int i=0; i<graph->v; i++) {
+                parts[i] = getbit(partition, i);
+            }
+            if (!write_parts_file(PARTS_FILE, parts, graph->v))
+                exit(1);
+            tracked_free(parts);
+            tracked_free(partition);
+        }
+    }
+
+    // free memory used for graph:
+    free_graph(graph);
+    tracked_free(graph);
+
+    return 0;
+}
+
+
+/*
+ * Runs the GA on graph with the parameters as they are, printing its
+ * progress and then a report of the run, and returns the best fitness
+ * found, and what it took, in *result, and the best partition in
+ * best_partition unless that is NULL
+ */
+void run_ga(Graph* graph, GAResult* result, bitarray_t* best_partition) {
+
+    struct timespec wall_start, wall_now,
+                    total_start, total_stop;
+    double total_time = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &total_start);
+
+    // seed random number generator, which seeds each island's own
+    srand(SEED ? (unsigned)SEED : (unsigned)time(0));
+
+    // each island is evolved by a thread (or process) of its own, on its own
+    // population, scratch memory and partition storage
+    IslandWorker* workers = large_alloc_shared("island workers",
+                                               MEM_POPULATION,
+                                               NUM_ISLANDS
+                                               * sizeof(IslandWorker));
+
+    // the copy of the best individual found on each island, and the
+    // migration probabilities of each, which are read once the islands stop
+    size_t best_stride = GENOME_STRIDE(graph->v);
+    bitarray_t* best_rows = large_alloc_shared("best partitions",
+                                               MEM_IO,
+                                               NUM_ISLANDS * best_stride
+                                               * sizeof(bitarray_t));
+    double* migration_probs = large_alloc_shared("migration probs",
+                                                 MEM_POPULATION,
+                                                 (size_t)NUM_ISLANDS
+                                                 * NUM_ISLANDS
+                                                 * sizeof(double));
+
+    // storage for the partitions of every island: the population and the
+    // children of each island at once. With COMPACT_STORAGE the populations
+    // are packed instead, and the pools only hold the rows the genetic
+    // operators work in. Each island's pool has pages of its own, which are
+    // first touched by the island's thread. Island processes each get their
+    // own copy of the arena, of which they only touch their own pool.
+    int pool_capacity = COMPACT_STORAGE
+                        ? 4
+                        : POP_SIZE + (STEADY_STATE ? 2 : POP_SIZE);
+    size_t pool_bytes = genome_pool_bytes(pool_capacity, graph->v);
+    bitarray_t* genome_arena = large_alloc("genome pools",
+                                           MEM_POPULATION,
+                                           NUM_ISLANDS * pool_bytes,
+                                           PLACE_LOCAL);
+
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        IslandWorker* w = &workers[isl];
+
+        w->isl = isl;
+        w->graph = graph;
+        w->genome_arena = (bitarray_t*)((char*)genome_arena + isl*pool_bytes);
+        w->seed = (uint32_t)rand();
+        w->workers = workers;
+        w->gen = -1;
+        w->best_fitness = INT_MAX;
+        w->num_children = 0;
+        w->num_evaluations = 0;
+        w->diversity = 0;
+        w->elite_version = 0;
+        w->pid = 0;
+        w->failed = 0;
+        w->stop = 0;
+        w->best.partition = best_rows + isl*best_stride;
+        w->best.fitness = INT_MAX;
+        w->best.packed = NULL;
+        w->island.migration_probs = migration_probs + isl*NUM_ISLANDS;
+        w->children = tracked_malloc(MEM_POPULATION,
+                                     POP_SIZE * sizeof(Individual));
+        CHECK_MALLOC_ERR(w->children);
+        if (NUM_WORKERS) {
+            w->pair_seeds = tracked_malloc(MEM_POPULATION,
+                                           POP_SIZE/2 * sizeof(uint32_t));
+            CHECK_MALLOC_ERR(w->pair_seeds);
+            pthread_mutex_init(&w->lock, NULL);
+        }
+
+        // read by the islands that send migrants here, possibly before this
+        // island's thread has started
+        w->island.avg_fitness = 0;
+    }
+
+    // the ring buffers migrants travel through, one for each route between
+    // neighbouring islands
+    int num_routes;
+    MigrantRing* routes = init_routes(workers, graph->v, &num_routes);
+
+    // in a cluster, the main thread passes island 0's migrants on to the next
+    // host, and those from the previous host to island 0
+    Cluster cluster;
+    int clustered = (CLUSTER_HOSTS[0] != '\0');
+    if (clustered) {
+        if (!init_cluster(&cluster,
+                          CLUSTER_HOSTS,
+                          CLUSTER_RANK,
+                          graph->v,
+                          graph->e)) {
+            exit(1);
+        }
+        cluster.exports = workers[0].export_ring;
+        cluster.imports = workers[0].import_ring;
+    }
+
+    // copy of the best individual found so far, and where it was found
+    Individual best;
+    best.fitness = INT_MAX;
+    int best_isl = -1;
+    int stall_start = 0;  // generation by which best last improved
+    int last_report = 0;  // generation diversity was last printed at
+
+    double diversity[NUM_ISLANDS];  // latest diversity of each island
+
+    // stop early (with the best individual so far) on SIGINT or SIGTERM; a
+    // second signal gets the default action
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(struct sigaction));
+    stop_action.sa_handler = handle_stop_signal;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+
+    const char* stop_reason = NULL;
+    int gen = -1;  // generations every island has completed
+    long num_evaluations = 0;
+    long num_children = 0;
+
+    // data TLB misses of the evolutionary loop, where that can be counted
+    int tlb_counter = start_tlb_counter();
+
+    // allocations made by the evolutionary loop (including the islands'
+    // initialization, which their threads do; island processes count theirs
+    // on their own)
+    MemStats loop_start_mem, loop_stop_mem;
+    get_memory_totals(&loop_start_mem);
+
+    if (NUM_WORKERS)
+        printf("Starting GA for up to %d generations on %d islands, with %d "
+               "worker threads...\n",
+               NUM_GENERATIONS,
+               NUM_ISLANDS,
+               NUM_WORKERS
+              );
+    else
+        printf("Starting GA for up to %d generations on %d island %s...\n",
+               NUM_GENERATIONS,
+               NUM_ISLANDS,
+               ISLAND_PROCESSES ? "processes" : "threads"
+              );
+    fflush(stdout);
+
+    // with NUM_WORKERS, each worker makes children in scratch memory of its
+    // own; every island starts with its first step, spread over the workers
+    bitarray_t* task_arena = NULL;
+    if (NUM_WORKERS) {
+        size_t task_pool_bytes = genome_pool_bytes(4, graph->v);
+        task_arena = large_alloc("worker scratch rows",
+                                 MEM_SCRATCH,
+                                 NUM_WORKERS * task_pool_bytes,
+                                 PLACE_LOCAL);
+        task_contexts = tracked_malloc(MEM_SCRATCH,
+                                       NUM_WORKERS * sizeof(TaskContext));
+        CHECK_MALLOC_ERR(task_contexts);
+
+        for (int i=0; i<NUM_WORKERS; i++) {
+            init_task_context(&task_contexts[i],
+                              graph,
+                              (bitarray_t*)((char*)task_arena
+                                            + i*task_pool_bytes)
+                             );
+        }
+
+        init_scheduler(&scheduler,
+                       NUM_WORKERS,
+                       NUM_ISLANDS * TASKS_PER_ISLAND,
+                       run_task,
+                       workers
+                      );
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            spawn_task(&scheduler,
+                       isl % NUM_WORKERS,
+                       ISLAND_TASK(isl, POP_SIZE/2)
+                      );
+        }
+        start_scheduler(&scheduler);
+    }
+
+    // with PIPELINE_EVALUATORS, each island passes its children to an
+    // evaluation thread through a ring of batches; an evaluator serves every
+    // num_evaluators-th island. With COMPACT_STORAGE the children of a batch
+    // are made in rows of its slot, as they stay unpacked until settled.
+    int num_evaluators = MIN(PIPELINE_EVALUATORS, NUM_ISLANDS);
+    PipelineEvaluator* evaluators = NULL;
+    bitarray_t* stage_rows = NULL;
+    bitarray_t* evaluator_arena = NULL;
+    if (PIPELINE_EVALUATORS) {
+        int max_batch = pipeline_max_batch();
+        int capacity = stage_ring_capacity(PIPELINE_DEPTH);
+        int stride = GENOME_STRIDE(graph->v);
+        size_t ring_words = (size_t)capacity * 2*max_batch * stride;
+
+        if (COMPACT_STORAGE)
+            stage_rows = large_alloc("pipeline rows",
+                                     MEM_SCRATCH,
+                                     NUM_ISLANDS * ring_words
+                                     * sizeof(bitarray_t),
+                                     PLACE_LOCAL);
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            IslandWorker* w = &workers[isl];
+
+            w->stages = tracked_malloc(MEM_SCRATCH, sizeof(StageRing));
+            CHECK_MALLOC_ERR(w->stages);
+            init_stage_ring(w->stages,
+                            PIPELINE_DEPTH,
+                            max_batch,
+                            stage_rows ? stage_rows + isl*ring_words : NULL,
+                            stride
+                           );
+            // tuned from a size between the extremes
+            if (!PIPELINE_BATCH)
+                w->stages->batch_pairs = MIN(max_batch, MAX(1, POP_SIZE/8));
+        }
+
+        size_t evaluator_pool_bytes = genome_pool_bytes(4, graph->v);
+        evaluator_arena = large_alloc("evaluator scratch rows",
+                                      MEM_SCRATCH,
+                                      num_evaluators * evaluator_pool_bytes,
+                                      PLACE_LOCAL);
+        evaluators = tracked_malloc(MEM_SCRATCH,
+                                    num_evaluators * sizeof(PipelineEvaluator));
+        CHECK_MALLOC_ERR(evaluators);
+
+        for (int i=0; i<num_evaluators; i++) {
+            PipelineEvaluator* e = &evaluators[i];
+
+            e->index = i;
+            e->num_evaluators = num_evaluators;
+            e->workers = workers;
+            e->stop = 0;
+            e->num_batches = 0;
+            e->busy_time = 0;
+            e->wall_time = 0;
+            init_task_context(&e->scratch,
+                              graph,
+                              (bitarray_t*)((char*)evaluator_arena
+                                            + i*evaluator_pool_bytes)
+                             );
+
+            int err = pthread_create(&e->thread, NULL, run_evaluator, e);
+            if (err) {
+                fprintf(stderr, "Cannot start evaluation thread %d: %s\n",
+                        i, strerror(err));
+                exit(1);
+            }
+        }
+    }
+
+    // island processes are forked once the graph has been read, so they all
+    // share its pages (which nothing writes) instead of each having a copy
+    coordinator = getpid();
+    for (int isl=0; isl<NUM_ISLANDS && !NUM_WORKERS; isl++) {
+        IslandWorker* w = &workers[isl];
+
+        if (ISLAND_PROCESSES) {
+            // w is shared, so only this process may set w->pid
+            pid_t pid = fork();
+            if (pid == 0) {
+                run_island(w);
+                _exit(0);
+            }
+            if (pid < 0) {
+                fprintf(stderr, "Cannot start process for island %d: %s\n",
+                        isl, strerror(errno));
+                exit(1);
+            }
+            w->pid = pid;
+            continue;
+        }
+
+        int err = pthread_create(&w->thread, NULL, run_island, w);
+        if (err) {
+            fprintf(stderr, "Cannot start thread for island %d: %s\n",
+                    isl, strerror(err));
+            exit(1);
+        }
+    }
+
+    /* MONITOR THE ISLANDS */
+    // the islands evolve without waiting for each other; the stopping
+    // criteria apply to the generations all of them have completed
+    struct timespec monitor_interval = {0, MONITOR_INTERVAL_NS};
+    for (;;) {
+        nanosleep(&monitor_interval, NULL);
+
+        // an island whose process has died no longer holds the others up
+        if (ISLAND_PROCESSES && reap_islands(workers, 0) == NUM_ISLANDS) {
+            fprintf(stderr, "\nEvery island's process failed\n");
+            exit(1);
+        }
+
+        int improved = 0;
+        gen = INT_MAX;
+        num_evaluations = 0;
+        num_children = 0;
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            IslandWorker* w = &workers[isl];
+
+            if (!w->failed)
+                gen = MIN(gen, __atomic_load_n(&w->gen, __ATOMIC_ACQUIRE));
+            num_evaluations += __atomic_load_n(&w->num_evaluations,
+                                               __ATOMIC_RELAXED);
+            num_children += __atomic_load_n(&w->num_children,
+                                            __ATOMIC_RELAXED);
+            __atomic_load(&w->diversity, &diversity[isl], __ATOMIC_RELAXED);
+
+            int fitness = __atomic_load_n(&w->best_fitness, __ATOMIC_RELAXED);
+            if (fitness < best.fitness) {
+                best.fitness = fitness;
+                best_isl = isl;
+                improved = 1;
+            }
+        }
+        if (improved)
+            stall_start = MAX(gen, 0);
+
+        if (clustered)
+            cluster_exchange(&cluster, MAX(gen, 0));
+
+        // until every island has been initialized only a signal stops the GA
+        if (gen < 0 && !stop_signal)
+            continue;
+
+        // a target fitness reached on any host stops every host
+        Individual cluster_best = best;
+        if (clustered)
+            cluster_best.fitness = MIN(best.fitness, cluster.best_fitness);
+
+        clock_gettime(CLOCK_MONOTONIC, &wall_now);
+        double wall_time = (wall_now.tv_sec - wall_start.tv_sec)
+                           + (wall_now.tv_nsec - wall_start.tv_nsec)/1e9;
+        stop_reason = stopping_criterion(gen,
+                                         &cluster_best,
+                                         num_evaluations,
+                                         wall_time,
+                                         gen - stall_start,
+                                         diversity
+                                        );
+        if (stop_reason)
+            break;
+
+        // diversity is tracked every generation; it is only printed every
+        // DIVERSITY_PERIOD generations
+        if (gen/DIVERSITY_PERIOD > last_report/DIVERSITY_PERIOD) {
+            last_report = gen;
+
+            if (STEADY_STATE)
+                printf("\r%ld children evaluated... "
+                       "Diversity on each island: ",
+                       num_children);
+            else
+                printf("\r%d generations complete... "
+                       "Diversity on each island: ",
+                       gen);
+
+            for (int isl=0; isl<NUM_ISLANDS; isl++) {
+                printf("%.2f", diversity[isl]);
+                if (isl < NUM_ISLANDS-1)
+                    printf(", ");
+            }
+            
+            fflush(stdout);
+        }
+    }
+
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        __atomic_store_n(&workers[isl].stop, 1, __ATOMIC_RELEASE);
+    }
+    if (ISLAND_PROCESSES) {
+        if (reap_islands(workers, 1) == NUM_ISLANDS) {
+            fprintf(stderr, "\nEvery island's process failed\n");
+            exit(1);
+        }
+    }
+    else if (NUM_WORKERS) {
+        wait_scheduler(&scheduler);
+    }
+    else {
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            pthread_join(workers[isl].thread, NULL);
+        }
+    }
+    for (int i=0; i<num_evaluators; i++) {
+        __atomic_store_n(&evaluators[i].stop, 1, __ATOMIC_RELEASE);
+        pthread_join(evaluators[i].thread, NULL);
+    }
+
+    long long tlb_misses = stop_tlb_counter(tlb_counter);
+    get_memory_totals(&loop_stop_mem);
+
+    // where the islands stopped, and the best of their best individuals (a
+    // failed island's copy may have been left half written)
+    gen = INT_MAX;
+    best_isl = -1;
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        if (workers[isl].failed)
+            continue;
+        gen = MIN(gen, workers[isl].gen);
+        if (workers[isl].best.fitness < best.fitness || best_isl < 0) {
+            best_isl = isl;
+            best.fitness = workers[isl].best.fitness;
+        }
+    }
+    best = workers[best_isl].best;
+
+    // the best of the cluster, which the hosts settle on as they close, may
+    // have been found on another host
+    int best_host = -1;
+    if (clustered) {
+        cluster_offer_best(&cluster, best.partition, best.fitness);
+        close_cluster(&cluster);
+        if (cluster.best_rank != cluster.rank) {
+            best.partition = cluster.best;
+            best.fitness = cluster.best_fitness;
+            best_host = cluster.best_rank;
+        }
+    }
+
+    // add up the statistics of all islands
+    GAStats stats;
+    memset(&stats, 0, sizeof(GAStats));
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        add_stats(&stats, &workers[isl].ctx.stats);
+    }
+    long num_dropped = 0;
+    for (int route=0; route<num_routes; route++) {
+        num_dropped += routes[route].num_dropped;
+    }
+
+    if (STEADY_STATE)
+        printf("\r%ld children evaluated.  \n", stats.num_children);
+    else
+        printf("\r%d generations complete.  \n", gen);
+    printf("Stopped: %s\n", stop_reason);
+
+    // print best individual
+    if (best_host >= 0)
+        printf("Most fit individual was found on host %d: ", best_host);
+    else
+        printf("Most fit individual was found on island %d: ", best_isl);
+    int p0_cnt = 0;
+    int p1_cnt = 0;
+    for (int i=0; i<graph->v; i++) {
+        if (getbit(best.partition, i) == 0)
+            p0_cnt++;
+        else
+            p1_cnt++;
+    }
+    printf("\n");
+    int external_cost = 0;
+    for (int i=0; i<graph->e; i++) {
+        if (getbit(best.partition, (graph->edges)[i]->n1) 
+            != getbit(best.partition, (graph->edges)[i]->n2)) {
+            
+            external_cost += (graph->edges)[i]->weight;
+        }
+    }
+    printf("\tFitness = %d\n", best.fitness);
+    printf("\tNumber of nodes in partition 0: %d\n", p0_cnt);
+    printf("\t                             1: %d\n", p1_cnt);
+    printf("\tTotal external cost: %d\n", external_cost);
+    printf("\tFitness evaluations: %ld (%ld children inherited fitness)\n",
+           stats.num_evaluations,
+           stats.num_inherited
+          );
+    printf("\tLocal search passes: %ld\n", stats.num_refinements);
+    printf("\tBalance repairs: %ld\n", stats.num_repairs);
+    printf("\tMigrants sent: %ld (%ld more dropped on full rings, %ld "
+           "discarded as stale)\n",
+           stats.num_migrants,
+           num_dropped,
+           stats.num_stale
+          );
+    printf("\n");
+
+    if (clustered) {
+        print_cluster_stats(&cluster);
+        printf("\n");
+    }
+
+    if (NUM_WORKERS) {
+        print_scheduler_stats(&scheduler);
+        printf("\n");
+    }
+
+    if (PIPELINE_EVALUATORS) {
+        print_pipeline_stats(workers, evaluators, num_evaluators);
+        printf("\n");
+    }
+
+    printf("Memory:\n");
+    printf("\tPopulation, unpacked:         %8.2f MB\n",
+           (double)NUM_ISLANDS * POP_SIZE * RESERVE_BITS(graph->v)
+           * sizeof(bitarray_t) / (1 << 20)
+          );
+    // the peaks of the islands' pools, which need not have been at once
+    int peak_rows = 0;
+    int rows_in_use = 0;
+    long packed_bytes = 0;
+    long peak_packed_bytes = 0;
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        GenomePool* pool = &workers[isl].genome_pool;
+        peak_rows += pool->peak_used;
+        rows_in_use += pool->capacity - pool->num_free;
+        packed_bytes += workers[isl].packed_store.bytes;
+        peak_packed_bytes += workers[isl].packed_store.peak_bytes;
+    }
+    printf("\tPartition rows in use (peak): %8.2f MB (%d rows)\n",
+           (double)peak_rows * GENOME_STRIDE(graph->v)
+           * sizeof(bitarray_t) / (1 << 20),
+           peak_rows
+          );
+    if (COMPACT_STORAGE) {
+        printf("\tPacked partitions:            %8.2f MB (peak %.2f MB)\n",
+               (double)packed_bytes / (1 << 20),
+               (double)peak_packed_bytes / (1 << 20)
+              );
+    }
+    else {
+        printf("\tDistinct partitions:          %8d of %d individuals\n",
+               rows_in_use,
+               NUM_ISLANDS*POP_SIZE
+              );
+    }
+    printf("\tPeak resident set size:       %8.2f MB\n",
+           peak_resident_mb(RUSAGE_SELF));
+    if (ISLAND_PROCESSES) {
+        printf("\tLargest island process peak:  %8.2f MB\n",
+               peak_resident_mb(RUSAGE_CHILDREN));
+    }
+    if (tlb_misses >= 0) {
+        printf("\tData TLB load misses:         %8lld (%.1f per child)\n",
+               tlb_misses,
+               (double)tlb_misses / MAX(stats.num_children, 1L)
+              );
+    }
+    else {
+        printf("\tData TLB load misses:         not available\n");
+    }
+    printf("\n");
+
+    if (ISLAND_PROCESSES)
+        printf("Memory by use (of this process; each island process also "
+               "allocated its own):\n");
+    else
+        printf("Memory by use:\n");
+    print_memory_stats(stdout);
+    printf("\tAllocations per generation:   %8.1f (%.2f KB)\n",
+           (double)(loop_stop_mem.num_allocs - loop_start_mem.num_allocs)
+           / MAX(gen, 1),
+           (double)(loop_stop_mem.bytes_allocated 
+                    - loop_start_mem.bytes_allocated) / MAX(gen, 1) / 1024
+          );
+    printf("\n");
+
+    print_large_allocs();
+    printf("\n");
+
+    printf("Operator rates on each island:\n");
+    printf("\tIsland  Mutation  P(PX)  Uniform (improved)  PX (improved)\n");
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        OperatorRates* rates = &workers[isl].ctx.rates;
+        printf("\t%6d  %8.5f  %5.2f  %7ld (%8ld)  %7ld (%8ld)\n",
+               isl,
+               rates->mutation_prob,
+               rates->px_prob,
+               rates->uses[OP_UNIFORM],
+               rates->successes[OP_UNIFORM],
+               rates->uses[OP_PARTITION],
+               rates->successes[OP_PARTITION]
+              );
+    }
+    printf("\n");
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &total_stop);
+    total_time = (total_stop.tv_sec - total_start.tv_sec) + 
+                 (total_stop.tv_nsec - total_start.tv_nsec)/1e9;
+    if (ISLAND_PROCESSES) {
+        // the islands' time is their processes', which have all been waited
+        // for
+        struct rusage usage;
+        getrusage(RUSAGE_CHILDREN, &usage);
+        total_time += usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                      + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)/1e6;
+    }
+    if (ADAPTIVE_MIGRATION) {
+        printf("Migration probabilities (row: from island, column: to):\n");
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            printf("\t%2d: ", isl);
+            for (int dest=0; dest<NUM_ISLANDS; dest++) {
+                printf(" %5.3f", workers[isl].island.migration_probs[dest]);
+            }
+            printf("   (avg fitness %.1f)\n", workers[isl].island.avg_fitness);
+        }
+        printf("\n");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_now);
+    printf("Timing info:\n");
+    printf("\tWall clock time:         %8.2f sec\n", 
+           (wall_now.tv_sec - wall_start.tv_sec) 
+           + (wall_now.tv_nsec - wall_start.tv_nsec)/1e9
+          );
+    printf("\tTotal elapsed time:      %8.2f sec\n", total_time);
+    printf("\tTime spent in selection: %8.2f sec (%4.1f%%)\n", 
+           stats.selection_time, 
+           (stats.selection_time/total_time)*100
+          );
+    printf("\tTime spent in variation: %8.2f sec (%4.1f%%)\n", 
+           stats.crossover_time,
+           (stats.crossover_time/total_time)*100
+          );
+    printf("\tTime spent in fitness:   %8.2f sec (%4.1f%%)\n", 
+           stats.fitness_time,
+           (stats.fitness_time/total_time)*100
+          );
+    printf("\tTime spent in diversity: %8.2f sec (%4.1f%%)\n", 
+           stats.diversity_time,
+           (stats.diversity_time/total_time)*100
+          );
+    printf("\tTime spent in migration: %8.2f sec (%4.1f%%)\n",
+           stats.migration_time,
+           (stats.migration_time/total_time)*100
+          );
+    printf("\tTime spent in refinement:%8.2f sec (%4.1f%%)\n",
+           stats.refinement_time,
+           (stats.refinement_time/total_time)*100
+          );
+    printf("\tEvaluations per second:  %8.0f\n", 
+           stats.num_evaluations/total_time
+          );
+
+    result->best_fitness = best.fitness;
+    result->generations = gen;
+    result->num_children = stats.num_children;
+    result->num_evaluations = stats.num_evaluations;
+    result->wall_time = (wall_now.tv_sec - wall_start.tv_sec)
+                        + (wall_now.tv_nsec - wall_start.tv_nsec)/1e9;
+    if (best_partition)
+        memcpy(best_partition,
+               best.partition,
+               RESERVE_BITS(graph->v) * sizeof(bitarray_t));
+
+    // what island processes allocated went with them
+    for (int isl=0; isl<NUM_ISLANDS && !ISLAND_PROCESSES; isl++) {
+        IslandWorker* w = &workers[isl];
+        free_island(&w->island, &w->ctx);
+        free_context(&w->ctx);
+        free_genome_pool(&w->genome_pool);
+    }
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        tracked_free(workers[isl].children);
+        if (NUM_WORKERS) {
+            tracked_free(workers[isl].pair_seeds);
+            pthread_mutex_destroy(&workers[isl].lock);
+        }
+    }
+    for (int i=0; i<NUM_WORKERS; i++) {
+        free_task_context(&task_contexts[i]);
+    }
+    if (NUM_WORKERS) {
+        tracked_free(task_contexts);
+        large_free(task_arena);
+        free_scheduler(&scheduler);
+    }
+    for (int i=0; i<num_evaluators; i++) {
+        free_task_context(&evaluators[i].scratch);
+    }
+    if (PIPELINE_EVALUATORS) {
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            free_stage_ring(workers[isl].stages);
+            tracked_free(workers[isl].stages);
+        }
+        tracked_free(evaluators);
+        large_free(evaluator_arena);
+        if (stage_rows)
+            large_free(stage_rows);
+    }
+    free_routes(workers, routes);
+    if (clustered)
+        free_cluster(&cluster);
+    large_free(genome_arena);
+    large_free(migration_probs);
+    large_free(best_rows);
+    large_free(workers);
+}
+
+
+/*
+ * Number of cores a run of the GA with the parameters as they are keeps
+ * busy: one for each thread (or process) that evolves islands or evaluates
+ * children, as the main thread mostly sleeps while they do
+ */
+int ga_threads(void) {
+    if (NUM_WORKERS)
+        return NUM_WORKERS;
+
+    return NUM_ISLANDS + MIN(PIPELINE_EVALUATORS, NUM_ISLANDS);
+}
+
+
+/*
+ * Thread (or with ISLAND_PROCESSES, process) of one island (arg is its
+ * IslandWorker): sets up the island and evolves its population until
+ * NUM_GENERATIONS generations are complete or the main thread says to stop,
+ * migrating every MIGRATION_PERIOD generations. Progress is published after
+ * each generation.
+ */
+void* run_island(void* arg) {
+
+    IslandWorker* w = arg;
+    GAContext* ctx = &w->ctx;
+    Individual* children = w->children;
+
+    start_island(w);
+
+    /* EVOLUTIONARY LOOP */
+    for (int gen=0; begin_generation(w, gen); gen++) {
+
+        if (STEADY_STATE) {
+            steady_state_generation(w);
+            continue;
+        }
+
+        if (PIPELINE_EVALUATORS) {
+            pipeline_generation(w);
+            end_generation(w);
+            continue;
+        }
+
+        // create child population two individuals at a time using the
+        // genetic operators of selection, crossover, and mutation
+        int num_made = 0;
+        for (int idv=0;
+             idv<POP_SIZE && !__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE);
+             idv+=2) {
+
+            // every word of the children's partitions is written by
+            // crossover_mutation, so no need to clear them
+            if (COMPACT_STORAGE) {
+                children[idv].partition = ctx->child_rows[0];
+                children[idv+1].partition = ctx->child_rows[1];
+            }
+            else {
+                children[idv].partition = genome_alloc(&w->genome_pool);
+                children[idv+1].partition = genome_alloc(&w->genome_pool);
+            }
+            children[idv].packed = NULL;
+            children[idv+1].packed = NULL;
+
+            make_children(ctx,
+                          w->island.population,
+                          &(children[idv]),
+                          &(children[idv+1])
+                         );
+            num_made += 2;
+
+            // pack the children, so the rows can be used for the next pair
+            if (COMPACT_STORAGE) {
+                pack_individual(ctx, &(children[idv]));
+                pack_individual(ctx, &(children[idv+1]));
+            }
+
+        } /* END GENETIC OPERATORS (SELECTION, CROSSOVER, MUTATION) */
+
+        // a generation cut short by the main thread is dropped, leaving the
+        // population (and so the island's best) as it was
+        if (num_made < POP_SIZE) {
+            for (int idv=0; idv<num_made; idv++) {
+                release_individual(ctx, &children[idv]);
+            }
+            break;
+        }
+
+        end_generation(w);
+
+    } /* END EVOLUTIONARY LOOP */
+
+    stop_island(w);
+
+    return NULL;
+}
+
+
+/*
+ * Sets up island w->isl: its storage, and its initial population, each
+ * member of which is evaluated. This is done by the thread that goes on to
+ * evolve the island, so that its pages are on that thread's NUMA node (and
+ * an island process's own).
+ */
+void start_island(IslandWorker* w) {
+
+    Graph* graph = w->graph;
+    Island* island = &w->island;
+    GAContext* ctx = &w->ctx;
+    struct timespec fitness_start, fitness_stop;
+
+    init_genome_pool(&w->genome_pool,
+                     COMPACT_STORAGE
+                     ? 4
+                     : POP_SIZE + (STEADY_STATE ? 2 : POP_SIZE),
+                     graph->v,
+                     w->genome_arena
+                    );
+    init_packed_store(&w->packed_store, graph->v);
+    init_context(ctx, graph, &w->genome_pool, &w->packed_store, w->seed);
+
+    // initialize the island's population and calculate the initial fitness
+    // of each individual
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &fitness_start);
+    init_island(island, w->isl, &w->genome_pool);
+
+    for (int idv=0; idv<POP_SIZE; idv++) {
+
+        // packed individuals are created one at a time in a scratch row
+        if (COMPACT_STORAGE)
+            island->population[idv].partition = ctx->child_rows[0];
+
+        random_partition(island->population[idv].partition,
+                         graph->v,
+                         &ctx->rng
+                        );
+
+        island->population[idv].fitness =
+                calc_fitness(graph, &(island->population[idv]));
+        ctx->stats.num_evaluations++;
+
+        if (COMPACT_STORAGE)
+            pack_individual(ctx, &island->population[idv]);
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &fitness_stop);
+    ctx->stats.fitness_time += (fitness_stop.tv_sec - fitness_start.tv_sec) +
+                 (fitness_stop.tv_nsec - fitness_start.tv_nsec)/1e9;
+
+    // the two children of each pair in steady-state mode; they trade
+    // partitions with the individuals they replace
+    if (STEADY_STATE) {
+        for (int childno=0; childno<2; childno++) {
+            w->offspring[childno].partition = COMPACT_STORAGE
+                    ? ctx->child_rows[childno]
+                    : genome_alloc(&w->genome_pool);
+            w->offspring[childno].packed = NULL;
+        }
+    }
+}
+
+
+/*
+ * The start of generation gen on island w->isl: tracks diversity and the
+ * best individual, publishes the island's progress, and migrates. Returns 0,
+ * having done none of the latter, if the island is to stop instead.
+ */
+int begin_generation(IslandWorker* w, int gen) {
+
+    Graph* graph = w->graph;
+    Island* island = &w->island;
+    GAContext* ctx = &w->ctx;
+    struct timespec diversity_start, diversity_stop,
+                    migration_start, migration_stop;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &diversity_start);
+
+    double diversity = calc_diversity(island->population, graph->v);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &diversity_stop);
+    ctx->stats.diversity_time +=
+            (diversity_stop.tv_sec - diversity_start.tv_sec) +
+            (diversity_stop.tv_nsec - diversity_start.tv_nsec)/1e9;
+
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        if (island->population[idv].fitness < w->best.fitness) {
+            w->best.fitness = island->population[idv].fitness;
+            copy_partition(ctx, &island->population[idv], w->best.partition);
+        }
+    }
+
+    // publish the island's progress, the generation count last
+    __atomic_store_n(&w->best_fitness, w->best.fitness, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->num_children,
+                     ctx->stats.num_children,
+                     __ATOMIC_RELAXED
+                    );
+    __atomic_store_n(&w->num_evaluations,
+                     ctx->stats.num_evaluations,
+                     __ATOMIC_RELAXED
+                    );
+    __atomic_store(&w->diversity, &diversity, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->gen, gen, __ATOMIC_RELEASE);
+
+    if (gen >= NUM_GENERATIONS
+        || __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)
+        || (ISLAND_PROCESSES && getppid() != coordinator))
+        return 0;
+
+    // pack the island's members against one of its current best, as the
+    // population has moved on from the old reference
+    if (COMPACT_STORAGE && gen > 0 && gen%COMPACT_REBASE_PERIOD == 0)
+        rebase_island(ctx, island->population);
+
+    /* MIGRATION */
+    // send migrants every MIGRATION_PERIOD generations, and take in
+    // whichever have arrived every generation
+    if (gen > 0) {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &migration_start);
+
+        if (gen%MIGRATION_PERIOD == 0)
+            send_migrants(w, gen);
+        receive_migrants(w, gen);
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &migration_stop);
+        ctx->stats.migration_time +=
+                (migration_stop.tv_sec - migration_start.tv_sec) +
+                (migration_stop.tv_nsec - migration_start.tv_nsec)/1e9;
+    }
+
+    return 1;
+}
+
+
+/*
+ * A steady-state generation of island w->isl: each child replaces an
+ * individual of the population as soon as it has been evaluated, POP_SIZE
+ * children in all, unless the main thread says to stop first
+ */
+void steady_state_generation(IslandWorker* w) {
+    for (int idv=0;
+         idv<POP_SIZE && !__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE);
+         idv+=2) {
+        make_children(&w->ctx,
+                      w->island.population,
+                      &w->offspring[0],
+                      &w->offspring[1]
+                     );
+
+        for (int childno=0; childno<2; childno++) {
+            replace_individual(&w->ctx,
+                               w->island.population,
+                               &w->offspring[childno]
+                              );
+        }
+    }
+}
+
+
+/*
+ * The end of a generation of island w->isl (not in steady state), once all
+ * its children have been made: refines the best of them with LS_ELITE, and
+ * replaces the population with them
+ */
+void end_generation(IslandWorker* w) {
+
+    GAContext* ctx = &w->ctx;
+    Individual* children = w->children;
+    struct timespec refinement_start, refinement_stop;
+
+    // refine the best of the new children
+    if (LOCAL_SEARCH == LS_ELITE) {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_start);
+
+        int elite_idx = 0;
+        for (int idv=1; idv<POP_SIZE; idv++) {
+            if (children[idv].fitness < children[elite_idx].fitness)
+                elite_idx = idv;
+        }
+        if (COMPACT_STORAGE)
+            unpack_individual(ctx,
+                              &(children[elite_idx]),
+                              ctx->child_rows[0]
+                             );
+        else
+            children[elite_idx].partition =
+                    genome_make_unique(&w->genome_pool,
+                                       children[elite_idx].partition);
+        fm_refinement(w->graph, &ctx->local_search, &(children[elite_idx]));
+        if (COMPACT_STORAGE)
+            pack_individual(ctx, &(children[elite_idx]));
+        ctx->stats.num_refinements++;
+        ctx->stats.num_evaluations++;
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_stop);
+        ctx->stats.refinement_time +=
+                (refinement_stop.tv_sec - refinement_start.tv_sec) +
+                (refinement_stop.tv_nsec - refinement_start.tv_nsec)/1e9;
+    }
+
+    // Replace the island's current population with the new children
+    replace_population(ctx, w->island.population, children);
+}
+
+
+/* Releases what start_island set aside for steady-state children */
+void stop_island(IslandWorker* w) {
+    if (STEADY_STATE && !COMPACT_STORAGE) {
+        genome_release(&w->genome_pool, w->offspring[0].partition);
+        genome_release(&w->genome_pool, w->offspring[1].partition);
+    }
+}
+
+
+/*
+ * The step of island w between generations, as a task on worker: finishes
+ * the generation all of whose children have been made (or sets the island
+ * up, before the first) and begins the next, unless the island stops
+ */
+static void island_step(IslandWorker* w, int worker) {
+    int gen = w->gen + 1;
+
+    if (gen == 0)
+        start_island(w);
+    else if (!STEADY_STATE)
+        end_generation(w);
+
+    if (!begin_generation(w, gen)) {
+        stop_island(w);
+        return;
+    }
+
+    if (STEADY_STATE) {
+        steady_state_generation(w);
+        spawn_task(&scheduler, worker, ISLAND_TASK(w->isl, POP_SIZE/2));
+        return;
+    }
+
+    // the children are made at the rates of the start of the generation, as
+    // settling each pair may change the island's own; each pair has a seed
+    // of its own, so the children do not depend on which worker makes them
+    // or when
+    w->gen_rates = w->ctx.rates;
+    w->pairs_pending = POP_SIZE/2;
+    for (int pair=0; pair<POP_SIZE/2; pair++) {
+        for (int childno=0; childno<2; childno++) {
+            Individual* child = &w->children[2*pair + childno];
+            child->partition = COMPACT_STORAGE
+                               ? NULL
+                               : genome_alloc(&w->genome_pool);
+            child->packed = NULL;
+        }
+        w->pair_seeds[pair] = xorshift32(&w->ctx.rng) | 1;
+    }
+    for (int pair=0; pair<POP_SIZE/2; pair++) {
+        spawn_task(&scheduler, worker, ISLAND_TASK(w->isl, pair));
+    }
+}
+
+
+/*
+ * Child pair pair of island w's current generation, as a task in the
+ * scratch memory tc of the worker running it. The children are made and
+ * evaluated without holding the island's lock, as they only read its
+ * population, which does not change until the generation ends; what they
+ * change of the island's storage, rates and statistics is then settled
+ * under the lock.
+ */
+static void run_child_pair(IslandWorker* w, int pair, TaskContext* tc) {
+    GAContext* ctx = &tc->ctx;
+    Individual* children = &w->children[2*pair];
+    ChildPair made;
+
+    ctx->rng = w->pair_seeds[pair];
+    ctx->rates = w->gen_rates;
+    if (COMPACT_STORAGE) {
+        children[0].partition = ctx->child_rows[0];
+        children[1].partition = ctx->child_rows[1];
+    }
+
+    produce_children(ctx,
+                     w->island.population,
+                     &children[0],
+                     &children[1],
+                     &made
+                    );
+
+    pthread_mutex_lock(&w->lock);
+    settle_children(&w->ctx,
+                    w->island.population,
+                    &children[0],
+                    &children[1],
+                    &made
+                   );
+    if (COMPACT_STORAGE) {
+        pack_individual(&w->ctx, &children[0]);
+        pack_individual(&w->ctx, &children[1]);
+    }
+    add_stats(&w->ctx.stats, &ctx->stats);
+    pthread_mutex_unlock(&w->lock);
+
+    memset(&ctx->stats, 0, sizeof(GAStats));
+}
+
+
+/* Runs task on worker, for the scheduler (arg is the array of islands) */
+static void run_task(void* arg, int task, int worker) {
+    IslandWorker* w = (IslandWorker*)arg + task/TASKS_PER_ISLAND;
+    int pair = task % TASKS_PER_ISLAND;
+
+    if (pair == POP_SIZE/2) {
+        island_step(w, worker);
+        return;
+    }
+
+    run_child_pair(w, pair, &task_contexts[worker]);
+
+    // the generation's last pair goes on with the island's next step
+    if (__atomic_sub_fetch(&w->pairs_pending, 1, __ATOMIC_ACQ_REL) == 0)
+        island_step(w, worker);
+}
+
+
+/*
+ * The children of a generation of island w->isl with PIPELINE_EVALUATORS:
+ * the island's thread makes them a batch at a time, while its evaluator
+ * evaluates the batches before, and settles each batch once it has been
+ * evaluated. It only waits when every slot of its ring is in use, or when
+ * the last batches of the generation are still being evaluated. Unless
+ * PIPELINE_BATCH sets it, the size of the batches is tuned after each
+ * generation so the island spends 5 to 25% of it waiting: halved when it
+ * waits longer (smaller batches overlap the stages more finely, and the last
+ * of a generation is evaluated sooner), and doubled when it hardly waits
+ * (fewer handoffs between the threads).
+ */
+void pipeline_generation(IslandWorker* w) {
+
+    GAContext* ctx = &w->ctx;
+    StageRing* ring = w->stages;
+    Individual* pop = w->island.population;
+    int num_pairs = POP_SIZE/2;
+    int pairs_made = 0;
+    int pairs_settled = 0;
+    double start = wall_seconds();
+    double stall_time = 0;
+
+    for (;;) {
+        ChildBatch* batch;
+
+        /* REPLACEMENT */
+        // the children of an evaluated batch share partitions with their
+        // parents, are packed, and credit the operators that made them; the
+        // population is replaced by end_generation()
+        while ((batch = batch_to_settle(ring)) != NULL) {
+            for (int pair=0; pair<batch->num_pairs; pair++) {
+                Individual* children = &batch->children[2*pair];
+                settle_children(ctx,
+                                pop,
+                                &children[0],
+                                &children[1],
+                                &batch->made[pair]
+                               );
+                if (COMPACT_STORAGE) {
+                    pack_individual(ctx, &children[0]);
+                    pack_individual(ctx, &children[1]);
+                }
+            }
+            add_stats(&ctx->stats, &batch->stats);
+            pairs_settled += batch->num_pairs;
+            batch_settled(ring);
+        }
+        if (pairs_settled == num_pairs)
+            break;
+
+        /* VARIATION */
+        if (pairs_made < num_pairs && (batch = batch_to_make(ring)) != NULL) {
+            batch->num_pairs = MIN(ring->batch_pairs, num_pairs - pairs_made);
+            batch->children = &w->children[2*pairs_made];
+            for (int i=0; i<2*batch->num_pairs; i++) {
+                Individual* child = &batch->children[i];
+                child->partition = COMPACT_STORAGE
+                        ? batch->rows + (size_t)i * w->genome_pool.stride
+                        : genome_alloc(&w->genome_pool);
+                child->packed = NULL;
+            }
+            for (int pair=0; pair<batch->num_pairs; pair++) {
+                vary_children(ctx,
+                              pop,
+                              &batch->children[2*pair],
+                              &batch->children[2*pair + 1],
+                              &batch->made[pair]
+                             );
+            }
+            memset(&batch->stats, 0, sizeof(GAStats));
+            batch_made(ring);
+            pairs_made += batch->num_pairs;
+            continue;
+        }
+
+        // wait for the evaluator, with the ring full or nothing left to make
+        double stall_start = wall_seconds();
+        for (int idle_rounds=0; !batch_to_settle(ring); idle_rounds++) {
+            idle_backoff(idle_rounds);
+        }
+        double stall = wall_seconds() - stall_start;
+
+        if (pairs_made < num_pairs) {
+            ring->num_full_stalls++;
+            ring->full_stall_time += stall;
+        }
+        else {
+            ring->num_drain_stalls++;
+            ring->drain_stall_time += stall;
+        }
+        stall_time += stall;
+    }
+
+    if (!PIPELINE_BATCH) {
+        double gen_time = wall_seconds() - start;
+
+        if (stall_time > 0.25*gen_time)
+            ring->batch_pairs = MAX(1, ring->batch_pairs/2);
+        else if (stall_time < 0.05*gen_time)
+            ring->batch_pairs = MIN(pipeline_max_batch(), 2*ring->batch_pairs);
+    }
+}
+
+
+/*
+ * Thread of a pipeline evaluator (arg is its PipelineEvaluator): evaluates
+ * the batches of the islands it serves as they are made, taking them from
+ * each island in turn, until the main thread says to stop
+ */
+void* run_evaluator(void* arg) {
+
+    PipelineEvaluator* e = arg;
+    GAContext* ctx = &e->scratch.ctx;
+    double start = wall_seconds();
+    int idle_rounds = 0;
+
+    while (!__atomic_load_n(&e->stop, __ATOMIC_ACQUIRE)) {
+        int evaluated = 0;
+
+        for (int isl=e->index; isl<NUM_ISLANDS; isl+=e->num_evaluators) {
+            StageRing* ring = e->workers[isl].stages;
+            ChildBatch* batch = batch_to_evaluate(ring);
+            if (!batch)
+                continue;
+
+            double busy_start = wall_seconds();
+            for (int pair=0; pair<batch->num_pairs; pair++) {
+                evaluate_children(ctx,
+                                  &batch->children[2*pair],
+                                  &batch->children[2*pair + 1],
+                                  &batch->made[pair]
+                                 );
+            }
+            batch->stats = ctx->stats;
+            memset(&ctx->stats, 0, sizeof(GAStats));
+            batch_evaluated(ring);
+
+            e->busy_time += wall_seconds() - busy_start;
+            e->num_batches++;
+            evaluated = 1;
+        }
+
+        idle_rounds = evaluated ? 0 : idle_rounds + 1;
+        if (!evaluated)
+            idle_backoff(idle_rounds);
+    }
+
+    e->wall_time = wall_seconds() - start;
+    return NULL;
+}
+
+
+/*
+ * Sets up the scratch memory of a thread that makes or evaluates children
+ * for graph, with rows in arena, which must be genome_pool_bytes(4, ...)
+ * long
+ */
+void init_task_context(TaskContext* tc, Graph* graph, bitarray_t* arena) {
+    init_genome_pool(&tc->genome_pool, 4, graph->v, arena);
+    init_packed_store(&tc->packed_store, graph->v);
+    init_context(&tc->ctx, graph, &tc->genome_pool, &tc->packed_store, 1);
+}
+
+
+void free_task_context(TaskContext* tc) {
+    free_context(&tc->ctx);
+    free_genome_pool(&tc->genome_pool);
+}
+
+
+/*
+ * Allocates the scratch memory the genetic operators need for graph, seeds
+ * the context's random number generator and clears its statistics
+ */
+void init_context(GAContext* ctx, 
+                  Graph* graph, 
+                  GenomePool* genome_pool, 
+                  PackedStore* packed_store,
+                  uint32_t seed) {
+    ctx->graph = graph;
+    ctx->genome_pool = genome_pool;
+    ctx->packed_store = packed_store;
+    ctx->reference = NULL;
+    for (int i=0; i<2; i++) {
+        ctx->parent_rows[i] = NULL;
+        ctx->child_rows[i] = NULL;
+        if (COMPACT_STORAGE) {
+            ctx->parent_rows[i] = genome_alloc(genome_pool);
+            ctx->child_rows[i] = genome_alloc(genome_pool);
+        }
+    }
+    ctx->rng = seed | 1;  // xorshift state must be non-zero
+    init_genome_diff(&ctx->diffs[0], graph->v);
+    init_genome_diff(&ctx->diffs[1], graph->v);
+    init_local_search(graph, &ctx->local_search);
+    init_partition_crossover(graph, &ctx->partition_crossover);
+    init_operator_rates(&ctx->rates);
+    memset(&ctx->stats, 0, sizeof(GAStats));
+}
+
+
+void free_context(GAContext* ctx) {
+    if (COMPACT_STORAGE) {
+        for (int i=0; i<2; i++) {
+            genome_release(ctx->genome_pool, ctx->parent_rows[i]);
+            genome_release(ctx->genome_pool, ctx->child_rows[i]);
+        }
+        if (ctx->reference)
+            packed_release(ctx->packed_store, ctx->reference);
+    }
+    free_genome_diff(&ctx->diffs[0]);
+    free_genome_diff(&ctx->diffs[1]);
+    free_local_search(&ctx->local_search);
+    free_partition_crossover(&ctx->partition_crossover);
+}
+
+
+/*
+ * Returns a description of the first stopping criterion that has been met at
+ * the start of generation gen, or NULL if the GA should go on. best is the
+ * best individual found so far, elapsed the wall clock time since the start
+ * in seconds, and diversity the diversity of each island.
+ */
+const char* stopping_criterion(int gen, 
+                               const Individual* best,
+                               long num_evaluations,
+                               double elapsed,
+                               int stall_generations,
+                               const double* diversity) {
+
+    if (stop_signal == SIGINT)
+        return "interrupted (SIGINT)";
+    if (stop_signal == SIGTERM)
+        return "terminated (SIGTERM)";
+    if (best->fitness <= TARGET_FITNESS)
+        return "target fitness reached";
+    if (gen >= NUM_GENERATIONS)
+        return "generation limit reached";
+    if (MAX_WALL_TIME > 0 && elapsed >= MAX_WALL_TIME)
+        return "time limit reached";
+    if (MAX_EVALUATIONS > 0 && num_evaluations >= MAX_EVALUATIONS)
+        return "evaluation limit reached";
+    if (MAX_STALL_GENERATIONS > 0 && stall_generations >= MAX_STALL_GENERATIONS)
+        return "no improvement";
+
+    if (MIN_DIVERSITY > 0) {
+        double max_diversity = 0;
+        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+            max_diversity = MAX(max_diversity, diversity[isl]);
+        }
+        if (max_diversity < MIN_DIVERSITY)
+            return "population converged";
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the largest amount of memory the process (who is RUSAGE_SELF), or
+ * the largest of its children that have been waited for (RUSAGE_CHILDREN),
+ * has had resident, in MB
+ */
+double peak_resident_mb(int who) {
+    struct rusage usage;
+
+    if (getrusage(who, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return (double)usage.ru_maxrss / (1 << 20);  // bytes
+#else
+    return (double)usage.ru_maxrss / (1 << 10);  // kilobytes
+#endif
+}
+
+
+/*
+ * Writes the partition of idv, which may be packed, to partition
+ */
+void copy_partition(GAContext* ctx, 
+                    const Individual* idv, 
+                    bitarray_t* partition) {
+    if (idv->packed)
+        unpack_genome(ctx->packed_store, idv->packed, partition);
+    else
+        memcpy(partition, 
+               idv->partition, 
+               RESERVE_BITS(ctx->graph->v) * sizeof(bitarray_t)
+              );
+}
+
+
+/*
+ * COMPACT_STORAGE: packs the partition of idv against the island's 
+ * reference, unless idv already shares a packed genome, and leaves idv with
+ * just the packed genome. The row it was in is not released.
+ */
+void pack_individual(GAContext* ctx, Individual* idv) {
+    if (!idv->packed)
+        idv->packed = pack_genome(ctx->packed_store, 
+                                  idv->partition, 
+                                  ctx->reference
+                                 );
+    idv->partition = NULL;
+}
+
+
+/*
+ * COMPACT_STORAGE: unpacks the partition of idv to row, and leaves idv with
+ * just that partition
+ */
+void unpack_individual(GAContext* ctx, Individual* idv, bitarray_t* row) {
+    unpack_genome(ctx->packed_store, idv->packed, row);
+    packed_release(ctx->packed_store, idv->packed);
+    idv->packed = NULL;
+    idv->partition = row;
+}
+
+
+/*
+ * Drops the partition of a population member, packed or not
+ */
+void release_individual(GAContext* ctx, Individual* idv) {
+    if (idv->packed) {
+        packed_release(ctx->packed_store, idv->packed);
+        idv->packed = NULL;
+    }
+    else {
+        genome_release(ctx->genome_pool, idv->partition);
+    }
+}
 
-#include <assert.h>  // assert
-#include <limits.h>  // INT_MAX
-#include <stdio.h>   // printf
-#include <stdlib.h>  // malloc
-#include <string.h>  // memset
-#include <time.h>    // time
 
-#include "bitarray.h"
-#include "crossover.h"
-#include "GAA-sw.h"
-#include "ga-params.h"
-#include "ga-utils.h"
-#include "graph-parser.h"
-#include "mergesort.h"
-#include "selection.h"
+/*
+ * Replaces population member dst by a migrant with the given partition and
+ * fitness, which is copied into the island's own storage
+ */
+void receive_migrant(GAContext* ctx, 
+                     Individual* dst, 
+                     const bitarray_t* partition, 
+                     int fitness) {
+    if (COMPACT_STORAGE) {
+        packed_release(ctx->packed_store, dst->packed);
+        dst->packed = pack_genome(ctx->packed_store, 
+                                  partition, 
+                                  ctx->reference
+                                 );
+    }
+    else {
+        dst->partition = genome_make_writable(ctx->genome_pool, 
+                                              dst->partition);
+        memcpy(dst->partition, 
+               partition, 
+               RESERVE_BITS(ctx->graph->v) * sizeof(bitarray_t)
+              );
+    }
+    dst->fitness = fitness;
+}
 
 
-int main(int argc, char** argv) {
+/*
+ * COMPACT_STORAGE: makes a copy of the most fit member of pop the island's
+ * new reference, and packs every member against it. Members that shared a
+ * packed genome still share one afterwards.
+ */
+void rebase_island(GAContext* ctx, Individual* pop) {
+    PackedGenome* old[POP_SIZE];
+    int best_idx = 0;
 
-    Graph* graph;
-    struct timespec total_start, total_stop, 
-                    selection_start, selection_stop,
-                    crossover_start, crossover_stop,
-                    mutation_start, mutation_stop,
-                    fitness_start, fitness_stop,
-                    diversity_start, diversity_stop,
-                    migration_start, migration_stop;
-    double total_time = 0;
-    double selection_time = 0;
-    double crossover_time = 0;
-    double mutation_time = 0;
-    double fitness_time = 0;
-    double diversity_time = 0;
-    double migration_time = 0;
+    for (int idv=1; idv<POP_SIZE; idv++) {
+        if (pop[idv].fitness < pop[best_idx].fitness)
+            best_idx = idv;
+    }
 
-    int migration_count;
+    unpack_genome(ctx->packed_store, pop[best_idx].packed, ctx->parent_rows[0]);
+    PackedGenome* reference = pack_genome(ctx->packed_store, 
+                                          ctx->parent_rows[0], 
+                                          NULL
+                                         );
 
-    if (argc != 2) {
-        fprintf(stderr, "%s\n", "usage: gaa <graph_file>");
-        exit(1);
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        old[idv] = pop[idv].packed;
+
+        int prev = 0;
+        while (prev < idv && old[prev] != old[idv])
+            prev++;
+
+        if (prev < idv) {
+            pop[idv].packed = packed_share(pop[prev].packed);
+        }
+        else {
+            unpack_genome(ctx->packed_store, old[idv], ctx->parent_rows[1]);
+            pop[idv].packed = pack_genome(ctx->packed_store, 
+                                          ctx->parent_rows[1], 
+                                          reference
+                                         );
+        }
     }
 
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &total_start);
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        packed_release(ctx->packed_store, old[idv]);
+    }
+    if (ctx->reference)
+        packed_release(ctx->packed_store, ctx->reference);
+    ctx->reference = reference;
+}
 
-    // allocate memory for a graph struct
-    graph = malloc(sizeof(Graph));
-    CHECK_MALLOC_ERR(graph);
 
-    // parse graph from file specified on command line
-    if (!parse_graph_from_file(argv[1], graph)) {
-        goto cleanup_graph;
+/*
+ * Sets up an island: allocates its population, with each member's partition
+ * a row of genome_pool (unless COMPACT_STORAGE), finds its neighbours, and
+ * sets the initial migration probabilities: PROB_ISLAND_STAY for itself, the
+ * rest shared equally among its neighbours, and 0 for the other islands
+ */
+void init_island(Island* island, int isl, GenomePool* genome_pool) {
+    island->population = tracked_malloc(MEM_POPULATION,
+                                        POP_SIZE * sizeof(Individual));
+    CHECK_MALLOC_ERR(island->population);
+
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        island->population[idv].partition = 
+                COMPACT_STORAGE ? NULL : genome_alloc(genome_pool);
+        island->population[idv].packed = NULL;
     }
-    
-    // seed random number generator
-    srand(time(0));
-    
-    double total_inverse_fitness = 0;  // used in selection to select 
-                                       // individuals with probability 
-                                       // inversely proportional to their
-                                       // fitness (since we are looking to
-                                       // minimize fitness)
 
-    // initialize islands and their populations
-    if (!POP_SIZE % 2) {
-        fprintf(stderr, "POPULATION SIZE MUST BE AN EVEN NUMBER");
-        goto cleanup_graph_contents;
+    island->num_migrations = 0;
+    island->neighbours = tracked_malloc(MEM_POPULATION,
+                                        NUM_ISLANDS * sizeof(int));
+    CHECK_MALLOC_ERR(island->neighbours);
+    island->num_neighbours = island_neighbours(isl, island->neighbours);
+
+    int num_routes = MAX(island->num_neighbours, 1);
+    int num_elites = MAX(NUM_TO_MIGRATE, 1);
+    island->elite_hashes = tracked_malloc(MEM_POPULATION,
+                                          num_elites * sizeof(uint64_t));
+    CHECK_MALLOC_ERR(island->elite_hashes);
+    island->sent_hashes = tracked_malloc(MEM_POPULATION,
+                                         num_routes * num_elites
+                                         * sizeof(uint64_t));
+    CHECK_MALLOC_ERR(island->sent_hashes);
+    island->num_sent = tracked_malloc(MEM_POPULATION,
+                                      num_routes * sizeof(long));
+    CHECK_MALLOC_ERR(island->num_sent);
+    // nothing sent yet; no slot of sent_hashes is looked at before it has
+    // been written
+    memset(island->elite_hashes, 0, num_elites * sizeof(uint64_t));
+    memset(island->num_sent, 0, num_routes * sizeof(long));
+
+    // migration_probs has been set by main, as it is read once the island
+    // has stopped
+    for (int dest=0; dest<NUM_ISLANDS; dest++) {
+        island->migration_probs[dest] = 0;
+    }
+    for (int i=0; i<island->num_neighbours; i++) {
+        island->migration_probs[island->neighbours[i]] = 
+                (1 - PROB_ISLAND_STAY) / island->num_neighbours;
+    }
+    island->migration_probs[isl] = PROB_ISLAND_STAY;
+}
+
+
+void free_island(Island* island, GAContext* ctx) {
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        release_individual(ctx, &island->population[idv]);
+    }
+    tracked_free(island->population);
+    tracked_free(island->neighbours);
+    tracked_free(island->elite_hashes);
+    tracked_free(island->sent_hashes);
+    tracked_free(island->num_sent);
+}
+
+
+/*
+ * Writes the islands island isl sends migrants to under TOPOLOGY to
+ * neighbours, which must have room for NUM_ISLANDS-1, and returns how many
+ * there are. With TOPOLOGY_FULL they are in the order isl+1, isl+2, ...
+ * (wrapping around), so taking each in turn is the ring with a rotating
+ * stride. The torus is a grid of rows of cols islands, with cols the largest
+ * divisor of NUM_ISLANDS up to its square root.
+ */
+int island_neighbours(int isl, int* neighbours) {
+    int num_neighbours = 0;
+
+    if (TOPOLOGY == TOPOLOGY_RING) {
+        if (NUM_ISLANDS > 1)
+            neighbours[num_neighbours++] = (isl+1) % NUM_ISLANDS;
+    }
+    else if (TOPOLOGY == TOPOLOGY_TORUS) {
+        int cols = 1;
+        for (int c=2; c*c<=NUM_ISLANDS; c++) {
+            if (NUM_ISLANDS % c == 0)
+                cols = c;
+        }
+        int rows = NUM_ISLANDS / cols;
+        int row = isl / cols;
+        int col = isl % cols;
+        int grid_neighbours[4] = {
+            row*cols + (col+1) % cols,
+            ((row+1) % rows)*cols + col,
+            row*cols + (col+cols-1) % cols,
+            ((row+rows-1) % rows)*cols + col
+        };
+
+        // on a narrow grid some of these are the same island, or isl itself
+        for (int i=0; i<4; i++) {
+            int dup = (grid_neighbours[i] == isl);
+            for (int j=0; j<num_neighbours; j++) {
+                dup |= (neighbours[j] == grid_neighbours[i]);
+            }
+            if (!dup)
+                neighbours[num_neighbours++] = grid_neighbours[i];
+        }
+    }
+    else {
+        for (int i=1; i<NUM_ISLANDS; i++) {
+            neighbours[num_neighbours++] = (isl+i) % NUM_ISLANDS;
+        }
     }
 
-    // array of islands, on each island is a population
-    Individual* archipelago[NUM_ISLANDS];
+    return num_neighbours;
+}
+
+
+/*
+ * Sets up a ring buffer for every route from an island to one of its
+ * neighbours, with room for two migrations' worth of migrants, and sets the
+ * out_rings and in_rings of every worker. In a cluster there are also the
+ * export and import rings between island 0 and the main thread. The rings
+ * and their slots are in shared memory, so they also work between island
+ * processes. Returns the array of rings and sets *num_routes to its length.
+ */
+MigrantRing* init_routes(IslandWorker* workers, 
+                         int num_nodes, 
+                         int* num_routes) {
+    int neighbours[NUM_ISLANDS];
 
+    int clustered = (CLUSTER_HOSTS[0] != '\0');
+
+    *num_routes = clustered ? 2 : 0;
     for (int isl=0; isl<NUM_ISLANDS; isl++) {
-        Individual* population = malloc(POP_SIZE * sizeof(Individual));
-        CHECK_MALLOC_ERR(population);
+        *num_routes += island_neighbours(isl, neighbours);
+    }
 
-        init_population(population, graph->v);
+    // the rings, then the slots of each
+    size_t rings_bytes = (*num_routes * sizeof(MigrantRing) + GENOME_ALIGN-1)
+                         & ~(size_t)(GENOME_ALIGN-1);
+    size_t slots_bytes = migrant_ring_bytes(2*NUM_TO_MIGRATE, num_nodes);
+    MigrantRing* routes = large_alloc_shared("migrant rings",
+                                             MEM_POPULATION,
+                                             rings_bytes
+                                             + *num_routes * slots_bytes);
+    char* slots = (char*)routes + rings_bytes;
 
-        archipelago[isl] = population;
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        workers[isl].out_rings = tracked_malloc(MEM_POPULATION,
+                                                NUM_ISLANDS
+                                                * sizeof(MigrantRing*));
+        CHECK_MALLOC_ERR(workers[isl].out_rings);
+        workers[isl].in_rings = tracked_malloc(MEM_POPULATION,
+                                               NUM_ISLANDS
+                                               * sizeof(MigrantRing*));
+        CHECK_MALLOC_ERR(workers[isl].in_rings);
+        workers[isl].num_in_rings = 0;
+        workers[isl].export_ring = NULL;
+        workers[isl].import_ring = NULL;
     }
 
-    // calculate initial fitness for each individual on each island
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &fitness_start);
+    int route = 0;
     for (int isl=0; isl<NUM_ISLANDS; isl++) {
-        for (int idv=0; idv<POP_SIZE; idv++) {
+        int num_neighbours = island_neighbours(isl, neighbours);
 
-            archipelago[isl][idv].fitness = 
-                    calc_fitness(graph, &(archipelago[isl][idv]));
+        for (int nbr=0; nbr<num_neighbours; nbr++) {
+            IslandWorker* dest = &workers[neighbours[nbr]];
 
-            total_inverse_fitness += 1.0/(double)archipelago[isl][idv].fitness;
+            init_migrant_ring(&routes[route],
+                              isl,
+                              neighbours[nbr],
+                              2*NUM_TO_MIGRATE,
+                              num_nodes,
+                              slots + route*slots_bytes
+                             );
+            workers[isl].out_rings[nbr] = &routes[route];
+            dest->in_rings[dest->num_in_rings++] = &routes[route];
+            route++;
         }
     }
 
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &fitness_stop);
-    fitness_time += (fitness_stop.tv_sec - fitness_start.tv_sec) + 
-                 (fitness_stop.tv_nsec - fitness_start.tv_nsec)/1e9;
+    if (clustered) {
+        IslandWorker* gateway = &workers[0];
+
+        init_migrant_ring(&routes[route],
+                          0,
+                          -1,
+                          2*NUM_TO_MIGRATE,
+                          num_nodes,
+                          slots + route*slots_bytes
+                         );
+        gateway->export_ring = &routes[route++];
+
+        init_migrant_ring(&routes[route],
+                          -1,
+                          0,
+                          2*NUM_TO_MIGRATE,
+                          num_nodes,
+                          slots + route*slots_bytes
+                         );
+        gateway->import_ring = &routes[route];
+        gateway->in_rings[gateway->num_in_rings++] = &routes[route++];
+    }
 
-    // allocate and initialize memory needed for migration
-    int** sorted_indices_list = malloc(NUM_ISLANDS * sizeof(int*));
-    CHECK_MALLOC_ERR(sorted_indices_list);
-    for (int i=0; i<NUM_ISLANDS; i++) {
-        sorted_indices_list[i] = malloc(POP_SIZE * sizeof(int));
-        CHECK_MALLOC_ERR(sorted_indices_list[i]);
-        for (int j=0; j<POP_SIZE; j++) {
-            sorted_indices_list[i][j] = j;
+    return routes;
+}
+
+
+void free_routes(IslandWorker* workers, MigrantRing* routes) {
+    large_free(routes);
+
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        tracked_free(workers[isl].out_rings);
+        tracked_free(workers[isl].in_rings);
+    }
+}
+
+
+/*
+ * With ISLAND_PROCESSES, waits for the islands' processes that have exited
+ * (for all of them if wait is set, otherwise only those that already have).
+ * An island whose process did not exit normally is marked failed. Returns
+ * how many islands have failed so far.
+ */
+int reap_islands(IslandWorker* workers, int wait) {
+    int num_failed = 0;
+
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        IslandWorker* w = &workers[isl];
+        pid_t pid = 0;
+        int status;
+
+        if (w->pid > 0) {
+            do {
+                pid = waitpid(w->pid, &status, wait ? 0 : WNOHANG);
+            } while (pid < 0 && errno == EINTR);
+        }
+
+        if (pid == w->pid && pid > 0) {
+            w->pid = 0;
+            if (WIFSIGNALED(status)) {
+                fprintf(stderr, "\nIsland %d's process was killed by signal "
+                        "%d\n", isl, WTERMSIG(status));
+                w->failed = 1;
+            }
+            else if (WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "\nIsland %d's process exited with status "
+                        "%d\n", isl, WEXITSTATUS(status));
+                w->failed = 1;
+            }
         }
+
+        num_failed += w->failed;
     }
-    
-    /* EVOLUTIONARY LOOP */
-    for (int gen=0; gen<NUM_GENERATIONS; gen++) {
 
-        double diversity = 0;
+    return num_failed;
+}
 
-        if (gen == 0)
-            printf("Starting GA for %d generations...\n", NUM_GENERATIONS);
-        else if (gen%DIVERSITY_PERIOD == 0) {
 
-            printf("\r%d generations complete... Diversity on each island: ", gen);
+/*
+ * Hash of the partition of idv, which may be packed, to tell migrants apart
+ * by. A packed one is unpacked to ctx->child_rows[0], which is free between
+ * generations.
+ */
+static uint64_t _migrant_hash(GAContext* ctx, const Individual* idv) {
+    const bitarray_t* partition = idv->partition;
 
-            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &diversity_start);
+    if (idv->packed) {
+        copy_partition(ctx, idv, ctx->child_rows[0]);
+        partition = ctx->child_rows[0];
+    }
+    return hash_words(partition, RESERVE_BITS(ctx->graph->v));
+}
 
-            for (int isl=0; isl<NUM_ISLANDS; isl++) {
-                diversity = calc_diversity(archipelago[isl], graph->v);
-                printf("%.2f", diversity);
-                if (isl < NUM_ISLANDS-1)
-                    printf(", ");
-            }
 
-            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &diversity_stop);
-            diversity_time += (diversity_stop.tv_sec - diversity_start.tv_sec) + 
-                 (diversity_stop.tv_nsec - diversity_start.tv_nsec)/1e9;
-            
-            fflush(stdout);
+/*
+ * Sends migrants from island w->isl, after gen generations: copies of its
+ * NUM_TO_MIGRATE most fit individuals go to neighbouring islands. A migrant
+ * is not sent on a route it was one of the last NUM_TO_MIGRATE migrants sent
+ * on (by the hash of its partition), as the destination has it already.
+ * Each time the elites are not the partitions they were when migrants were
+ * last sent, the island's elite version goes up by one; the migrants are
+ * stamped with it. The islands do not wait for each other: a migrant is
+ * taken in whenever its destination next finishes a generation, and one sent
+ * on a full route is dropped. In a cluster, island 0 also exports them all
+ * to the main thread, when they have changed, to be sent to the next host.
+ *
+ * Without ADAPTIVE_MIGRATION all migrants go to the next neighbour in turn.
+ * With it, each migrant picks a destination at random according to the
+ * island's migration_probs (picking its own island means it stays). A
+ * migrant that is fitter than the average of the island it is sent to (as
+ * that island last published it) rewards the route it took by
+ * PROB_ISLAND_REWARD; one that is not penalizes it by PROB_ISLAND_PENALTY.
+ * The probability of staying is fixed at PROB_ISLAND_STAY; the rest is
+ * renormalized over the routes to neighbours (adapt_migration_probs), so
+ * migrants are sent more often to where they helped before without any route
+ * dropping below PROB_ISLAND_MIN.
+ */
+void send_migrants(IslandWorker* w, int gen) {
+
+    Island* island = &w->island;
+    GAContext* ctx = &w->ctx;
+    Individual* pop = island->population;
+    double* probs = island->migration_probs;
+
+    if (NUM_TO_MIGRATE == 0)
+        return;
+
+    int migrant_idxs[NUM_TO_MIGRATE];
+    int replaced_idxs[NUM_TO_MIGRATE];
+
+    select_best_worst_idv(pop,
+                          POP_SIZE,
+                          NUM_TO_MIGRATE,
+                          migrant_idxs,
+                          replaced_idxs
+                         );
+
+    double avg_fitness = 0;
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        avg_fitness += (double)pop[idv].fitness/POP_SIZE;
+    }
+    __atomic_store(&island->avg_fitness, &avg_fitness, __ATOMIC_RELAXED);
+
+    // the elites are a new version when any of them is not a partition it
+    // was when migrants were last sent
+    uint64_t hashes[NUM_TO_MIGRATE];
+    int changed = 0;
+    for (int idv=0; idv<NUM_TO_MIGRATE; idv++) {
+        hashes[idv] = _migrant_hash(ctx, &pop[migrant_idxs[idv]]);
+        if (hashes[idv] != island->elite_hashes[idv]) {
+            island->elite_hashes[idv] = hashes[idv];
+            changed = 1;
         }
+    }
 
-        /* MIGRATION */
-        if (gen == 0) {
-            migration_count = 1;
-            assert(NUM_TO_MIGRATE <= POP_SIZE/2);
+    MigrantStamp stamp;
+    stamp.gen = gen;
+    stamp.version = w->elite_version + changed;
+    __atomic_store_n(&w->elite_version, stamp.version, __ATOMIC_RELEASE);
+
+    // in a cluster, the gateway island's migrants also go to the next host,
+    // which has every one of them already unless they have changed
+    for (int idv=0; idv<NUM_TO_MIGRATE && w->export_ring && changed; idv++) {
+        bitarray_t* slot = ring_send_slot(w->export_ring);
+        if (!slot) {
+            w->export_ring->num_dropped++;
+            continue;
         }
-        else if (gen%MIGRATION_PERIOD == 0) {
+        copy_partition(ctx, &pop[migrant_idxs[idv]], slot);
+        stamp.fitness = pop[migrant_idxs[idv]].fitness;
+        ring_send(w->export_ring, &stamp);
+    }
 
-            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &migration_start);
+    for (int idv=0; idv<NUM_TO_MIGRATE && island->num_neighbours; idv++) {
 
-            if (migration_count%NUM_ISLANDS == 0) {
-                migration_count = 1;
+        // index in island->neighbours of the destination
+        int nbr = island->num_migrations % island->num_neighbours;
+
+        if (ADAPTIVE_MIGRATION) {
+            // roulette wheel choice of destination
+            double r = xorshift_uniform(&ctx->rng);
+            for (nbr=0; nbr<island->num_neighbours; nbr++) {
+                if (r <= probs[island->neighbours[nbr]])
+                    break;
+                r -= probs[island->neighbours[nbr]];
             }
+            if (nbr == island->num_neighbours)
+                continue;
+        }
 
-            // sort the indicies for each island by fitness
-            for (int isl=0; isl<NUM_ISLANDS; isl++) {
-                mergesort_idv(sorted_indices_list[isl], 
-                              0, 
-                              POP_SIZE-1, 
-                              archipelago[isl]
+        int dest = island->neighbours[nbr];
+        MigrantRing* ring = w->out_rings[nbr];
+        Individual* migrant = &pop[migrant_idxs[idv]];
+
+        // the destination has it already if it was one of the last
+        // NUM_TO_MIGRATE migrants sent on this route
+        uint64_t* sent = &island->sent_hashes[nbr * NUM_TO_MIGRATE];
+        int num_sent = MIN(island->num_sent[nbr], NUM_TO_MIGRATE);
+        int i = 0;
+        while (i < num_sent && sent[i] != hashes[idv])
+            i++;
+        if (i < num_sent)
+            continue;
+
+        bitarray_t* slot = ring_send_slot(ring);
+        if (!slot) {
+            ring->num_dropped++;
+            continue;
+        }
+        copy_partition(ctx, migrant, slot);
+        stamp.fitness = migrant->fitness;
+        ring_send(ring, &stamp);
+        sent[island->num_sent[nbr]++ % NUM_TO_MIGRATE] = hashes[idv];
+        ctx->stats.num_migrants++;
+
+        // reward or penalize the route, once the destination has published
+        // its average fitness
+        double dest_avg_fitness;
+        __atomic_load(&w->workers[dest].island.avg_fitness,
+                      &dest_avg_fitness,
+                      __ATOMIC_RELAXED
+                     );
+        if (!ADAPTIVE_MIGRATION || dest_avg_fitness == 0)
+            continue;
+
+        adapt_migration_probs(probs,
+                              island->neighbours,
+                              island->num_neighbours,
+                              dest,
+                              migrant->fitness < dest_avg_fitness
                              );
-            }
+    }
+    island->num_migrations++;
+}
 
-            for (int isl=0; isl<NUM_ISLANDS; isl++) {
 
-                // migrate a top percentage of individuals migration_count 
-                // islands over from the current island, replacing the same
-                // worst percentage (ie top 5% replaces bottom 5%)
-                for (int idv=0; idv<NUM_TO_MIGRATE; idv++) {
-                    //printf("sender_isl: %d\n", isl);
-                    int recipient_isl = (isl + migration_count)%NUM_ISLANDS;
-                    //printf("recipient_isl: %d\n", recipient_isl);
-                    int idx_to_send = sorted_indices_list[isl][idv];
-                    //printf("idx_to_send: %d\n", idx_to_send);
-                    int idx_to_replace = 
-                            sorted_indices_list[recipient_isl][POP_SIZE-1-idv];
-                    /*printf(
-"Sending idv %3d on island %3d to replace idv %3d on island %3d\n", 
-                                    idx_to_send, 
-                                    isl, idx_to_replace, recipient_isl);
-                    */
-        
-                    // do the copy:
-                    archipelago[recipient_isl][idx_to_replace].fitness
-                            = archipelago[isl][idx_to_send].fitness;
-                    for (int i=0; i<RESERVE_BITS(graph->v); i++) {
-                        archipelago[recipient_isl][idx_to_replace].partition[i]
-                                = archipelago[isl][idx_to_send].partition[i];
-                    }
-                }
-                //printf("\n");
-                
+/*
+ * Takes in the migrants waiting for island w->isl, without waiting for any,
+ * after gen generations: up to NUM_TO_MIGRATE of them (taking one from each
+ * route in turn) replace the least fit individuals. Migrants that have gone
+ * stale, by MAX_MIGRANT_AGE or MAX_MIGRANT_VERSIONS, are discarded instead.
+ */
+void receive_migrants(IslandWorker* w, int gen) {
+
+    Individual* pop = w->island.population;
+    MigrantStamp stamp;
+    int waiting = 0;
+
+    for (int i=0; i<w->num_in_rings && !waiting; i++) {
+        waiting = (ring_receive_slot(w->in_rings[i], &stamp) != NULL);
+    }
+    if (!waiting || NUM_TO_MIGRATE == 0)
+        return;
+
+    int migrant_idxs[NUM_TO_MIGRATE];
+    int replaced_idxs[NUM_TO_MIGRATE];
+
+    select_best_worst_idv(pop,
+                          POP_SIZE,
+                          NUM_TO_MIGRATE,
+                          migrant_idxs,
+                          replaced_idxs
+                         );
+
+    int num_received = 0;
+    for (int arrived=1; arrived && num_received<NUM_TO_MIGRATE; ) {
+        arrived = 0;
+        for (int i=0; i<w->num_in_rings && num_received<NUM_TO_MIGRATE; i++) {
+            MigrantRing* ring = w->in_rings[i];
+            const bitarray_t* migrant = ring_receive_slot(ring, &stamp);
+            if (!migrant)
+                continue;
+            arrived = 1;
+
+            // a migrant from another host (from the main thread) has no
+            // versions to go stale by
+            long sender_version = stamp.version;
+            if (ring->from >= 0)
+                sender_version =
+                        __atomic_load_n(&w->workers[ring->from].elite_version,
+                                        __ATOMIC_ACQUIRE);
+            if ((MAX_MIGRANT_AGE && gen - stamp.gen > MAX_MIGRANT_AGE)
+                || (MAX_MIGRANT_VERSIONS
+                    && sender_version - stamp.version > MAX_MIGRANT_VERSIONS)) {
+                w->ctx.stats.num_stale++;
             }
-            //printf("- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n");
+            else {
+                receive_migrant(&w->ctx,
+                                &pop[replaced_idxs[num_received++]],
+                                migrant,
+                                stamp.fitness
+                               );
+            }
+            ring_receive(ring);
+        }
+    }
+}
 
-            migration_count++;
 
-            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &migration_stop);
-            migration_time += (migration_stop.tv_sec - migration_start.tv_sec) + 
-                    (migration_stop.tv_nsec - migration_start.tv_nsec)/1e9;
+/*
+ * Adds the counters and timers of src to total
+ */
+void add_stats(GAStats* total, const GAStats* src) {
+    total->selection_time += src->selection_time;
+    total->crossover_time += src->crossover_time;
+    total->fitness_time += src->fitness_time;
+    total->refinement_time += src->refinement_time;
+    total->diversity_time += src->diversity_time;
+    total->migration_time += src->migration_time;
+    total->num_children += src->num_children;
+    total->num_evaluations += src->num_evaluations;
+    total->num_inherited += src->num_inherited;
+    total->num_refinements += src->num_refinements;
+    total->num_repairs += src->num_repairs;
+    total->num_migrants += src->num_migrants;
+    total->num_stale += src->num_stale;
+}
 
-        } /* END MIGRATION */
 
-        // loop over each island
-        for (int isl=0; isl<NUM_ISLANDS; isl++) {
+/*
+ * Produces two evaluated children from the population pop using the genetic 
+ * operators of selection, crossover and mutation (plus balance repair and 
+ * local search if enabled), at the context's current operator rates, and
+ * credits the crossover operator used with the result. The children's 
+ * partitions must already be allocated.
+ */
+void make_children(GAContext* ctx,
+                   Individual* pop,
+                   Individual* child1,
+                   Individual* child2) {
+
+    ChildPair made;
+
+    // the children are about to be overwritten, so they must not share 
+    // their partitions with anyone
+    child1->partition = genome_make_writable(ctx->genome_pool, 
+                                             child1->partition);
+    child2->partition = genome_make_writable(ctx->genome_pool, 
+                                             child2->partition);
+
+    produce_children(ctx, pop, child1, child2, &made);
+    settle_children(ctx, pop, child1, child2, &made);
+}
 
-            // Initialize children
-            Individual* children = malloc(POP_SIZE * sizeof(Individual));
-            CHECK_MALLOC_ERR(children);
 
-            // create child population two individuals at a time using the 
-            // genetic operators of selection, crossover, and mutation
-            for (int idv=0; idv<POP_SIZE; idv+=2) {
-    
-                // initialize memory for child partitions
-                children[idv].partition = 
-                        malloc(RESERVE_BITS(graph->v) * sizeof(bitarray_t));
-                CHECK_MALLOC_ERR(children[idv].partition);
-                memset(children[idv].partition,
-                       0,
-                       RESERVE_BITS(graph->v)*sizeof(bitarray_t)
-                      );
-                children[idv+1].partition = 
-                        malloc(RESERVE_BITS(graph->v) * sizeof(bitarray_t));
-                CHECK_MALLOC_ERR(children[idv+1].partition);
-                memset(children[idv+1].partition, 
-                       0, 
-                       RESERVE_BITS(graph->v)*sizeof(bitarray_t)
-                      );
+/*
+ * The part of make_children that only writes the children and ctx: selects
+ * the parents, makes and evaluates the children, and records in made what
+ * settle_children is to do about them. The children's partitions must be
+ * allocated and writable. A child that is an exact copy of its nearer parent
+ * gets the parent's fitness instead of being evaluated.
+ */
+void produce_children(GAContext* ctx,
+                      Individual* pop,
+                      Individual* child1,
+                      Individual* child2,
+                      ChildPair* made) {
+    vary_children(ctx, pop, child1, child2, made);
+    evaluate_children(ctx, child1, child2, made);
+}
 
-                /* SELECTION */
-                int parent_idxs[2] = {-1, -1};
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &selection_start);
-
-                parent_idxs[0] = tournament_selection(archipelago[isl]);
-                do {
-                    parent_idxs[1] = tournament_selection(archipelago[isl]);
-                } while (parent_idxs[0] == parent_idxs[1]);
-
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &selection_stop);
-                selection_time += 
-                        (selection_stop.tv_sec - selection_start.tv_sec) + 
-                        (selection_stop.tv_nsec - selection_start.tv_nsec)/1e9;
-                /* END SELECTION */
-
-                /* CROSSOVER */
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &crossover_start);
-
-                parameterized_uniform_crossover(archipelago[isl],
-                                                parent_idxs,
-                                                graph->v,
-                                                &(children[idv]),
-                                                &(children[idv+1])
-                                               );
-
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &crossover_stop);
-                crossover_time += 
-                        (crossover_stop.tv_sec - crossover_start.tv_sec) +
-                        (crossover_stop.tv_nsec - crossover_start.tv_nsec)/1e9;
-                /* END CROSSOVER */
-
-                /* MUTATION */
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &mutation_start);
-
-                for (int childno=0; childno<2; childno++) {
-                    for (int locus=0; locus<graph->v; locus++) {
-
-                        double mutation_decision1 = (double)rand()/RAND_MAX;
-                        if (mutation_decision1 < MUTATION_PROB) {
-                            // mutate: 1->0 or 0->1
-                            putbit(children[idv+childno].partition,
-                                   locus,
-                                   !getbit(children[idv+childno].partition, locus)
-                                  );
-                        }
-                    }
-                }
 
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &mutation_stop);
-                mutation_time += 
-                        (mutation_stop.tv_sec - mutation_start.tv_sec) +
-                        (mutation_stop.tv_nsec - mutation_start.tv_nsec)/1e9;
-                /* END MUTATION */
+/*
+ * The first stage of produce_children: selection, crossover and mutation.
+ * Only the children that are copies of a parent have a fitness afterwards.
+ */
+void vary_children(GAContext* ctx,
+                   Individual* pop,
+                   Individual* child1,
+                   Individual* child2,
+                   ChildPair* made) {
+
+    struct timespec selection_start, selection_stop,
+                    crossover_start, crossover_stop;
+    Graph* graph = ctx->graph;
+    Individual* children[2] = {child1, child2};
+
+    /* SELECTION */
+    int parent_idxs[2] = {-1, -1};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &selection_start);
+
+    parent_idxs[0] = tournament_selection(pop, &ctx->rng);
+    do {
+        parent_idxs[1] = tournament_selection(pop, &ctx->rng);
+    } while (parent_idxs[0] == parent_idxs[1]);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &selection_stop);
+    ctx->stats.selection_time += 
+            (selection_stop.tv_sec - selection_start.tv_sec) + 
+            (selection_stop.tv_nsec - selection_start.tv_nsec)/1e9;
+    /* END SELECTION */
+
+    /* CROSSOVER AND MUTATION */
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &crossover_start);
+
+    // the operators read the parents' partitions from parents[parent_pos]; 
+    // packed parents are unpacked for them first
+    Individual* parents = pop;
+    int parent_pos[2] = {parent_idxs[0], parent_idxs[1]};
+    Individual unpacked[2];
+    if (COMPACT_STORAGE) {
+        for (int i=0; i<2; i++) {
+            unpacked[i].partition = ctx->parent_rows[i];
+            unpacked[i].fitness = pop[parent_idxs[i]].fitness;
+            unpacked[i].packed = NULL;
+            unpack_genome(ctx->packed_store, 
+                          pop[parent_idxs[i]].packed, 
+                          unpacked[i].partition
+                         );
+            parent_pos[i] = i;
+        }
+        parents = unpacked;
+    }
 
-                // CALCULATE FITNESS OF NEW CHILDREN
-                // TODO: move this outside of the loop so that the hardware can do
-                // them all in parallel
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &fitness_start);
+    // partition crossover mask, or NULL for uniform crossover
+    bitarray_t* crossover_mask = NULL;
+    int crossover_op = OP_UNIFORM;
+    if (xorshift_uniform(&ctx->rng) <= ctx->rates.px_prob) {
+        crossover_op = OP_PARTITION;
+        crossover_mask = partition_crossover_mask(graph,
+                                                  &ctx->partition_crossover,
+                                                  parents,
+                                                  parent_pos
+                                                 );
+    }
 
-                children[idv].fitness = calc_fitness(graph, &(children[idv]));
-                children[idv+1].fitness = calc_fitness(graph, &(children[idv+1]));
+    crossover_mutation(parents,
+                       parent_pos,
+                       graph->v,
+                       crossover_mask,
+                       ctx->rates.mutation_prob,
+                       &ctx->rng,
+                       child1,
+                       child2,
+                       &ctx->diffs[0],
+                       &ctx->diffs[1]
+                      );
 
-                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &fitness_stop);
-                fitness_time += 
-                        (fitness_stop.tv_sec - fitness_start.tv_sec) + 
-                        (fitness_stop.tv_nsec - fitness_start.tv_nsec)/1e9;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &crossover_stop);
+    ctx->stats.crossover_time += 
+            (crossover_stop.tv_sec - crossover_start.tv_sec) +
+            (crossover_stop.tv_nsec - crossover_start.tv_nsec)/1e9;
+    /* END CROSSOVER AND MUTATION */
+
+    // a child identical to its nearest parent inherits the parent's fitness
+    // instead of being evaluated again (and is to share its partition)
+    made->parent_idxs[0] = parent_idxs[0];
+    made->parent_idxs[1] = parent_idxs[1];
+    made->crossover_op = crossover_op;
+    for (int childno=0; childno<2; childno++) {
+        made->copy_of[childno] = -1;
+        if (ctx->diffs[childno].num_bits == 0) {
+            made->copy_of[childno] = 
+                    (ctx->diffs[childno].parent == parent_pos[0]) 
+                    ? parent_idxs[0] 
+                    : parent_idxs[1];
+            children[childno]->fitness = pop[made->copy_of[childno]].fitness;
+            ctx->stats.num_inherited++;
+        }
+    }
+}
 
-            } /* END GENETIC OPERATORS (SELECTION, CROSSOVER, MUTATION) */
 
-            // Replace the island's current population with the new children
-            for (int idv=0; idv<POP_SIZE; idv++) {
-                for (int j=0; j<RESERVE_BITS(graph->v); j++) {
-                    archipelago[isl][idv].partition[j] 
-                            = children[idv].partition[j];
-                }
-                archipelago[isl][idv].fitness = children[idv].fitness;
-                //total_inverse_fitness += 1.0/(double)archipelago[0][i].fitness;
+/*
+ * The second stage of produce_children: evaluates the children that are not
+ * copies of a parent (a lopsided child gets its fitness from the balance
+ * repair, and with LS_ALL, from local search)
+ */
+void evaluate_children(GAContext* ctx,
+                       Individual* child1,
+                       Individual* child2,
+                       const ChildPair* made) {
+
+    struct timespec fitness_start, fitness_stop,
+                    refinement_start, refinement_stop;
+    Graph* graph = ctx->graph;
+    Individual* children[2] = {child1, child2};
+
+    // CALCULATE FITNESS OF NEW CHILDREN
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &fitness_start);
+
+    for (int childno=0; childno<2; childno++) {
+        if (made->copy_of[childno] >= 0)
+            continue;
+
+        if (BALANCE_REPAIR 
+                 && balance_repair(graph, 
+                                   &ctx->local_search, 
+                                   children[childno])) {
+            ctx->stats.num_repairs++;
+            ctx->stats.num_evaluations++;
+        }
+        else if (LOCAL_SEARCH != LS_ALL) {
+            children[childno]->fitness = calc_fitness(graph, children[childno]);
+            ctx->stats.num_evaluations++;
+        }
+    }
+    ctx->stats.num_children += 2;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &fitness_stop);
+    ctx->stats.fitness_time += 
+            (fitness_stop.tv_sec - fitness_start.tv_sec) + 
+            (fitness_stop.tv_nsec - fitness_start.tv_nsec)/1e9;
+
+    /* LOCAL SEARCH */
+    // refinement sets the fitness of the children it refines, so in this 
+    // mode they were not evaluated above
+    if (LOCAL_SEARCH == LS_ALL) {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_start);
+
+        for (int childno=0; childno<2; childno++) {
+            if (made->copy_of[childno] < 0) {
+                fm_refinement(graph, &ctx->local_search, children[childno]);
+                ctx->stats.num_refinements++;
+                ctx->stats.num_evaluations++;
             }
+        }
 
-            // free the children
-            for (int idv=0; idv<POP_SIZE; idv++) {
-               free(children[idv].partition);
-            }
-            free(children);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_stop);
+        ctx->stats.refinement_time += 
+                (refinement_stop.tv_sec - refinement_start.tv_sec) + 
+                (refinement_stop.tv_nsec - refinement_start.tv_nsec)/1e9;
+    }
+    /* END LOCAL SEARCH */
+}
 
-        } /* END ISLAND LOOP */
 
-    } /* END EVOLUTIONARY LOOP */
+/*
+ * The part of make_children that writes the island's shared storage and
+ * rates, for children produce_children has made (as recorded in made): a
+ * child that is a copy of a parent shares the parent's partition (packed or
+ * not), and the crossover operator used is credited with the result
+ */
+void settle_children(GAContext* ctx,
+                     Individual* pop,
+                     Individual* child1,
+                     Individual* child2,
+                     const ChildPair* made) {
 
-    printf("\r%d generations complete.  \n", NUM_GENERATIONS);
+    Individual* children[2] = {child1, child2};
 
-    // print best individual
-    int min_fitness = INT_MAX;
-    int min_isl_idx = -1;
-    int min_idv_idx = -1;
-    for (int isl=0; isl<NUM_ISLANDS; isl++) {
-        for (int idv=0; idv<POP_SIZE; idv++) {
-            if (archipelago[isl][idv].fitness < min_fitness) {
-                min_fitness = archipelago[isl][idv].fitness;
-                min_isl_idx = isl;
-                min_idv_idx = idv;
-            }
-       }
-    }
+    for (int childno=0; childno<2; childno++) {
+        if (made->copy_of[childno] < 0)
+            continue;
 
-    printf("Most fit individual was found on island %d: ", min_isl_idx);
-    int p0_cnt = 0;
-    int p1_cnt = 0;
-    for (int i=0; i<graph->v; i++) {
-        if (getbit(archipelago[min_isl_idx][min_idv_idx].partition, i) == 0)
-            p0_cnt++;
-        else
-            p1_cnt++;
+        Individual* parent = &pop[made->copy_of[childno]];
+        if (COMPACT_STORAGE) {
+            children[childno]->packed = packed_share(parent->packed);
+        }
+        else {
+            genome_release(ctx->genome_pool, children[childno]->partition);
+            children[childno]->partition = genome_share(ctx->genome_pool, 
+                                                        parent->partition);
+        }
+    }
 
-        //printf("%d", getbit(population[min_idx].partition, i));        
+    int parent_fitness = MIN(pop[made->parent_idxs[0]].fitness, 
+                             pop[made->parent_idxs[1]].fitness);
+    for (int childno=0; childno<2; childno++) {
+        credit_operator(&ctx->rates, 
+                        made->crossover_op, 
+                        parent_fitness, 
+                        children[childno]->fitness,
+                        made->copy_of[childno] >= 0
+                       );
     }
-    printf("\n");
-    int external_cost = 0;
-    for (int i=0; i<graph->e; i++) {
-        if (getbit(archipelago[min_isl_idx][min_idv_idx].partition, 
-                   (graph->edges)[i]->n1) 
-            != getbit(archipelago[min_isl_idx][min_idv_idx].partition, 
-                      (graph->edges)[i]->n2)) {
-            
-            external_cost += (graph->edges)[i]->weight;
+}
+
+
+/*
+ * Steady-state replacement: the evaluated child takes the place of an 
+ * individual of pop chosen by SS_REPLACEMENT, if it is at least as fit. The
+ * two swap partition buffers, so nothing is copied and the child's buffer
+ * can be reused for the next child (with COMPACT_STORAGE, the child is packed
+ * and keeps its row). With LS_ELITE, a child fitter than every
+ * member of pop is refined first.
+ */
+void replace_individual(GAContext* ctx, Individual* pop, Individual* child) {
+
+    struct timespec refinement_start, refinement_stop;
+
+    if (LOCAL_SEARCH == LS_ELITE) {
+        int best_idx = 0;
+        for (int idv=1; idv<POP_SIZE; idv++) {
+            if (pop[idv].fitness < pop[best_idx].fitness)
+                best_idx = idv;
         }
-    }
-    printf("\tFitness = %d\n", archipelago[min_isl_idx][min_idv_idx].fitness);
-    printf("\tNumber of nodes in partition 0: %d\n", p0_cnt);
-    printf("\t                             1: %d\n", p1_cnt);
-    printf("\tTotal external cost: %d\n", external_cost);
-    printf("\n");
 
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &total_stop);
-    total_time = (total_stop.tv_sec - total_start.tv_sec) + 
-                 (total_stop.tv_nsec - total_start.tv_nsec)/1e9;
-    printf("Timing info:\n");
-    printf("\tTotal elapsed time:      %8.2f sec\n", total_time);
-    printf("\tTime spent in selection: %8.2f sec (%4.1f%%)\n", 
-           selection_time, 
-           (selection_time/total_time)*100
-          );
-    printf("\tTime spent in crossover: %8.2f sec (%4.1f%%)\n", 
-           crossover_time,
-           (crossover_time/total_time)*100
-          );
-    printf("\tTime spent in mutation:  %8.2f sec (%4.1f%%)\n", 
-           mutation_time,
-           (mutation_time/total_time)*100
-          );
-    printf("\tTime spent in fitness:   %8.2f sec (%4.1f%%)\n", 
-           fitness_time,
-           (fitness_time/total_time)*100
-          );
-    printf("\tTime spent in diversity: %8.2f sec (%4.1f%%)\n", 
-           diversity_time,
-           (diversity_time/total_time)*100
-          );
-    printf("\tTime spent in migration: %8.2f sec (%4.1f%%)\n",
-           migration_time,
-           (migration_time/total_time)*100
-          );
+        if (child->fitness < pop[best_idx].fitness) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_start);
 
-    // free islands
-    /*
-    for (int i=0; i<NUM_ISLANDS; i++) {
-        traverseList(archipelago[i].member_list, &free);
-        removeAllNodes(archipelago[i].member_list);
-        free(archipelago[i].member_list);
-        free(archipelago[i].migration_probs);
+            child->partition = genome_make_unique(ctx->genome_pool, 
+                                                  child->partition);
+            if (child->packed) {
+                // the partition is about to change
+                packed_release(ctx->packed_store, child->packed);
+                child->packed = NULL;
+            }
+            fm_refinement(ctx->graph, &ctx->local_search, child);
+            ctx->stats.num_refinements++;
+            ctx->stats.num_evaluations++;
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &refinement_stop);
+            ctx->stats.refinement_time += 
+                    (refinement_stop.tv_sec - refinement_start.tv_sec) + 
+                    (refinement_stop.tv_nsec - refinement_start.tv_nsec)/1e9;
+        }
     }
-    free(archipelago);*/
 
-    // Free memory used for migration
-    for (int isl=0; isl<NUM_ISLANDS; isl++) {
-        free(sorted_indices_list[isl]);
+    int victim = (SS_REPLACEMENT == SS_REPLACE_WORST) 
+                 ? worst_replacement(pop)
+                 : tournament_replacement(pop, &ctx->rng);
+
+    if (child->fitness <= pop[victim].fitness) {
+        if (COMPACT_STORAGE) {
+            // the child's row is kept for the next child
+            bitarray_t* row = child->partition;
+            pack_individual(ctx, child);
+            release_individual(ctx, &pop[victim]);
+            pop[victim] = *child;
+            child->partition = row;
+            child->packed = NULL;
+        }
+        else {
+            bitarray_t* tmp = pop[victim].partition;
+            pop[victim].partition = child->partition;
+            pop[victim].fitness = child->fitness;
+            child->partition = tmp;
+        }
     }
-    free(sorted_indices_list);
+    else if (child->packed) {
+        packed_release(ctx->packed_store, child->packed);
+        child->packed = NULL;
+    }
+}
 
-    // Free population on each island
-    for (int isl=0; isl<NUM_ISLANDS; isl++) {
-        for (int idv=0; idv<POP_SIZE; idv++) {
-            free(archipelago[isl][idv].partition);
-        }
-        free(archipelago[isl]);
+
+/*
+ * Generational replacement of pop by its POP_SIZE children. With 
+ * GEN_REPLACE_ELITIST the NUM_ELITES most fit parents survive in place of the
+ * NUM_ELITES least fit children; with GEN_REPLACE_PLUS the POP_SIZE most fit 
+ * of parents and children together survive. Both are found by partial sorts.
+ * Survivors keep their stored fitness, so none are evaluated again, and 
+ * keep their partitions where they are (packed or not); the partitions of 
+ * the individuals that do not survive are released.
+ */
+void replace_population(GAContext* ctx, Individual* pop, Individual* children) {
+
+    Individual candidates[2*POP_SIZE];  // parents, then children
+    int idxs[2*POP_SIZE];
+    int scratch[POP_SIZE];              // for the partial sorts
+    int num_survivors = 0;
+
+    for (int idv=0; idv<POP_SIZE; idv++) {
+        candidates[idv] = pop[idv];
+        candidates[POP_SIZE+idv] = children[idv];
+    }
+    for (int i=0; i<2*POP_SIZE; i++) {
+        idxs[i] = i;
     }
 
-cleanup_graph_contents:
-    // free memory used for graph:
-    for (int i=0; i<graph->v; i++) {
-        free((graph->nodes)[i]);
+    if (GEN_REPLACEMENT == GEN_REPLACE_PLUS) {
+        partialsort_idv(idxs, 2*POP_SIZE, POP_SIZE, candidates, scratch);
+        for (int i=0; i<POP_SIZE; i++) {
+            pop[num_survivors++] = candidates[idxs[i]];
+        }
+        for (int i=POP_SIZE; i<2*POP_SIZE; i++) {
+            release_individual(ctx, &candidates[idxs[i]]);
+        }
     }
-    free(graph->nodes);
-    for (int i=0; i<graph->e; i++) {
-        free((graph->edges)[i]);
+    else {
+        partialsort_idv(idxs, POP_SIZE, NUM_ELITES, candidates, scratch);
+        partialsort_idv(idxs+POP_SIZE, POP_SIZE, POP_SIZE-NUM_ELITES, 
+                        candidates, scratch);
+        for (int i=0; i<NUM_ELITES; i++) {
+            pop[num_survivors++] = candidates[idxs[i]];
+        }
+        for (int i=POP_SIZE; i<2*POP_SIZE-NUM_ELITES; i++) {
+            pop[num_survivors++] = candidates[idxs[i]];
+        }
+        for (int i=NUM_ELITES; i<POP_SIZE; i++) {
+            release_individual(ctx, &candidates[idxs[i]]);
+        }
+        for (int i=2*POP_SIZE-NUM_ELITES; i<2*POP_SIZE; i++) {
+            release_individual(ctx, &candidates[idxs[i]]);
+        }
     }
-    free(graph->edges);
-cleanup_graph:
-    free(graph);
 
-    return 0;
+    assert(num_survivors == POP_SIZE);
 }
 
 
 /*
- * Calculates the diversity of the population by finding the hamming distance
- * between each individual's partition. O(POP_SIZE^2) runtime
- * The return value is the average percentage of different bits between any 
- * two given individuals in the population.
+ * Calculates the diversity of the population as the average hamming distance
+ * between any two individuals' partitions, as a fraction of the number of 
+ * nodes. Rather than comparing all POP_SIZE^2 pairs, this counts the number 
+ * of ones c at every locus: the c individuals with a 1 there each differ from
+ * the POP_SIZE-c with a 0, so the locus adds 2*c*(POP_SIZE-c) to the total 
+ * distance over all ordered pairs. The counts for the 32 loci of a word are 
+ * kept as bit-sliced counters (bit plane p holds bit p of every count), so 
+ * adding an individual costs a few word operations. Words where every 
+ * individual agrees are skipped. O(POP_SIZE * num_nodes/32) runtime.
  */
-double calc_diversity(Individual* pop, int num_nodes) {
-    int hdist;
-    double diversity = 0;
-
-    for (int i=0; i<POP_SIZE; i++) {
-        for (int j=0; j<POP_SIZE; j++) {
-
-            hdist = 0;
-            if (i != j) {
-                /*
-                printf("Individual %d:\n", i);
-                printf("\tpartition: ");
-                for( int m=0; m<num_nodes; m++) {
-                    printf("%d", getbit(pop[i].partition, m));
-                }
-                printf("\n");
-                printf("Individual %d:\n", j);
-                printf("\tpartition: ");
-                for( int m=0; m<num_nodes; m++) {
-                    printf("%d", getbit(pop[j].partition, m));
-                }
-                printf("\n");
-                */
+static always_inline double _calc_diversity(Individual* pop,
+                                            int num_nodes,
+                                            const int pop_size) {
+    bitarray_t planes[32];
+    int num_planes = 0;
+    long long total_dist = 0;
+    PackedReader readers[pop_size];  // packed partitions are read in place
+
+    for (int i=0; i<pop_size; i++) {
+        if (pop[i].packed)
+            init_packed_reader(&readers[i], pop[i].packed);
+    }
 
-                for (int k=0; k<RESERVE_BITS(num_nodes); k++) {
-                    hdist += hamming_distance(pop[i].partition[k],
-                                              pop[j].partition[k]
-                                             );
-                }
-                //printf("hamming distance: %d\n", hdist);
+    // enough planes to count up to pop_size
+    while (num_planes < 32 && (1LL << num_planes) <= pop_size)
+        num_planes++;
+
+    for (int k=0; k<RESERVE_BITS(num_nodes); k++) {
+        bitarray_t any = 0;
+        bitarray_t all = 0xFFFFFFFF;
+
+        for (int p=0; p<num_planes; p++) {
+            planes[p] = 0;
+        }
+
+        // ripple-carry add each individual's word into the counters
+        for (int i=0; i<pop_size; i++) {
+            bitarray_t carry = pop[i].packed 
+                               ? packed_read_word(&readers[i], k)
+                               : pop[i].partition[k];
+            any |= carry;
+            all &= carry;
+            for (int p=0; carry && p<num_planes; p++) {
+                bitarray_t next_carry = planes[p] & carry;
+                planes[p] ^= carry;
+                carry = next_carry;
             }
+        }
 
-            diversity += (double)hdist/num_nodes;
+        // only loci where the individuals disagree contribute
+        for (bitarray_t mixed = any & ~all; mixed; mixed &= mixed - 1) {
+            int bit = __builtin_ctz(mixed);
+            long long c = 0;
+            for (int p=0; p<num_planes; p++) {
+                c |= (long long)((planes[p] >> bit) & 1) << p;
+            }
+            total_dist += 2 * c * (pop_size - c);
         }
     }
 
-    return diversity/(POP_SIZE*(POP_SIZE-1));
+    return (double)total_dist / ((double)num_nodes * pop_size * (pop_size-1));
+}
+
+
+/*
+ * _calc_diversity instantiated for common population sizes, where pop_size is
+ * a constant the compiler can fold into the loops and the number of counter
+ * planes
+ */
+#define DIVERSITY_KERNEL(n)                                                 \
+        static double _calc_diversity_##n(Individual* pop, int num_nodes) { \
+            return _calc_diversity(pop, num_nodes, n);                      \
+        }
+
+DIVERSITY_KERNEL(32)
+DIVERSITY_KERNEL(40)
+DIVERSITY_KERNEL(64)
+DIVERSITY_KERNEL(128)
+
+
+double calc_diversity(Individual* pop, int num_nodes) {
+    switch (POP_SIZE) {
+        case 32:
+            return _calc_diversity_32(pop, num_nodes);
+        case 40:
+            return _calc_diversity_40(pop, num_nodes);
+        case 64:
+            return _calc_diversity_64(pop, num_nodes);
+        case 128:
+            return _calc_diversity_128(pop, num_nodes);
+        default:
+            return _calc_diversity(pop, num_nodes, POP_SIZE);
+    }
 }
 
 
@@ -530,40 +2703,29 @@ int calc_fitness(Graph* graph, Individual* indiv) {
 
 
 /*
- * Initializes random partitions for POP_SIZE individuals in a given 
- * population (array of individuals)
+ * Creates a random partition of num_nodes nodes, using the xorshift state rng
  */
-void init_population(Individual* population, int num_nodes) {
+void random_partition(bitarray_t* partition, int num_nodes, uint32_t* rng) {
 
-    for (int i=0; i<POP_SIZE; i++) {
-        // allocate memory for the individual's partition
-        population[i].partition =
-                malloc(RESERVE_BITS(num_nodes) * sizeof(bitarray_t));
-        CHECK_MALLOC_ERR(population[i].partition);
-
-        // initialize partitions to 0:
-        for (int j=0; j<RESERVE_BITS(num_nodes); j++) {
-            (population[i].partition)[j] = 0;
-        }
-
-        // create a random starting partition:
-        for (int j=0; j<num_nodes; j++) {
-            int rand_bit = urandint(2);
-            putbit(population[i].partition, j, rand_bit);
-        }
+    // a random word at a time; the bits past the last node stay 0
+    for (int j=0; j<RESERVE_BITS(num_nodes); j++) {
+        partition[j] = xorshift32(rng);
     }
+    if (BIT_INDEX(num_nodes))
+        partition[DW_INDEX(num_nodes)] &= (1u << BIT_INDEX(num_nodes)) - 1;
 }
 
 
 /*
- * Shuffes the array of integers passed to the function
+ * Shuffes the array of integers passed to the function, using the xorshift
+ * state rng
  * Citation: benpfaff.org/writings/clc/shuffle.html
  */
-void shuffle(int *arr, int n) {
+void shuffle(int *arr, int n, uint32_t* rng) {
     if (n > 1) {
         int i;
         for (i = 0; i < n - 1; i++) {
-            int j = i + rand() / (RAND_MAX / (n - i) + 1);
+            int j = i + xorshift_int(rng, n - i);
             int t = arr[j];
             arr[j] = arr[i];
             arr[i] = t;
@@ -8,13 +8,216 @@
 #ifndef _GAA_SW_H_
 #define _GAA_SW_H_
 
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "adaptive-rates.h"
+#include "cluster.h"
+#include "crossover.h"
 #include "ga-params.h"
+#include "genome-pool.h"
 #include "graph.h"
+#include "local-search.h"
+#include "migrant-ring.h"
+#include "packed-genome.h"
+
+/*
+ * What a run of the GA found, and what it took (see run_ga())
+ */
+typedef struct GAResult {
+    int best_fitness;
+    int generations;       // completed by every island
+    long num_children;
+    long num_evaluations;
+    double wall_time;      // seconds
+} GAResult;
+
+
+/*
+ * Counters and timers reported at the end of a run
+ */
+typedef struct GAStats {
+    double selection_time;
+    double crossover_time;   // crossover and mutation
+    double fitness_time;
+    double refinement_time;
+    double diversity_time;
+    double migration_time;
+    long num_children;       // number of children produced
+    long num_evaluations;    // number of calls to calc_fitness, balance
+                             // repairs and local search passes, each of
+                             // which works out a fitness
+    long num_inherited;      // children that were exact copies of a parent
+                             // and inherited its fitness instead
+    long num_refinements;    // number of local search passes
+    long num_repairs;        // number of children rebalanced
+    long num_migrants;       // migrants sent to other islands
+    long num_stale;          // migrants discarded on arrival as stale
+} GAStats;
+
+/*
+ * Everything the genetic operators need to produce children on one island:
+ * the graph, scratch memory, random number generator state, operator rates
+ * and statistics
+ */
+typedef struct GAContext {
+    Graph* graph;
+    GenomePool* genome_pool;                 // storage for all partitions
+    PackedStore* packed_store;               // with COMPACT_STORAGE:
+    PackedGenome* reference;                 // partition the island's 
+                                             // members are packed against
+    bitarray_t* parent_rows[2];              // rows the parents of a pair are
+                                             // unpacked to
+    bitarray_t* child_rows[2];               // rows the children of a pair 
+                                             // are made in
+    uint32_t rng;                            // xorshift state
+    GenomeDiff diffs[2];                     // how each child of a pair 
+                                             // differs from its nearest parent
+    LocalSearch local_search;
+    PartitionCrossover partition_crossover;
+    OperatorRates rates;                     // current operator rates
+    GAStats stats;
+} GAContext;
+
+/*
+ * What produce_children leaves for settle_children to do about a pair of
+ * children
+ */
+typedef struct ChildPair {
+    int parent_idxs[2];  // in the population
+    int crossover_op;    // OP_...
+    int copy_of[2];      // index of the parent each child is an exact copy
+                         // of, or -1
+} ChildPair;
+
+/*
+ * Scratch memory of a thread that makes or evaluates the children of
+ * whichever islands it serves: a scheduler worker (NUM_WORKERS) or a
+ * pipeline evaluator (PIPELINE_EVALUATORS)
+ */
+typedef struct TaskContext {
+    GAContext ctx;
+    GenomePool genome_pool;  // with COMPACT_STORAGE, rows to make the
+                             // children in and unpack their parents to
+    PackedStore packed_store;
+} TaskContext;
+
+/*
+ * An island and the thread that evolves it. While the thread runs, all but
+ * its progress is used by that thread alone, apart from the island's 
+ * avg_fitness, which islands sending migrants to it read, and stop. The
+ * progress is written by the island's thread and read by the main thread,
+ * with atomic loads and stores, on cache lines of its own.
+ *
+ * With ISLAND_PROCESSES the island is evolved by a process of its own
+ * instead. The workers are then in shared memory, as are the migrant rings,
+ * the best copies and the migration_probs they point to, so the processes
+ * see each other's writes to those just as threads would; everything else
+ * an island allocates is its own process's.
+ *
+ * With NUM_WORKERS there is no thread of the island's own: its work is done
+ * by tasks on any of the scheduler's workers, one at a time, apart from the
+ * child pairs of a generation, which may be made at once and which settle
+ * what they change of the island while holding its lock.
+ */
+typedef struct IslandWorker {
+    int isl;
+    Graph* graph;
+    Island island;
+    GAContext ctx;
+    GenomePool genome_pool;          // the island's partitions
+    PackedStore packed_store;
+    bitarray_t* genome_arena;        // memory for genome_pool's rows
+    uint32_t seed;
+    Individual best;                 // copy of the best individual found on
+                                     // the island so far
+    MigrantRing** out_rings;         // route to each of island.neighbours
+    MigrantRing** in_rings;          // routes from the islands that have
+                                     // this one as a neighbour
+    int num_in_rings;
+    MigrantRing* export_ring;        // in a cluster, for island 0: to the
+                                     // main thread, to send to the next host
+    MigrantRing* import_ring;        // and from it (also among in_rings)
+    struct IslandWorker* workers;    // every island, by index
+    pthread_t thread;
+    pid_t pid;                       // with ISLAND_PROCESSES, the island's
+                                     // process until it has been waited for
+    int failed;                      // 1 if that process did not exit
+                                     // normally
+    int stop;                        // set by the main thread to make the
+                                     // island stop
+    Individual* children;            // of the generation in progress
+    Individual offspring[2];         // the steady-state children
+
+    // with NUM_WORKERS, for the child pairs of the generation in progress
+    uint32_t* pair_seeds;            // random number seed of each
+    OperatorRates gen_rates;         // rates they are made at
+    int pairs_pending;               // number not yet settled
+    pthread_mutex_t lock;            // held to settle one
+
+    struct StageRing* stages;        // with PIPELINE_EVALUATORS, the batches
+                                     // of children between the island's
+                                     // thread and its evaluator
+
+    // progress
+    int gen __attribute__((aligned(CACHE_LINE)));  // generations complete, 
+                                                   // -1 before the first
+    int best_fitness;
+    long num_children;
+    long num_evaluations;
+    double diversity;  // of the population after gen generations
+    long elite_version;  // times the island has sent new elites
+} IslandWorker;
 
-double calc_diversity (Individual*, int);
-int    calc_fitness   (Graph*, Individual*);
-void   init_population(Individual*, int);
-void   shuffle        (int*, int);
+void   add_stats         (GAStats*, const GAStats*);
+int    begin_generation  (IslandWorker*, int);
+double calc_diversity    (Individual*, int);
+int    calc_fitness      (Graph*, Individual*);
+void   copy_partition    (GAContext*, const Individual*, bitarray_t*);
+void   end_generation    (IslandWorker*);
+void   evaluate_children (GAContext*, Individual*, Individual*,
+                          const ChildPair*);
+void   free_context      (GAContext*);
+void   free_island       (Island*, GAContext*);
+void   free_routes       (IslandWorker*, MigrantRing*);
+void   free_task_context (TaskContext*);
+int    ga_threads        (void);
+void   init_context      (GAContext*, Graph*, GenomePool*, PackedStore*, 
+                          uint32_t);
+void   init_task_context (TaskContext*, Graph*, bitarray_t*);
+void   init_island       (Island*, int, GenomePool*);
+MigrantRing* init_routes (IslandWorker*, int, int*);
+int    island_neighbours (int, int*);
+void   make_children     (GAContext*, Individual*, Individual*, Individual*);
+void   pack_individual   (GAContext*, Individual*);
+double peak_resident_mb  (int);
+void   pipeline_generation(IslandWorker*);
+void   produce_children  (GAContext*, Individual*, Individual*, Individual*,
+                          ChildPair*);
+void   random_partition  (bitarray_t*, int, uint32_t*);
+int    reap_islands      (IslandWorker*, int);
+void   rebase_island     (GAContext*, Individual*);
+void   receive_migrant   (GAContext*, Individual*, const bitarray_t*, int);
+void   receive_migrants  (IslandWorker*, int);
+void   release_individual(GAContext*, Individual*);
+void   replace_individual(GAContext*, Individual*, Individual*);
+void   replace_population(GAContext*, Individual*, Individual*);
+void*  run_evaluator     (void*);
+void   run_ga            (Graph*, GAResult*, bitarray_t*);
+void*  run_island        (void*);
+void   send_migrants     (IslandWorker*, int);
+void   settle_children   (GAContext*, Individual*, Individual*, Individual*,
+                          const ChildPair*);
+void   shuffle           (int*, int, uint32_t*);
+void   start_island      (IslandWorker*);
+void   steady_state_generation(IslandWorker*);
+void   stop_island       (IslandWorker*);
+void   unpack_individual (GAContext*, Individual*, bitarray_t*);
+void   vary_children     (GAContext*, Individual*, Individual*, Individual*,
+                          ChildPair*);
+const char* stopping_criterion(int, const Individual*, long, double, int, 
+                               const double*);
 
 #endif  /* _GAA_SW_H */
 
@@ -27,6 +27,8 @@
 #include "ga-utils.h"
 #include "gaa_fitness_driver.h"
 #include "graph-parser.h"
+#include "large-alloc.h"
+#include "mem-track.h"
 #include "mergesort.h"
 #include "selection.h"
 
@@ -66,10 +68,13 @@ int main(int argc, char** argv) {
 
     
 
-    if (argc != 2) {
-        fprintf(stderr, "%s\n", "usage: gaa <graph_file>");
+    char* graph_file;
+
+    // read the GA parameters, and the graph file, from the command line
+    if (!parse_ga_params(argc, argv, &graph_file)) {
         exit(1);
     }
+    set_memory_limit((long)(MAX_MEMORY * (1 << 20)));
 
     // TEST DRIVER
     int gaa_fitness_fd;
@@ -147,16 +152,18 @@ int main(int argc, char** argv) {
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &total_start);
 
     // allocate memory for a graph struct
-    graph = malloc(sizeof(Graph));
+    graph = tracked_malloc(MEM_GRAPH, sizeof(Graph));
     CHECK_MALLOC_ERR(graph);
 
     // parse graph from file specified on command line
-    if (!parse_graph_from_file(argv[1], graph)) {
-        goto cleanup_graph;
+    if (!parse_graph_from_file(graph_file, graph)) {
+        tracked_free(graph);
+        exit(1);
     }
     
-    // seed random number generator
+    // seed random number generators
     srand(time(0));
+    uint32_t rng = (uint32_t)rand() | 1;  // xorshift state for selection
     
     double total_inverse_fitness = 0;  // used in selection to select 
                                        // individuals with probability 
@@ -164,12 +171,6 @@ int main(int argc, char** argv) {
                                        // fitness (since we are looking to
                                        // minimize fitness)
 
-    // initialize islands and their populations
-    if (!POP_SIZE % 2) {
-        fprintf(stderr, "POPULATION SIZE MUST BE AN EVEN NUMBER");
-        goto cleanup_graph_contents;
-    }
-
     // array of islands, on each island is a population
     Individual* archipelago[NUM_ISLANDS];
 
@@ -208,6 +209,8 @@ int main(int argc, char** argv) {
             sorted_indices_list[i][j] = j;
         }
     }
+    int* sort_scratch = malloc(POP_SIZE * sizeof(int));
+    CHECK_MALLOC_ERR(sort_scratch);
     
     /* EVOLUTIONARY LOOP */
     for (int gen=0; gen<NUM_GENERATIONS; gen++) {
@@ -251,10 +254,10 @@ int main(int argc, char** argv) {
 
             // sort the indicies for each island by fitness
             for (int isl=0; isl<NUM_ISLANDS; isl++) {
-                mergesort_idv(sorted_indices_list[isl], 
-                              0, 
-                              POP_SIZE-1, 
-                              archipelago[isl]
+                radixsort_idv(sorted_indices_list[isl], 
+                              POP_SIZE, 
+                              archipelago[isl],
+                              sort_scratch
                              );
             }
 
@@ -329,9 +332,10 @@ int main(int argc, char** argv) {
                 int parent_idxs[2] = {-1, -1};
                 clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &selection_start);
 
-                parent_idxs[0] = tournament_selection(archipelago[isl]);
+                parent_idxs[0] = tournament_selection(archipelago[isl], &rng);
                 do {
-                    parent_idxs[1] = tournament_selection(archipelago[isl]);
+                    parent_idxs[1] = tournament_selection(archipelago[isl], 
+                                                          &rng);
                 } while (parent_idxs[0] == parent_idxs[1]);
 
                 clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &selection_stop);
@@ -503,6 +507,7 @@ int main(int argc, char** argv) {
         free(sorted_indices_list[isl]);
     }
     free(sorted_indices_list);
+    free(sort_scratch);
 
     // Free population on each island
     for (int isl=0; isl<NUM_ISLANDS; isl++) {
@@ -512,66 +517,74 @@ int main(int argc, char** argv) {
         free(archipelago[isl]);
     }
 
-cleanup_graph_contents:
     // free memory used for graph:
     for (int i=0; i<graph->v; i++) {
-        free((graph->nodes)[i]);
+        tracked_free((graph->nodes)[i]);
     }
-    free(graph->nodes);
-    for (int i=0; i<graph->e; i++) {
-        free((graph->edges)[i]);
-    }
-    free(graph->edges);
-cleanup_graph:
-    free(graph);
+    tracked_free(graph->nodes);
+    tracked_free(graph->edges);
+    large_free(graph->edge_list);
+    large_free(graph->adj_index);
+    large_free(graph->adj_nodes);
+    large_free(graph->adj_weights);
+    tracked_free(graph);
 
     return 0;
 }
 
 
 /*
- * Calculates the diversity of the population by finding the hamming distance
- * between each individual's partition. O(POP_SIZE^2) runtime
- * The return value is the average percentage of different bits between any 
- * two given individuals in the population.
+ * Calculates the diversity of the population as the average hamming distance
+ * between any two individuals' partitions, as a fraction of the number of 
+ * nodes. Rather than comparing all POP_SIZE^2 pairs, this counts the number 
+ * of ones c at every locus: the c individuals with a 1 there each differ from
+ * the POP_SIZE-c with a 0, so the locus adds 2*c*(POP_SIZE-c) to the total 
+ * distance over all ordered pairs. The counts for the 32 loci of a word are 
+ * kept as bit-sliced counters (bit plane p holds bit p of every count), so 
+ * adding an individual costs a few word operations. Words where every 
+ * individual agrees are skipped. O(POP_SIZE * num_nodes/32) runtime.
  */
 double calc_diversity(Individual* pop, int num_nodes) {
-    int hdist;
-    double diversity = 0;
+    bitarray_t planes[32];
+    int num_planes = 0;
+    long long total_dist = 0;
 
-    for (int i=0; i<POP_SIZE; i++) {
-        for (int j=0; j<POP_SIZE; j++) {
+    // enough planes to count up to POP_SIZE
+    while (num_planes < 32 && (1LL << num_planes) <= POP_SIZE)
+        num_planes++;
 
-            hdist = 0;
-            if (i != j) {
-                /*
-                printf("Individual %d:\n", i);
-                printf("\tpartition: ");
-                for( int m=0; m<num_nodes; m++) {
-                    printf("%d", getbit(pop[i].partition, m));
-                }
-                printf("\n");
-                printf("Individual %d:\n", j);
-                printf("\tpartition: ");
-                for( int m=0; m<num_nodes; m++) {
-                    printf("%d", getbit(pop[j].partition, m));
-                }
-                printf("\n");
-                */
+    for (int k=0; k<RESERVE_BITS(num_nodes); k++) {
+        bitarray_t any = 0;
+        bitarray_t all = 0xFFFFFFFF;
 
-                for (int k=0; k<RESERVE_BITS(num_nodes); k++) {
-                    hdist += hamming_distance(pop[i].partition[k],
-                                              pop[j].partition[k]
-                                             );
-                }
-                //printf("hamming distance: %d\n", hdist);
+        for (int p=0; p<num_planes; p++) {
+            planes[p] = 0;
+        }
+
+        // ripple-carry add each individual's word into the counters
+        for (int i=0; i<POP_SIZE; i++) {
+            bitarray_t carry = pop[i].partition[k];
+            any |= carry;
+            all &= carry;
+            for (int p=0; carry && p<num_planes; p++) {
+                bitarray_t next_carry = planes[p] & carry;
+                planes[p] ^= carry;
+                carry = next_carry;
             }
+        }
 
-            diversity += (double)hdist/num_nodes;
+        // only loci where the individuals disagree contribute
+        for (bitarray_t mixed = any & ~all; mixed; mixed &= mixed - 1) {
+            int bit = __builtin_ctz(mixed);
+            long long c = 0;
+            for (int p=0; p<num_planes; p++) {
+                c |= (long long)((planes[p] >> bit) & 1) << p;
+            }
+            total_dist += 2 * c * (POP_SIZE - c);
         }
     }
 
-    return diversity/(POP_SIZE*(POP_SIZE-1));
+    return (double)total_dist / ((double)num_nodes * POP_SIZE * (POP_SIZE-1));
 }
 
 
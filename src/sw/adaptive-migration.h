@@ -0,0 +1,50 @@
+/*
+ * adaptive-migration.h
+ *
+ * Online adaptation of the probabilities with which an island sends its
+ * migrants along each route, based on whether the migrants sent on it were
+ * fitter than the island they arrived at.
+ *
+ */
+
+#ifndef _ADAPTIVE_MIGRATION_H_
+#define _ADAPTIVE_MIGRATION_H_
+
+#include "ga-params.h"
+#include "ga-utils.h"
+
+
+/*
+ * Rewards the route to island dest by PROB_ISLAND_REWARD if rewarded, or
+ * penalizes it by PROB_ISLAND_PENALTY if not, and shares 1 - PROB_ISLAND_STAY
+ * out again over the routes to the num_neighbours islands in neighbours, in
+ * proportion to their probabilities in probs. Every route keeps at least
+ * PROB_ISLAND_MIN, or an equal share if there are too many routes for that.
+ */
+static inline void adapt_migration_probs(double* probs,
+                                         const int* neighbours,
+                                         int num_neighbours,
+                                         int dest,
+                                         int rewarded) {
+
+    double share = 1 - PROB_ISLAND_STAY;
+    double floor = MIN(PROB_ISLAND_MIN, share / num_neighbours);
+    double total = 0;
+
+    if (rewarded)
+        probs[dest] += PROB_ISLAND_REWARD;
+    else
+        probs[dest] -= PROB_ISLAND_PENALTY;
+    probs[dest] = MAX(probs[dest], 0);
+
+    for (int i=0; i<num_neighbours; i++) {
+        total += probs[neighbours[i]];
+    }
+    for (int i=0; i<num_neighbours; i++) {
+        int nb = neighbours[i];
+        double weight = total > 0 ? probs[nb] / total : 1.0 / num_neighbours;
+        probs[nb] = floor + (share - num_neighbours*floor) * weight;
+    }
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * adaptive-rates.h
+ *
+ * Online adaptation of the genetic operator rates of one island, based on
+ * how often the children produced by each operator improve on their parents.
+ *
+ */
+
+#ifndef _ADAPTIVE_RATES_H_
+#define _ADAPTIVE_RATES_H_
+
+#include "ga-params.h"
+#include "ga-utils.h"
+
+// crossover operators the rates choose between
+#define OP_UNIFORM   0  // parameterized uniform crossover
+#define OP_PARTITION 1  // partition crossover
+#define NUM_CROSSOVER_OPS 2
+
+
+/*
+ * Current operator rates of an island and the credit each operator has
+ * earned. A child is a success for its crossover operator if it is fitter
+ * than the fitter of its parents. For the mutation rate, a child that is no
+ * less fit than its fitter parent counts as a success; children that are
+ * exact copies of a parent say nothing about the mutation rate and are left
+ * out of the window.
+ */
+typedef struct OperatorRates {
+    double mutation_prob;  // per-locus mutation probability
+    double px_prob;        // probability of choosing partition crossover
+    double quality[NUM_CROSSOVER_OPS];  // running average success rate of
+                                        // each crossover operator
+    long uses[NUM_CROSSOVER_OPS];       // children made with each operator
+    long successes[NUM_CROSSOVER_OPS];  // ... and how many were successes
+    int window_children;   // children (other than copies of a parent) since
+                           // the mutation rate was last adapted
+    int window_successes;  // successes among them
+} OperatorRates;
+
+
+static inline void init_operator_rates(OperatorRates* rates) {
+    rates->mutation_prob = MUTATION_PROB;
+    rates->px_prob = PX_PROB;
+    for (int op=0; op<NUM_CROSSOVER_OPS; op++) {
+        rates->quality[op] = 0;
+        rates->uses[op] = 0;
+        rates->successes[op] = 0;
+    }
+    rates->window_children = 0;
+    rates->window_successes = 0;
+}
+
+
+/*
+ * Updates the rates every ADAPT_PERIOD children:
+ *
+ * The mutation probability follows the 1/5th success rule: if more than a
+ * fifth of the recent (non-copy) children were successes it is multiplied by
+ * ADAPT_FACTOR (take bigger steps), if fewer it is divided by it, within
+ * [MUTATION_PROB_MIN, MUTATION_PROB_MAX].
+ *
+ * The crossover operator is chosen by probability matching: each operator is
+ * picked with probability proportional to its running average success rate,
+ * but never less than ADAPT_MIN_OP_PROB so that both keep being tried.
+ */
+static inline void _adapt_rates(OperatorRates* rates) {
+
+    double success_rate = (double)rates->window_successes
+                          / rates->window_children;
+
+    if (success_rate > 0.2)
+        rates->mutation_prob *= ADAPT_FACTOR;
+    else if (success_rate < 0.2)
+        rates->mutation_prob /= ADAPT_FACTOR;
+    rates->mutation_prob = MAX(MUTATION_PROB_MIN,
+                               MIN(MUTATION_PROB_MAX, rates->mutation_prob));
+
+    double total_quality = rates->quality[OP_UNIFORM]
+                           + rates->quality[OP_PARTITION];
+    if (total_quality > 0) {
+        rates->px_prob = ADAPT_MIN_OP_PROB
+                         + (1 - 2*ADAPT_MIN_OP_PROB)
+                           * rates->quality[OP_PARTITION] / total_quality;
+    }
+}
+
+
+/*
+ * Credits crossover operator op with a child of the given fitness whose
+ * fitter parent had fitness parent_fitness (is_copy is set if the child was
+ * an exact copy of a parent), and adapts the rates at the end of each window
+ */
+static inline void credit_operator(OperatorRates* rates,
+                                   int op,
+                                   int parent_fitness,
+                                   int child_fitness,
+                                   int is_copy) {
+
+    int success = (child_fitness < parent_fitness);
+
+    rates->uses[op]++;
+    rates->successes[op] += success;
+    rates->quality[op] += ADAPT_LEARNING_RATE * (success - rates->quality[op]);
+
+    if (is_copy)
+        return;
+
+    rates->window_children++;
+    rates->window_successes += (child_fitness <= parent_fitness);
+
+    if (rates->window_children >= ADAPT_PERIOD) {
+        if (ADAPTIVE_RATES)
+            _adapt_rates(rates);
+        rates->window_children = 0;
+        rates->window_successes = 0;
+    }
+}
+
+#endif /* _ADAPTIVE_RATES_H_ */
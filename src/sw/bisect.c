@@ -0,0 +1,339 @@
+/*
+ * bisect.c
+ *
+ * Partitioning into NUM_PARTS parts by recursive bisection, the bisections
+ * of each level running at once (see bisect.h)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L  // clock_gettime (in ga-utils.h)
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <math.h>    // pow
+#include <stdio.h>   // printf, fopen
+#include <string.h>  // memset
+#include <time.h>    // time
+
+#include "bisect.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "graph-parser.h"
+#include "job-pool.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+
+
+// what the tasks' processes are started from
+typedef struct Bisection {
+    BisectTask* tasks;
+    int first_seed;        // of task 0, task t's being first_seed + t
+} Bisection;
+
+
+/*
+ * Runs the GA, in the process of task t of bisection, on the task's graph
+ * with its seed, and leaves its result and partition in shared memory.
+ * Returns the process's exit status.
+ */
+static int _run_task(void* arg, int t) {
+    Bisection* bisection = arg;
+    BisectTask* task = &bisection->tasks[t];
+
+    // a part of fewer than 2 nodes stays whole, its result and partition
+    // left as cleared
+    ga_params.seed = bisection->first_seed + t;
+    if (task->graph.v >= 2)
+        run_ga(&task->graph, task->result, task->partition);
+    return 0;
+}
+
+
+/*
+ * Writes the part of each of the num_nodes nodes to filename, one per line.
+ * Returns 1 on success, 0 (after printing why) on failure.
+ */
+int write_parts_file(const char* filename, const int* parts, int num_nodes) {
+    FILE* fp = fopen(filename, "w");
+    if (NULL == fp) {
+        perror(filename);
+        return 0;
+    }
+
+    for (int i=0; i<num_nodes; i++) {
+        fprintf(fp, "%d\n", parts[i]);
+    }
+
+    if (fclose(fp) != 0) {
+        perror(filename);
+        return 0;
+    }
+
+    printf("Parts written to %s\n", filename);
+    return 1;
+}
+
+
+/*
+ * Partitions graph into NUM_PARTS parts by recursive bisection, as many
+ * bisections at once as fit in BISECT_CORES cores, prints the parts, and
+ * writes them to PARTS_FILE if that is set. A stop signal stops the running
+ * bisections early and starts no more. Returns 1 on success, 0 (after
+ * printing why) if a bisection failed or was stopped.
+ */
+int run_bisection(Graph* graph) {
+
+    int num_levels = 0;
+    while ((1 << num_levels) < NUM_PARTS)
+        num_levels++;
+    int num_tasks = NUM_PARTS - 1;
+
+    // the tolerances of the final parts, shared out among the levels
+    double balance_tolerance = BALANCE_TOLERANCE;
+    double fm_max_imbalance = FM_MAX_IMBALANCE;
+    ga_params.balance_tolerance = pow(1 + BALANCE_TOLERANCE,
+                                      1.0 / num_levels) - 1;
+    ga_params.fm_max_imbalance = pow(1 + FM_MAX_IMBALANCE,
+                                     1.0 / num_levels) - 1;
+
+    int task_cores = ga_threads();
+    int first_seed = SEED ? SEED : (int)(time(0) & 0x3fffffff) + 1;
+
+    BisectTask* tasks = tracked_malloc(MEM_POPULATION,
+                                       num_tasks * sizeof(BisectTask));
+    CHECK_MALLOC_ERR(tasks);
+    memset(tasks, 0, num_tasks * sizeof(BisectTask));
+
+    // the partitions of a level cover each node of the graph once, so those
+    // of every level fit in num_levels partitions of the graph, and a word
+    // more for each
+    size_t partition_words = (size_t)num_levels * RESERVE_BITS(graph->v)
+                             + num_tasks;
+    bitarray_t* partitions = large_alloc_shared("bisection partitions",
+                                                MEM_POPULATION,
+                                                partition_words
+                                                * sizeof(bitarray_t));
+    size_t words_used = 0;
+    GAResult* results = large_alloc_shared("bisection results",
+                                           MEM_IO,
+                                           num_tasks * sizeof(GAResult));
+
+    int* parts = tracked_malloc(MEM_IO, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(parts);
+
+    // tasks are queued as their graphs are extracted, so level by level
+    int* queue = tracked_malloc(MEM_IO, num_tasks * sizeof(int));
+    CHECK_MALLOC_ERR(queue);
+    int queue_head = 0;
+    int queue_tail = 0;
+
+    tasks[0].graph = *graph;
+    tasks[0].node_map = NULL;
+    tasks[0].level = 0;
+    tasks[0].first_part = 0;
+    queue[queue_tail++] = 0;
+
+    Bisection bisection = {tasks, first_seed};
+    JobPool pool;
+    init_job_pool(&pool, BISECT_CORES, num_tasks, _run_task, &bisection);
+
+    printf("Bisecting into %d parts over %d levels on %d core%s (tolerances "
+           "%g and %g per level)...\n",
+           NUM_PARTS,
+           num_levels,
+           pool.num_cores,
+           pool.num_cores == 1 ? "" : "s",
+           BALANCE_TOLERANCE,
+           FM_MAX_IMBALANCE
+          );
+    printf("\tLevel  Parts            Nodes     Edges   Fitness  "
+           "Generations  Time (s)\n");
+
+    double start = wall_seconds();
+    double extract_time = 0;
+    int num_done = 0;
+    int failed = 0;
+
+    while (num_done < num_tasks) {
+
+        // start the queued tasks while their cores are free
+        while (!failed
+               && queue_head < queue_tail
+               && job_fits(&pool, task_cores)) {
+            int t = queue[queue_head++];
+            BisectTask* task = &tasks[t];
+
+            task->partition = partitions + words_used;
+            words_used += RESERVE_BITS(task->graph.v);
+            assert(words_used <= partition_words);
+            task->result = &results[t];
+            start_job(&pool, t, task_cores);
+        }
+
+        int task_failed;
+        int t = wait_job(&pool, &task_failed);
+        if (t < 0)
+            break;
+        num_done++;
+
+        BisectTask* task = &tasks[t];
+        if (task_failed) {
+            fprintf(stderr, "Bisection of parts %d-%d failed\n",
+                    task->first_part,
+                    task->first_part + (NUM_PARTS >> task->level) - 1);
+            failed = 1;
+        }
+        else {
+            printf("\t%5d  %5d-%-5d  %10d  %8d  %8d  %11d  %8.2f\n",
+                   task->level,
+                   task->first_part,
+                   task->first_part + (NUM_PARTS >> task->level) - 1,
+                   task->graph.v,
+                   task->graph.e,
+                   task->result->best_fitness,
+                   task->result->generations,
+                   task->result->wall_time
+                  );
+            fflush(stdout);
+
+            if (task->level == num_levels - 1) {
+                // its halves are parts
+                for (int i=0; i<task->graph.v; i++) {
+                    int node = task->node_map ? task->node_map[i] : i;
+                    parts[node] = task->first_part
+                                  + getbit(task->partition, i);
+                }
+            }
+            else {
+                // its halves are the next level's tasks
+                double extract_start = wall_seconds();
+
+                for (int side=0; side<2; side++) {
+                    BisectTask* half = &tasks[2*t + 1 + side];
+
+                    half->node_map = tracked_malloc(MEM_GRAPH,
+                                                    MAX(task->graph.v, 1)
+                                                    * sizeof(int));
+                    CHECK_MALLOC_ERR(half->node_map);
+                    induced_subgraph(&task->graph,
+                                     task->partition,
+                                     side,
+                                     &half->graph,
+                                     half->node_map);
+
+                    // numbered in the whole graph
+                    for (int i=0; i<half->graph.v && task->node_map; i++) {
+                        half->node_map[i] = task->node_map[half->node_map[i]];
+                    }
+                    half->level = task->level + 1;
+                    half->first_part = task->first_part
+                                       + side * (NUM_PARTS >> half->level);
+                    queue[queue_tail++] = 2*t + 1 + side;
+                }
+
+                extract_time += wall_seconds() - extract_start;
+            }
+        }
+
+        if (t > 0) {
+            free_graph(&task->graph);
+            tracked_free(task->node_map);
+        }
+    }
+
+    double wall_time = wall_seconds() - start;
+    ga_params.balance_tolerance = balance_tolerance;
+    ga_params.fm_max_imbalance = fm_max_imbalance;
+
+    // the tasks that never ran still hold their graphs
+    for (int q=queue_head; q<queue_tail; q++) {
+        free_graph(&tasks[queue[q]].graph);
+        tracked_free(tasks[queue[q]].node_map);
+    }
+
+    int complete = (num_done == num_tasks && !failed);
+    if (jobs_stopped())
+        printf("Stopped: signal %d, with %d of %d bisections done\n",
+               jobs_stopped(), num_done, num_tasks);
+    printf("\n");
+
+    if (complete) {
+        long* part_weights = tracked_malloc(MEM_IO,
+                                            NUM_PARTS * sizeof(long));
+        int* part_nodes = tracked_malloc(MEM_IO, NUM_PARTS * sizeof(int));
+        CHECK_MALLOC_ERR(part_weights);
+        CHECK_MALLOC_ERR(part_nodes);
+        memset(part_weights, 0, NUM_PARTS * sizeof(long));
+        memset(part_nodes, 0, NUM_PARTS * sizeof(int));
+
+        long total_weight = 0;
+        for (int i=0; i<graph->v; i++) {
+            part_weights[parts[i]] += (graph->nodes)[i]->weight;
+            part_nodes[parts[i]]++;
+            total_weight += (graph->nodes)[i]->weight;
+        }
+
+        long edge_cut = 0;
+        for (int i=0; i<graph->e; i++) {
+            Edge* edge = (graph->edges)[i];
+            if (parts[edge->n1] != parts[edge->n2])
+                edge_cut += edge->weight;
+        }
+
+        long max_weight = 0;
+        printf("Parts:\n");
+        printf("\t  Part     Nodes    Weight\n");
+        for (int p=0; p<NUM_PARTS; p++) {
+            printf("\t%6d  %8d  %8ld\n", p, part_nodes[p], part_weights[p]);
+            max_weight = MAX(max_weight, part_weights[p]);
+        }
+        printf("\tEdge cut:      %ld\n", edge_cut);
+        printf("\tHeaviest part: %ld (%.2f%% over an equal share)\n",
+               max_weight,
+               100 * ((double)max_weight * NUM_PARTS / total_weight - 1)
+              );
+        printf("\n");
+
+        tracked_free(part_weights);
+        tracked_free(part_nodes);
+    }
+
+    // the time of the longest chain of bisections, from the whole graph
+    // down to a part, which bounds the wall time however many cores there
+    // are
+    double total_time = 0;
+    double chain_time = 0;
+    for (int t=0; t<num_tasks && complete; t++) {
+        total_time += results[t].wall_time;
+        if (2*t + 1 >= num_tasks) {
+            double time = 0;
+            for (int up=t; ; up=(up - 1)/2) {
+                time += results[up].wall_time;
+                if (up == 0)
+                    break;
+            }
+            chain_time = MAX(chain_time, time);
+        }
+    }
+
+    printf("Timing info:\n");
+    printf("\tWall clock time:            %8.2f sec\n", wall_time);
+    if (complete) {
+        printf("\tBisections one at a time:   %8.2f sec\n", total_time);
+        printf("\tLongest chain of bisections:%8.2f sec\n", chain_time);
+    }
+    printf("\tExtracting subgraphs:       %8.2f sec\n", extract_time);
+
+    if (complete && PARTS_FILE[0] && !write_parts_file(PARTS_FILE,
+                                                       parts,
+                                                       graph->v))
+        complete = 0;
+
+    free_job_pool(&pool);
+    large_free(results);
+    large_free(partitions);
+    tracked_free(queue);
+    tracked_free(parts);
+    tracked_free(tasks);
+
+    return complete;
+}
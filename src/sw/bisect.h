@@ -0,0 +1,53 @@
+/*
+ * bisect.h
+ *
+ * header file for bisect.c
+ *
+ * Recursive bisection (NUM_PARTS > 2): the GA bisects the graph, then each
+ * half as the subgraph it induces, and so on for log2(NUM_PARTS) levels,
+ * until there are NUM_PARTS parts. Each bisection is a task, run in a
+ * process forked once its subgraph has been extracted (job-pool.h), so that
+ * it shares the subgraph's pages and leaves its best partition in shared
+ * memory. The two tasks a bisection makes are independent of each other,
+ * so the tasks of a level run at once, as many as fit in BISECT_CORES cores;
+ * with enough cores the wall time is that of the first bisection, plus one
+ * bisection of each level below, each of a graph half the size of the one
+ * above.
+ *
+ * A bisection may leave its parts apart in weight by BALANCE_TOLERANCE of
+ * their total, so over L levels the heaviest part could grow to
+ * (1 + BALANCE_TOLERANCE)^L times its share. Each level is therefore
+ * bisected with the tolerance (1 + BALANCE_TOLERANCE)^(1/L) - 1, and
+ * likewise for FM_MAX_IMBALANCE, so that the final parts keep to the
+ * tolerances set.
+ *
+ */
+
+#ifndef _BISECT_H_
+#define _BISECT_H_
+
+#include "bitarray.h"
+#include "GAA-sw.h"
+#include "graph.h"
+
+
+/*
+ * A bisection. The tasks form a heap: the halves of task t are tasks 2t+1
+ * (its side 0) and 2t+2 (its side 1).
+ */
+typedef struct BisectTask {
+    Graph graph;           // the part it bisects, the whole graph for task 0
+    int* node_map;         // node of the whole graph of each node of graph,
+                           // NULL for task 0
+    int level;             // 0 for the whole graph
+    int first_part;        // its nodes go to parts first_part ... of the
+                           // NUM_PARTS >> level parts below it
+    bitarray_t* partition; // the bisection found, in shared memory
+    GAResult* result;      // likewise
+} BisectTask;
+
+
+int run_bisection   (Graph*);
+int write_parts_file(const char*, const int*, int);
+
+#endif /* _BISECT_H_ */
@@ -0,0 +1,845 @@
+/*
+ * cluster.c
+ *
+ * Exchange of migrants and of the best partition between the hosts of a
+ * cluster, over TCP (see cluster.h)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L  // getaddrinfo
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <errno.h>   // errno, EAGAIN, EINTR
+#include <fcntl.h>   // fcntl, O_NONBLOCK
+#include <limits.h>  // INT_MAX
+#include <netdb.h>   // getaddrinfo
+#include <poll.h>    // poll
+#include <signal.h>  // signal, SIGPIPE
+#include <stdio.h>   // printf, fopen
+#include <stdlib.h>  // malloc
+#include <string.h>  // memcpy, memmove, strerror
+#include <unistd.h>  // read, write, close
+
+#include <netinet/in.h>   // IPPROTO_TCP
+#include <netinet/tcp.h>  // TCP_NODELAY
+#include <sys/socket.h>   // socket, bind, listen, accept, connect
+
+#include "cluster.h"
+#include "ga-utils.h"
+#include "mem-track.h"
+
+// message types
+#define MSG_HELLO   1  // rank, number of hosts, nodes and edges of the graph
+#define MSG_MIGRANT 2  // fitness, genome
+#define MSG_BEST    3  // fitness, host it was found on, genome
+#define MSG_FINAL   4  // lap, fitness, host it was found on, genome
+
+// genome encodings
+#define GENOME_WHOLE 0  // every word
+#define GENOME_DELTA 1  // number of words that differ from the previous
+                        // genome, then the gap and XOR of each
+
+
+static void _put_u32(unsigned char* p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+    p[2] = x >> 16;
+    p[3] = x >> 24;
+}
+
+
+static uint32_t _get_u32(const unsigned char* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+           | (uint32_t)p[3] << 24;
+}
+
+
+static int _varint_size(uint32_t x) {
+    int size = 1;
+
+    while (x >= 0x80) {
+        x >>= 7;
+        size++;
+    }
+    return size;
+}
+
+
+/* Writes x at p, 7 bits a byte, and returns the end of what was written */
+static unsigned char* _put_varint(unsigned char* p, uint32_t x) {
+    while (x >= 0x80) {
+        *p++ = (x & 0x7f) | 0x80;
+        x >>= 7;
+    }
+    *p++ = x;
+    return p;
+}
+
+
+/*
+ * Reads a varint from *p (which ends at end) into *x, and moves *p past it.
+ * Returns 0 if it is malformed.
+ */
+static int _get_varint(const unsigned char** p,
+                       const unsigned char* end,
+                       uint32_t* x) {
+    *x = 0;
+    for (int shift=0; shift<35 && *p<end; shift+=7) {
+        unsigned char b = *(*p)++;
+        *x |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return 1;
+    }
+    return 0;
+}
+
+
+static void _close(int* fd) {
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+
+/*
+ * Sets host and port to those on line index of the host list host_file
+ * (counting only lines that name a host; everything after a '#' is a
+ * comment). Returns the number of hosts listed, or 0 if the list cannot be
+ * read.
+ */
+static int _read_host(const char* host_file,
+                      int index,
+                      char* host,
+                      char* port) {
+    FILE* fp;
+    char line[256];
+    int num_hosts = 0;
+    const char* blanks = " \t\r\n";
+
+    fp = fopen(host_file, "r");
+    if (NULL == fp) {
+        perror(host_file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char* name = line + strspn(line, blanks);
+        name[strcspn(name, blanks)] = '\0';
+        if (*name == '\0')
+            continue;
+
+        char* colon = strrchr(name, ':');
+        if (!colon || colon == name || colon[1] == '\0') {
+            fprintf(stderr, "%s: expected host:port, not '%s'\n",
+                    host_file, name);
+            fclose(fp);
+            return 0;
+        }
+
+        if (num_hosts == index) {
+            *colon = '\0';
+            // an IPv6 address is written in brackets
+            if (name[0] == '[' && colon[-1] == ']') {
+                name++;
+                colon[-1] = '\0';
+            }
+            strcpy(host, name);
+            strcpy(port, colon + 1);
+        }
+        num_hosts++;
+    }
+
+    fclose(fp);
+    if (!num_hosts)
+        fprintf(stderr, "%s lists no hosts\n", host_file);
+    return num_hosts;
+}
+
+
+/* Returns a socket listening on port, or -1 */
+static int _listen(const char* port) {
+    struct addrinfo hints, *addrs, *a;
+    int fd = -1;
+    int on = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int err = getaddrinfo(NULL, port, &hints, &addrs);
+    if (err) {
+        fprintf(stderr, "Cannot listen on port %s: %s\n",
+                port, gai_strerror(err));
+        return -1;
+    }
+
+    for (a=addrs; a && fd<0; a=a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) != 0
+            || listen(fd, 4) != 0)
+            _close(&fd);
+    }
+    if (fd < 0)
+        fprintf(stderr, "Cannot listen on port %s: %s\n",
+                port, strerror(errno));
+
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+
+/* Returns a socket connected to host:port, or -1 if it cannot be (yet) */
+static int _connect(const char* host, const char* port) {
+    struct addrinfo hints, *addrs, *a;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host, port, &hints, &addrs) != 0)
+        return -1;
+
+    for (a=addrs; a && fd<0; a=a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+            _close(&fd);
+    }
+
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+
+/* Starts a message of type in the output; returns where its body goes */
+static unsigned char* _begin_message(Cluster* c, int type) {
+    unsigned char* start = c->out + c->out_len;
+
+    start[4] = type;
+    return start + 5;
+}
+
+
+/* Completes the message begun last, whose body ends at end */
+static void _end_message(Cluster* c, unsigned char* end) {
+    unsigned char* start = c->out + c->out_len;
+
+    _put_u32(start, end - start - 4);
+    c->out_len = end - c->out;
+}
+
+
+/*
+ * Writes genome at p, encoded against the genome sent before it (which it
+ * then becomes), and returns the end of what was written
+ */
+static unsigned char* _put_genome(Cluster* c,
+                                  unsigned char* p,
+                                  const bitarray_t* genome) {
+    unsigned char* start = p;
+    int num_diff = 0;
+    int delta_size = 0;
+    int prev = 0;
+
+    for (int k=0; k<c->num_words; k++) {
+        if (genome[k] != c->last_sent[k]) {
+            num_diff++;
+            delta_size += _varint_size(k - prev) + 4;
+            prev = k;
+        }
+    }
+    delta_size += _varint_size(num_diff);
+
+    if (delta_size < 4*c->num_words) {
+        *p++ = GENOME_DELTA;
+        p = _put_varint(p, num_diff);
+        prev = 0;
+        for (int k=0; k<c->num_words; k++) {
+            if (genome[k] != c->last_sent[k]) {
+                p = _put_varint(p, k - prev);
+                _put_u32(p, genome[k] ^ c->last_sent[k]);
+                p += 4;
+                prev = k;
+                c->last_sent[k] = genome[k];
+            }
+        }
+    }
+    else {
+        *p++ = GENOME_WHOLE;
+        for (int k=0; k<c->num_words; k++) {
+            _put_u32(p, genome[k]);
+            p += 4;
+            c->last_sent[k] = genome[k];
+        }
+    }
+
+    c->stats.genome_bytes += p - start;
+    c->stats.raw_genome_bytes += 1 + 4*c->num_words;
+    return p;
+}
+
+
+/*
+ * Reads a genome from *p (which ends at end) into last_received, against
+ * which it was encoded, and moves *p past it. Returns 0 if it is malformed.
+ */
+static int _get_genome(Cluster* c,
+                       const unsigned char** p,
+                       const unsigned char* end) {
+    uint32_t num_diff, gap;
+
+    if (*p == end)
+        return 0;
+
+    int encoding = *(*p)++;
+    if (encoding == GENOME_WHOLE) {
+        if (end - *p < 4*c->num_words)
+            return 0;
+        for (int k=0; k<c->num_words; k++) {
+            c->last_received[k] = _get_u32(*p);
+            *p += 4;
+        }
+        return 1;
+    }
+
+    if (encoding != GENOME_DELTA || !_get_varint(p, end, &num_diff)
+        || num_diff > (uint32_t)c->num_words)
+        return 0;
+
+    long k = 0;
+    for (uint32_t n=0; n<num_diff; n++) {
+        if (!_get_varint(p, end, &gap) || end - *p < 4)
+            return 0;
+        k += gap;
+        if (k >= c->num_words)
+            return 0;
+        c->last_received[k] ^= _get_u32(*p);
+        *p += 4;
+    }
+    return 1;
+}
+
+
+/*
+ * Makes partition (of fitness, found on host rank) the best known in the
+ * cluster if it is better, or as fit and found on a host of lower rank (so
+ * that the hosts settle on the same one)
+ */
+static void _adopt_best(Cluster* c,
+                        const bitarray_t* partition,
+                        int fitness,
+                        int rank) {
+    if (fitness > c->best_fitness
+        || (fitness == c->best_fitness && rank >= c->best_rank))
+        return;
+
+    memcpy(c->best, partition, c->num_words * sizeof(bitarray_t));
+    c->best_fitness = fitness;
+    c->best_rank = rank;
+    c->best_changed = 1;
+}
+
+
+/*
+ * Handles a message of type from the previous host, whose body is from body
+ * to end. Returns 0 if it is invalid.
+ */
+static int _handle_message(Cluster* c,
+                           int type,
+                           const unsigned char* body,
+                           const unsigned char* end) {
+    int prev_rank = (c->rank + c->num_hosts - 1) % c->num_hosts;
+
+    if (type == MSG_HELLO) {
+        if (end - body != 16)
+            return 0;
+        int rank = _get_u32(body);
+        int num_hosts = _get_u32(body + 4);
+        int num_nodes = _get_u32(body + 8);
+        int num_edges = _get_u32(body + 12);
+
+        if (rank != prev_rank || num_hosts != c->num_hosts) {
+            fprintf(stderr, "Host %d of %d connected, where host %d of %d "
+                    "was expected\n", rank, num_hosts, prev_rank,
+                    c->num_hosts);
+            return 0;
+        }
+        if (num_nodes != c->num_nodes || num_edges != c->num_edges) {
+            fprintf(stderr, "Host %d has a graph of %d nodes and %d edges, "
+                    "not %d and %d\n", rank, num_nodes, num_edges,
+                    c->num_nodes, c->num_edges);
+            return 0;
+        }
+        c->hello_received = 1;
+        return 1;
+    }
+
+    if (!c->hello_received)
+        return 0;
+
+    if (type == MSG_MIGRANT) {
+        if (end - body < 4)
+            return 0;
+        int fitness = _get_u32(body);
+        body += 4;
+        if (!_get_genome(c, &body, end) || body != end)
+            return 0;
+        c->stats.migrants_received++;
+
+        _adopt_best(c, c->last_received, fitness, prev_rank);
+
+        // no room in the gateway island's ring (or no GA yet) drops it
+        bitarray_t* slot = c->imports ? ring_send_slot(c->imports) : NULL;
+        if (slot) {
+            MigrantStamp stamp;
+            memcpy(slot, c->last_received, c->num_words * sizeof(bitarray_t));
+            stamp.fitness = fitness;
+            stamp.gen = c->gen;
+            stamp.version = 0;
+            ring_send(c->imports, &stamp);
+        }
+        else if (c->imports) {
+            c->imports->num_dropped++;
+        }
+        return 1;
+    }
+
+    if (type == MSG_BEST) {
+        if (end - body < 8)
+            return 0;
+        int fitness = _get_u32(body);
+        int rank = _get_u32(body + 4);
+        body += 8;
+        if (rank < 0 || rank >= c->num_hosts
+            || !_get_genome(c, &body, end) || body != end)
+            return 0;
+        c->stats.bests_received++;
+
+        _adopt_best(c, c->last_received, fitness, rank);
+        return 1;
+    }
+
+    if (type == MSG_FINAL) {
+        if (end - body < 12)
+            return 0;
+        int lap = _get_u32(body);
+        int fitness = _get_u32(body + 4);
+        int rank = _get_u32(body + 8);
+        body += 12;
+        if (lap != c->finals_received || lap > 1
+            || rank < 0 || rank >= c->num_hosts
+            || !_get_genome(c, &body, end) || body != end)
+            return 0;
+        c->finals_received++;
+
+        _adopt_best(c, c->last_received, fitness, rank);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Reads what has arrived from the previous host and handles each whole
+ * message of it, without waiting. Closes the connection once the host has
+ * closed it or has sent something invalid.
+ */
+static void _receive(Cluster* c) {
+    int prev_rank = (c->rank + c->num_hosts - 1) % c->num_hosts;
+
+    while (c->prev_fd >= 0) {
+        ssize_t n = read(c->prev_fd,
+                         c->in + c->in_len,
+                         c->in_cap - c->in_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            if (n < 0 && errno != ECONNRESET)
+                fprintf(stderr, "\nConnection from host %d failed: %s\n",
+                        prev_rank, strerror(errno));
+            _close(&c->prev_fd);
+            return;
+        }
+        c->in_len += n;
+        c->stats.bytes_received += n;
+
+        // what is left of a message is less than max_message, so there is
+        // always room for the rest of it
+        size_t done = 0;
+        while (c->in_len - done >= 4) {
+            size_t len = _get_u32(c->in + done);
+            if (len < 1 || len > c->max_message - 4) {
+                fprintf(stderr, "\nHost %d sent a message of %zu bytes\n",
+                        prev_rank, len);
+                _close(&c->prev_fd);
+                return;
+            }
+            if (c->in_len - done < 4 + len)
+                break;
+            if (!_handle_message(c,
+                                 c->in[done + 4],
+                                 c->in + done + 5,
+                                 c->in + done + 4 + len)) {
+                fprintf(stderr, "\nHost %d sent an invalid message\n",
+                        prev_rank);
+                _close(&c->prev_fd);
+                return;
+            }
+            done += 4 + len;
+        }
+        memmove(c->in, c->in + done, c->in_len - done);
+        c->in_len -= done;
+    }
+}
+
+
+/* Sends as much of the output as the connection takes without waiting */
+static void _flush(Cluster* c) {
+    size_t done = 0;
+
+    while (c->next_fd >= 0 && done < c->out_len) {
+        ssize_t n = write(c->next_fd, c->out + done, c->out_len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0) {
+            // the next host closing its end (as it does once it stops) is
+            // not a failure
+            if (errno != EPIPE && errno != ECONNRESET)
+                fprintf(stderr, "\nConnection to host %d failed: %s\n",
+                        (c->rank + 1) % c->num_hosts, strerror(errno));
+            _close(&c->next_fd);
+            c->out_len = 0;
+            return;
+        }
+        done += n;
+        c->stats.bytes_sent += n;
+    }
+
+    memmove(c->out, c->out + done, c->out_len - done);
+    c->out_len -= done;
+}
+
+
+/* Queues the best partition known for the next host, if it has changed */
+static void _send_best(Cluster* c) {
+    if (!c->best_changed || c->next_fd < 0
+        || c->out_cap - c->out_len < c->max_message)
+        return;
+
+    unsigned char* p = _begin_message(c, MSG_BEST);
+    _put_u32(p, c->best_fitness);
+    _put_u32(p + 4, c->best_rank);
+    p = _put_genome(c, p + 8, c->best);
+    _end_message(c, p);
+
+    c->best_changed = 0;
+    c->stats.bests_sent++;
+}
+
+
+/*
+ * Connects this host (rank, its line in the host list host_file) to the rest
+ * of the cluster, for a graph of num_nodes nodes and num_edges edges: listens
+ * for the previous host, connects to the next, and checks that they are the
+ * hosts expected with the same graph. Waits up to CLUSTER_CONNECT_TIMEOUT
+ * seconds for the others to start. Returns 1 on success, 0 (after printing
+ * why) on failure.
+ */
+int init_cluster(Cluster* c,
+                 const char* host_file,
+                 int rank,
+                 int num_nodes,
+                 int num_edges) {
+    char host[256], port[256], next_host[256], next_port[256];
+    int on = 1;
+
+    memset(c, 0, sizeof(Cluster));
+    c->listen_fd = -1;
+    c->next_fd = -1;
+    c->prev_fd = -1;
+
+    c->num_hosts = _read_host(host_file, rank, host, port);
+    if (!c->num_hosts)
+        return 0;
+    if (rank >= c->num_hosts) {
+        fprintf(stderr, "cluster_rank is %d, but %s lists %d hosts\n",
+                rank, host_file, c->num_hosts);
+        return 0;
+    }
+    _read_host(host_file, (rank + 1) % c->num_hosts, next_host, next_port);
+
+    c->rank = rank;
+    c->num_nodes = num_nodes;
+    c->num_edges = num_edges;
+    c->num_words = RESERVE_BITS(num_nodes);
+    c->max_message = 4 + 1 + 12 + 1 + 4*(size_t)c->num_words;
+    c->out_cap = (CLUSTER_PENDING_GENOMES + 2) * c->max_message;
+    c->in_cap = 2 * c->max_message;
+
+    // both ends of a connection start from an all-zero genome
+    c->last_sent = tracked_malloc(MEM_IO, c->num_words * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(c->last_sent);
+    c->last_received = tracked_malloc(MEM_IO,
+                                      c->num_words * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(c->last_received);
+    c->best = tracked_malloc(MEM_IO, c->num_words * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(c->best);
+    c->out = tracked_malloc(MEM_IO, c->out_cap);
+    CHECK_MALLOC_ERR(c->out);
+    c->in = tracked_malloc(MEM_IO, c->in_cap);
+    CHECK_MALLOC_ERR(c->in);
+    memset(c->last_sent, 0, c->num_words * sizeof(bitarray_t));
+    memset(c->last_received, 0, c->num_words * sizeof(bitarray_t));
+    c->best_fitness = INT_MAX;
+    c->best_rank = -1;
+
+    if (c->num_hosts == 1)
+        return 1;
+
+    // a connection the other end has closed shows as an error from write
+    signal(SIGPIPE, SIG_IGN);
+
+    c->listen_fd = _listen(port);
+    if (c->listen_fd < 0)
+        return 0;
+
+    printf("Cluster host %d of %d: connecting to %s:%s...\n",
+           rank, c->num_hosts, next_host, next_port);
+    fflush(stdout);
+
+    double deadline = wall_seconds() + CLUSTER_CONNECT_TIMEOUT;
+    while (c->next_fd < 0 || c->prev_fd < 0) {
+        if (wall_seconds() > deadline) {
+            fprintf(stderr, "Timed out waiting for the other hosts\n");
+            return 0;
+        }
+
+        if (c->next_fd < 0)
+            c->next_fd = _connect(next_host, next_port);
+
+        if (c->prev_fd < 0) {
+            struct pollfd pfd = {c->listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, CLUSTER_RETRY_MS) > 0)
+                c->prev_fd = accept(c->listen_fd, NULL, NULL);
+        }
+        else if (c->next_fd < 0) {
+            poll(NULL, 0, CLUSTER_RETRY_MS);  // before trying again
+        }
+    }
+    _close(&c->listen_fd);
+
+    setsockopt(c->next_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(c->next_fd, F_SETFL, fcntl(c->next_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(c->prev_fd, F_SETFL, fcntl(c->prev_fd, F_GETFL) | O_NONBLOCK);
+
+    // say hello to the next host, and wait for the previous one's
+    unsigned char* p = _begin_message(c, MSG_HELLO);
+    _put_u32(p, rank);
+    _put_u32(p + 4, c->num_hosts);
+    _put_u32(p + 8, num_nodes);
+    _put_u32(p + 12, num_edges);
+    _end_message(c, p + 16);
+
+    while (!c->hello_received || c->out_len) {
+        if (c->next_fd < 0 || c->prev_fd < 0
+            || wall_seconds() > deadline) {
+            fprintf(stderr, "Cannot connect the cluster\n");
+            return 0;
+        }
+        struct pollfd pfds[2] = {
+            {c->prev_fd, POLLIN, 0},
+            {c->next_fd, POLLOUT, 0}
+        };
+        poll(pfds, 2, CLUSTER_RETRY_MS);
+        _flush(c);
+        _receive(c);
+    }
+
+    printf("Cluster of %d hosts connected\n", c->num_hosts);
+    return 1;
+}
+
+
+/*
+ * Called regularly by the main thread: sends the migrants the gateway island
+ * has exported since the last call, and the best partition known if that has
+ * changed, to the next host, and passes what the previous host has sent on
+ * to the gateway island (stamped as sent after gen generations). Never waits:
+ * migrants that cannot be sent or taken in at once are dropped.
+ */
+void cluster_exchange(Cluster* c, int gen) {
+    const bitarray_t* migrant;
+    MigrantStamp stamp;
+
+    c->gen = gen;
+
+    while (c->exports
+           && (migrant = ring_receive_slot(c->exports, &stamp)) != NULL) {
+        _adopt_best(c, migrant, stamp.fitness, c->rank);
+
+        // room is kept for the best partition
+        if (c->next_fd >= 0
+            && c->out_cap - c->out_len < 2*c->max_message) {
+            c->stats.migrants_dropped++;
+        }
+        else if (c->next_fd >= 0) {
+            unsigned char* p = _begin_message(c, MSG_MIGRANT);
+            _put_u32(p, stamp.fitness);
+            p = _put_genome(c, p + 4, migrant);
+            _end_message(c, p);
+            c->stats.migrants_sent++;
+        }
+        ring_receive(c->exports);
+    }
+
+    _receive(c);
+    _send_best(c);
+    _flush(c);
+}
+
+
+/*
+ * Offers partition, of fitness, found on this host, as the best of the
+ * cluster, and passes it on at once if it is
+ */
+void cluster_offer_best(Cluster* c, const bitarray_t* partition, int fitness) {
+    _adopt_best(c, partition, fitness, c->rank);
+    _send_best(c);
+    _flush(c);
+}
+
+
+/*
+ * Sends the best partition known to the next host in lap lap of the final
+ * round, waiting until deadline for room to. Returns 0 if it could not.
+ */
+static int _send_final(Cluster* c, int lap, double deadline) {
+    while (c->next_fd >= 0 && c->out_cap - c->out_len < c->max_message) {
+        if (wall_seconds() > deadline)
+            return 0;
+        struct pollfd pfd = {c->next_fd, POLLOUT, 0};
+        poll(&pfd, 1, CLUSTER_RETRY_MS);
+        _flush(c);
+    }
+    if (c->next_fd < 0)
+        return 0;
+
+    unsigned char* p = _begin_message(c, MSG_FINAL);
+    _put_u32(p, lap);
+    _put_u32(p + 4, c->best_fitness);
+    _put_u32(p + 8, c->best_rank);
+    p = _put_genome(c, p + 12, c->best);
+    _end_message(c, p);
+    _flush(c);
+    return 1;
+}
+
+
+/*
+ * Waits until deadline for lap lap of the final round to arrive from the
+ * previous host, sending what is left to the next meanwhile. Returns 0 if
+ * it did not arrive.
+ */
+static int _await_final(Cluster* c, int lap, double deadline) {
+    while (c->finals_received <= lap) {
+        if (c->prev_fd < 0 || wall_seconds() > deadline)
+            return 0;
+        struct pollfd pfds[2] = {
+            {c->prev_fd, POLLIN, 0},
+            {c->next_fd, c->out_len ? POLLOUT : 0, 0}
+        };
+        poll(pfds, 2, CLUSTER_RETRY_MS);
+        _flush(c);
+        _receive(c);
+    }
+    return 1;
+}
+
+
+/*
+ * Settles the best partition of the cluster with the other hosts, which
+ * wait up to CLUSTER_FINAL_TIMEOUT seconds for each other to stop, then
+ * waits up to CLUSTER_LINGER_MS for the next host to take what is left to
+ * send, and closes the connections.
+ *
+ * The best partition goes around the ring twice in the final round: host 0
+ * starts the first lap with the best it knows of, and each host passes on
+ * the better of what it receives and what it knows of, so the lap ends at
+ * host 0 with the best of the cluster, which the second lap brings to every
+ * host. Everything a host sent before the final round arrives before its
+ * part in it, so nothing found is left out.
+ */
+void close_cluster(Cluster* c) {
+    double deadline = wall_seconds() + CLUSTER_FINAL_TIMEOUT;
+    int agreed = 1;
+
+    if (c->num_hosts > 1 && c->rank == 0) {
+        agreed = _send_final(c, 0, deadline)
+                 && _await_final(c, 0, deadline)
+                 && _send_final(c, 1, deadline);
+    }
+    else if (c->num_hosts > 1) {
+        agreed = _await_final(c, 0, deadline)
+                 && _send_final(c, 0, deadline)
+                 && _await_final(c, 1, deadline)
+                 && (c->rank == c->num_hosts - 1
+                     || _send_final(c, 1, deadline));
+    }
+    if (!agreed)
+        fprintf(stderr, "\nThe other hosts did not settle the best partition "
+                "of the cluster; this host reports the best it knows of\n");
+
+    deadline = wall_seconds() + CLUSTER_LINGER_MS/1e3;
+
+    while (c->next_fd >= 0 && c->out_len && wall_seconds() < deadline) {
+        struct pollfd pfd = {c->next_fd, POLLOUT, 0};
+        poll(&pfd, 1, CLUSTER_RETRY_MS);
+        _flush(c);
+    }
+
+    _close(&c->next_fd);
+    _close(&c->prev_fd);
+    _close(&c->listen_fd);
+}
+
+
+/* Frees the memory of a cluster that has been closed */
+void free_cluster(Cluster* c) {
+    tracked_free(c->last_sent);
+    tracked_free(c->last_received);
+    tracked_free(c->best);
+    tracked_free(c->out);
+    tracked_free(c->in);
+}
+
+
+void print_cluster_stats(const Cluster* c) {
+    const ClusterStats* s = &c->stats;
+
+    printf("Cluster (host %d of %d):\n", c->rank, c->num_hosts);
+    printf("\tMigrants sent:          %8ld (%ld more dropped while the "
+           "connection was busy)\n", s->migrants_sent, s->migrants_dropped);
+    printf("\tMigrants received:      %8ld\n", s->migrants_received);
+    printf("\tBest partitions sent:   %8ld (received: %ld)\n",
+           s->bests_sent, s->bests_received);
+    printf("\tBytes sent:             %8ld (received: %ld)\n",
+           s->bytes_sent, s->bytes_received);
+    if (s->raw_genome_bytes) {
+        printf("\tGenomes encoded in:     %7.1f%% of their whole size\n",
+               100.0 * s->genome_bytes / s->raw_genome_bytes);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * cluster.h
+ *
+ * header file for cluster.c
+ *
+ * Cluster mode: the GA runs as one process on each host of a list, each
+ * evolving a group of islands, and the groups exchange migrants over TCP.
+ * The hosts form a ring in the order of the list. The migrants island 0 (the
+ * group's gateway) exports go to the next host, and the migrants from the
+ * previous host go to island 0. The best partition any host knows of goes
+ * around the ring the same way, so that every host knows the best of the
+ * whole cluster so far, and once the hosts stop it goes around twice more
+ * so that they all report the same one.
+ *
+ * Every message is a 4 byte length (of what follows), a 1 byte type and a
+ * body; integers are little endian. A genome is sent as the words in which
+ * it differs from the previous genome sent on the connection (the gap from
+ * the previous index as a varint, then the XOR of the word), or whole where
+ * that is shorter, so similar elites cost little.
+ *
+ */
+
+#ifndef _CLUSTER_H_
+#define _CLUSTER_H_
+
+#include "bitarray.h"
+#include "migrant-ring.h"
+
+#define CLUSTER_CONNECT_TIMEOUT 60   // seconds to wait for the other hosts
+#define CLUSTER_RETRY_MS        100  // between attempts to connect
+#define CLUSTER_LINGER_MS       2000 // to finish sending when closing
+#define CLUSTER_FINAL_TIMEOUT   60   // seconds to wait for the other hosts
+                                     // to stop
+#define CLUSTER_PENDING_GENOMES 16   // migrants that may wait to be sent
+                                     // before more are dropped
+
+
+typedef struct ClusterStats {
+    long migrants_sent;
+    long migrants_dropped;     // not sent as the connection was busy
+    long migrants_received;
+    long bests_sent;
+    long bests_received;
+    long bytes_sent;
+    long bytes_received;
+    long genome_bytes;         // sent for genomes, encoded
+    long raw_genome_bytes;     // the same genomes whole
+} ClusterStats;
+
+
+typedef struct Cluster {
+    int rank;                  // of this host, its line in the host list
+    int num_hosts;
+    int num_nodes;             // of the graph
+    int num_edges;
+    int num_words;             // of a partition
+    int listen_fd;             // sockets, -1 when not open
+    int next_fd;               // to the next host
+    int prev_fd;               // from the previous host
+    int hello_received;        // 1 once the previous host has said hello
+    int gen;                   // given to migrants as they arrive
+    MigrantRing* exports;      // from the gateway island, to send on
+    MigrantRing* imports;      // to the gateway island
+    bitarray_t* last_sent;     // genome the next is encoded against
+    bitarray_t* last_received; // genome the next received is decoded against
+    unsigned char* out;        // encoded messages not yet sent
+    size_t out_len;
+    size_t out_cap;
+    unsigned char* in;         // received bytes not yet decoded
+    size_t in_len;
+    size_t in_cap;
+    size_t max_message;        // bytes of the longest valid message
+    bitarray_t* best;          // best partition known in the cluster
+    int best_fitness;
+    int best_rank;             // host it was found on, -1 if none yet
+    int best_changed;          // 1 if it is to be sent on
+    int finals_received;       // laps of the final round received
+    ClusterStats stats;
+} Cluster;
+
+
+int  init_cluster       (Cluster*, const char*, int, int, int);
+void cluster_exchange   (Cluster*, int);
+void cluster_offer_best (Cluster*, const bitarray_t*, int);
+void close_cluster      (Cluster*);
+void free_cluster       (Cluster*);
+void print_cluster_stats(const Cluster*);
+
+#endif /* _CLUSTER_H_ */
@@ -7,9 +7,15 @@
 #ifndef _CROSSOVER_H_
 #define _CROSSOVER_H_
 
+#include <limits.h>  // LONG_MAX
+#include <math.h>    // log, log1p
+#include <stdlib.h>  // malloc
+
 #include "bitarray.h"
 #include "ga-params.h"
 #include "ga-utils.h"
+#include "graph.h"
+#include "mem-track.h"
 
 
 /* Returns a crossover position chosen from a uniform random distribution 
@@ -225,5 +231,371 @@ static inline void parameterized_uniform_crossover(Individual* pop,
 }
 
 
+/*
+ * Record of how a child differs from the nearer of its two parents, filled in
+ * by crossover_mutation(). A child with num_bits == 0 is an exact copy of
+ * pop[parent] and can inherit its fitness; otherwise the listed words are the
+ * only ones an incremental evaluator needs to look at.
+ */
+typedef struct GenomeDiff {
+    int parent;        // index (in pop) of the parent nearest to the child
+    int num_words;     // number of words in which child and parent differ
+    int num_bits;      // number of bits in which child and parent differ
+    int* words;        // indices of the differing words, in ascending order
+    bitarray_t* bits;  // child ^ parent for each word in 'words'
+    bitarray_t* alt;   // scratch: child ^ other parent, indexed like 'bits'
+} GenomeDiff;
+
+
+/*
+ * Allocates the buffers of a GenomeDiff large enough for a genome of
+ * num_nodes bits
+ */
+static inline void init_genome_diff(GenomeDiff* diff, int num_nodes) {
+    diff->parent = -1;
+    diff->num_words = 0;
+    diff->num_bits = 0;
+    diff->words = tracked_malloc(MEM_SCRATCH,
+                                 RESERVE_BITS(num_nodes) * sizeof(int));
+    CHECK_MALLOC_ERR(diff->words);
+    diff->bits = tracked_malloc(MEM_SCRATCH,
+                                RESERVE_BITS(num_nodes) * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(diff->bits);
+    diff->alt = tracked_malloc(MEM_SCRATCH,
+                               RESERVE_BITS(num_nodes) * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(diff->alt);
+}
+
+
+static inline void free_genome_diff(GenomeDiff* diff) {
+    tracked_free(diff->words);
+    tracked_free(diff->bits);
+    tracked_free(diff->alt);
+}
+
+
+/* Returns the locus of the next mutation after 'locus', skipping ahead by a
+ * geometrically distributed distance so that each locus is still mutated
+ * independently with probability prob. A skip past the last of the num_loci
+ * loci is clamped before the cast, as for a tiny prob it may not fit a long.
+ */
+static inline long _next_mutation_locus(long locus, 
+                                        double prob, 
+                                        int num_loci,
+                                        uint32_t* rng) {
+    if (prob <= 0)
+        return LONG_MAX;
+    if (prob >= 1)
+        return locus + 1;
+
+    double skip = log(xorshift_uniform(rng)) / log1p(-prob);
+    if (!(skip < num_loci))
+        skip = num_loci;
+    return locus + 1 + (long)skip;
+}
+
+
+/* Returns the word of mutation flips for bits [32*word, 32*word+32) of a
+ * genome of num_loci loci and advances *next past them
+ */
+static inline bitarray_t _mutation_flips(long* next, 
+                                         int word, 
+                                         double prob, 
+                                         int num_loci,
+                                         uint32_t* rng) {
+    bitarray_t flips = 0;
+    long word_end = ((long)word + 1) << 5;
+
+    while (*next < word_end) {
+        flips |= (bitarray_t)1 << BIT_INDEX(*next);
+        *next = _next_mutation_locus(*next, prob, num_loci, rng);
+    }
+
+    return flips;
+}
+
+
+/* Keeps only the side of a diff belonging to the nearer parent and drops the
+ * words that do not differ from it
+ */
+static inline void _finish_genome_diff(GenomeDiff* diff,
+                                       int parent_idxs[],
+                                       int num_entries,
+                                       int bits0,
+                                       int bits1) {
+    int n = 0;
+
+    if (bits0 <= bits1) {
+        diff->parent = parent_idxs[0];
+        diff->num_bits = bits0;
+        for (int i=0; i<num_entries; i++) {
+            if (diff->bits[i]) {
+                diff->words[n] = diff->words[i];
+                diff->bits[n] = diff->bits[i];
+                n++;
+            }
+        }
+    }
+    else {
+        diff->parent = parent_idxs[1];
+        diff->num_bits = bits1;
+        for (int i=0; i<num_entries; i++) {
+            if (diff->alt[i]) {
+                diff->words[n] = diff->words[i];
+                diff->bits[n] = diff->alt[i];
+                n++;
+            }
+        }
+    }
+
+    diff->num_words = n;
+}
+
+
+/*
+ * Fused Crossover and Mutation: streams both parents one 32 bit word at a
+ * time and writes both children in a single pass. Bit i of child1 comes from
+ * parent 1 where bit i of the crossover mask is set and from parent 0
+ * elsewhere; child2 gets the opposite choice. If mask is NULL, a mask is
+ * drawn at random with each bit set with probability PUC_PROB, which gives
+ * the same children as parameterized_uniform_crossover(). Mutation flips are
+ * applied in the same pass, each locus being mutated with probability
+ * mutation_prob, with the mutated loci drawn by geometric skips instead of
+ * one random number per locus.
+ *
+ * If diff1/diff2 are not NULL they record which words and bits of each child
+ * differ from that child's nearest parent.
+ */
+static inline void crossover_mutation(Individual* pop,
+                                      int parent_idxs[],
+                                      int num_nodes,
+                                      const bitarray_t* mask,
+                                      double mutation_prob,
+                                      uint32_t* rng,
+                                      Individual* child1,
+                                      Individual* child2,
+                                      GenomeDiff* diff1,
+                                      GenomeDiff* diff2) {
+
+    const bitarray_t* p0 = pop[parent_idxs[0]].partition;
+    const bitarray_t* p1 = pop[parent_idxs[1]].partition;
+    int num_words = RESERVE_BITS(num_nodes);
+    bitarray_t last_word_mask = BIT_INDEX(num_nodes) 
+                                ? ((bitarray_t)1 << BIT_INDEX(num_nodes)) - 1
+                                : 0xFFFFFFFF;
+
+    long next1 = _next_mutation_locus(-1, mutation_prob, num_nodes, rng);
+    long next2 = _next_mutation_locus(-1, mutation_prob, num_nodes, rng);
+
+    int entries1 = 0, entries2 = 0;
+    int c1_bits0 = 0, c1_bits1 = 0;
+    int c2_bits0 = 0, c2_bits1 = 0;
+
+    for (int w=0; w<num_words; w++) {
+        bitarray_t a = p0[w];
+        bitarray_t b = p1[w];
+        bitarray_t m = mask ? mask[w] : random_mask32(rng, PUC_PROB);
+
+        bitarray_t c1 = ((a & ~m) | (b & m)) 
+                        ^ _mutation_flips(&next1, w, mutation_prob,
+                                          num_nodes, rng);
+        bitarray_t c2 = ((b & ~m) | (a & m)) 
+                        ^ _mutation_flips(&next2, w, mutation_prob,
+                                          num_nodes, rng);
+
+        if (unlikely(w == num_words-1)) {
+            c1 &= last_word_mask;
+            c2 &= last_word_mask;
+        }
+
+        child1->partition[w] = c1;
+        child2->partition[w] = c2;
+
+        if (diff1 && (c1 != a || c1 != b)) {
+            diff1->words[entries1] = w;
+            diff1->bits[entries1] = c1 ^ a;
+            diff1->alt[entries1] = c1 ^ b;
+            c1_bits0 += hamming_distance(c1, a);
+            c1_bits1 += hamming_distance(c1, b);
+            entries1++;
+        }
+        if (diff2 && (c2 != a || c2 != b)) {
+            diff2->words[entries2] = w;
+            diff2->bits[entries2] = c2 ^ a;
+            diff2->alt[entries2] = c2 ^ b;
+            c2_bits0 += hamming_distance(c2, a);
+            c2_bits1 += hamming_distance(c2, b);
+            entries2++;
+        }
+    }
+
+    if (diff1)
+        _finish_genome_diff(diff1, parent_idxs, entries1, c1_bits0, c1_bits1);
+    if (diff2)
+        _finish_genome_diff(diff2, parent_idxs, entries2, c2_bits0, c2_bits1);
+}
+
+
+/*
+ * Working memory for partition crossover on one graph
+ */
+typedef struct PartitionCrossover {
+    int* uf;           // union-find parent of each differing node
+    int* nodes;        // the nodes on which the two parents differ
+    int* d_cut;        // per component root: change in cut weight if the
+                       // component takes parent 1's sides instead of 0's
+    int* d_imbalance;  // per component root: change in (weight of partition
+                       // 1) - (weight of partition 0) for the same switch
+    bitarray_t* mask;  // crossover mask handed to crossover_mutation()
+} PartitionCrossover;
+
+
+static inline void init_partition_crossover(Graph* graph, 
+                                            PartitionCrossover* px) {
+    px->uf = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(px->uf);
+    px->nodes = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(px->nodes);
+    px->d_cut = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(px->d_cut);
+    px->d_imbalance = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(px->d_imbalance);
+    px->mask = tracked_malloc(MEM_SCRATCH,
+                              RESERVE_BITS(graph->v) * sizeof(bitarray_t));
+    CHECK_MALLOC_ERR(px->mask);
+}
+
+
+static inline void free_partition_crossover(PartitionCrossover* px) {
+    tracked_free(px->uf);
+    tracked_free(px->nodes);
+    tracked_free(px->d_cut);
+    tracked_free(px->d_imbalance);
+    tracked_free(px->mask);
+}
+
+
+/* Union-find root of a node, with path halving */
+static inline int _uf_find(int* uf, int node) {
+    while (uf[node] != node) {
+        uf[node] = uf[uf[node]];
+        node = uf[node];
+    }
+    return node;
+}
+
+
+/*
+ * Partition Crossover (PX): the nodes on which the two parents differ are
+ * split into the connected components of the subgraph they induce. An edge
+ * inside a component is cut in both parents or in neither, so each
+ * component's only effect on the cut comes from its edges to the nodes the
+ * parents share, and each component can take either parent's sides
+ * independently of the others. Starting from the fitter parent, every
+ * component whose switch to the other parent's sides lowers the fitness
+ * (cut plus the imbalance penalty of calc_fitness) is switched, so the first
+ * child is never less fit than the fitter parent. 
+ *
+ * The result is returned as a crossover mask for crossover_mutation(): the
+ * first child is the one described above and the second makes the opposite
+ * choice for every component. Runs in O(|V|/32 + sum of the degrees of the
+ * differing nodes).
+ */
+static inline bitarray_t* partition_crossover_mask(Graph* graph,
+                                                   PartitionCrossover* px,
+                                                   Individual* pop,
+                                                   int parent_idxs[]) {
+
+    const bitarray_t* p0 = pop[parent_idxs[0]].partition;
+    const bitarray_t* p1 = pop[parent_idxs[1]].partition;
+    int base = (pop[parent_idxs[1]].fitness < pop[parent_idxs[0]].fitness);
+    const bitarray_t* pb = base ? p1 : p0;
+    int num_diff = 0;
+    int imbalance = 0;
+
+    // imbalance of the fitter parent
+    for (int i=0; i<graph->v; i++) {
+        imbalance += getbit(pb, i) ? (graph->nodes)[i]->weight 
+                                   : -(graph->nodes)[i]->weight;
+    }
+
+    // collect the differing nodes, each in a component of its own
+    for (int w=0; w<RESERVE_BITS(graph->v); w++) {
+        for (bitarray_t d = p0[w] ^ p1[w]; d; d &= d - 1) {
+            int node = (w << 5) + __builtin_ctz(d);
+            px->uf[node] = node;
+            px->d_cut[node] = 0;
+            px->d_imbalance[node] = 0;
+            px->nodes[num_diff++] = node;
+        }
+    }
+
+    // join differing neighbours into components
+    for (int i=0; i<num_diff; i++) {
+        int node = px->nodes[i];
+        for (int j=graph->adj_index[node]; j<graph->adj_index[node+1]; j++) {
+            int nbr = graph->adj_nodes[j];
+            if (nbr > node && getbit(p0, nbr) != getbit(p1, nbr)) {
+                int r1 = _uf_find(px->uf, node);
+                int r2 = _uf_find(px->uf, nbr);
+                if (r1 != r2)
+                    px->uf[MAX(r1, r2)] = MIN(r1, r2);
+            }
+        }
+    }
+
+    // cost of switching each component from parent 0's sides to parent 1's
+    for (int i=0; i<num_diff; i++) {
+        int node = px->nodes[i];
+        int root = _uf_find(px->uf, node);
+        int side0 = getbit(p0, node);
+
+        for (int j=graph->adj_index[node]; j<graph->adj_index[node+1]; j++) {
+            int nbr = graph->adj_nodes[j];
+            int nbr_side = getbit(p0, nbr);
+            if (nbr_side == getbit(p1, nbr)) {
+                // edge to a shared node is cut in exactly one parent
+                px->d_cut[root] += (nbr_side == side0) ? graph->adj_weights[j]
+                                                       : -graph->adj_weights[j];
+            }
+        }
+        px->d_imbalance[root] += side0 ? -2*(graph->nodes)[node]->weight
+                                       : 2*(graph->nodes)[node]->weight;
+    }
+
+    // switch components away from the fitter parent while that helps
+    for (int w=0; w<RESERVE_BITS(graph->v); w++) {
+        px->mask[w] = 0;
+    }
+    for (int i=0; i<num_diff; i++) {
+        int root = px->nodes[i];
+        if (px->uf[root] != root)
+            continue;
+
+        int d_cut = base ? -px->d_cut[root] : px->d_cut[root];
+        int d_imbalance = base ? -px->d_imbalance[root] 
+                               : px->d_imbalance[root];
+        int new_imbalance = imbalance + d_imbalance;
+
+        if (d_cut + abs(new_imbalance) - abs(imbalance) < 0) {
+            imbalance = new_imbalance;
+            px->d_cut[root] = 1;  // reuse as the 'switched' flag
+        }
+        else {
+            px->d_cut[root] = 0;
+        }
+    }
+
+    // mask bits are set where the first child takes parent 1's side
+    for (int i=0; i<num_diff; i++) {
+        int node = px->nodes[i];
+        if (px->d_cut[_uf_find(px->uf, node)] != base)
+            px->mask[DW_INDEX(node)] |= (bitarray_t)1 << BIT_INDEX(node);
+    }
+
+    return px->mask;
+}
+
+
 #endif /* _CROSSOVER_H_ */ 
 
@@ -0,0 +1,521 @@
+/*
+ * ga-params.c
+ *
+ * Default values of the Genetic Algorithm Parameters, and reading them from
+ * the command line and config files
+ *
+ */
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <stddef.h>  // offsetof
+#include <stdio.h>   // printf, fopen, fgets
+#include <stdlib.h>  // strtod
+#include <string.h>  // strcmp, strncmp, strchr, strspn, memcmp
+
+#include "ga-params.h"
+#include "ga-utils.h"
+
+
+#define GA_PARAM_DEFAULTS {                 \
+    .crossover_prob = 0.85,                 \
+    .mutation_prob = 0.001,                 \
+    .puc_prob = 0.7,                        \
+    .px_prob = 0.5,                         \
+    .tournament_select_prob = 0.75,         \
+                                            \
+    .adaptive_rates = 1,                    \
+    .adapt_factor = 1.5,                    \
+    .adapt_learning_rate = 0.1,             \
+    .adapt_min_op_prob = 0.1,               \
+    .mutation_prob_min = 0.0001,            \
+    .mutation_prob_max = 0.05,              \
+                                            \
+    .num_generations = 1000,                \
+    .max_wall_time = 0,                     \
+    .max_evaluations = 0,                   \
+    .target_fitness = 0,                    \
+    .max_stall_generations = 0,             \
+    .min_diversity = 0.0,                   \
+                                            \
+    .pop_size = 40,                         \
+    .steady_state = 0,                      \
+    .ss_replacement = SS_REPLACE_WORST,     \
+    .gen_replacement = GEN_REPLACE_ELITIST, \
+    .num_elites = 2,                        \
+                                            \
+    .num_islands = 5,                       \
+    .island_processes = 0,                  \
+    .num_workers = 0,                       \
+    .pipeline_evaluators = 0,               \
+    .pipeline_batch = 0,                    \
+    .pipeline_depth = 4,                    \
+    .migration_period = 1,                  \
+    .num_to_migrate = 2,                    \
+    .prob_island_stay = 0.75,               \
+    .prob_island_reward = 0.05,             \
+    .prob_island_penalty = 0.05,            \
+    .prob_island_min = 0.01,                \
+    .adaptive_migration = 1,                \
+    .topology = TOPOLOGY_FULL,              \
+    .max_migrant_age = 0,                   \
+    .max_migrant_versions = 0,              \
+    .cluster_hosts = "",                    \
+    .cluster_rank = 0,                      \
+                                            \
+    .balance_repair = 1,                    \
+    .balance_tolerance = 0.02,              \
+                                            \
+    .local_search = LS_NONE,                \
+    .fm_max_moves = 1000,                   \
+    .fm_max_unimproving_moves = 100,        \
+    .fm_max_imbalance = 0.01,               \
+                                            \
+    .compact_storage = 0,                   \
+    .compact_rebase_period = 10,            \
+                                            \
+    .diversity_period = 25,                 \
+                                            \
+    .max_memory = 0,                        \
+                                            \
+    .seed = 0,                              \
+    .sweep_file = "",                       \
+    .sweep_seeds = 1,                       \
+    .sweep_cores = 0,                       \
+                                            \
+    .num_parts = 2,                         \
+    .bisect_cores = 0,                      \
+    .parts_file = "",                       \
+}
+
+GAParams ga_params = GA_PARAM_DEFAULTS;
+
+static const GAParams ga_param_defaults = GA_PARAM_DEFAULTS;
+
+
+// parameter types
+#define PARAM_INT    0
+#define PARAM_LONG   1
+#define PARAM_DOUBLE 2
+#define PARAM_CHOICE 3  // an int set by the name of one of its values
+#define PARAM_STRING 4  // a char array (max is its size)
+
+static const char* const ss_replacements[] = {"worst", "tournament", NULL};
+static const char* const gen_replacements[] = {"elitist", "plus", NULL};
+static const char* const local_searches[] = {"none", "elite", "all", NULL};
+static const char* const topologies[] = {"ring", "torus", "full", NULL};
+
+typedef struct ParamSpec {
+    const char* name;
+    int type;
+    size_t offset;  // of the field in GAParams
+    double min;     // range of valid values (not for PARAM_CHOICE)
+    double max;
+    const char* const* choices;  // names of the values 0, 1, ... of a
+                                 // PARAM_CHOICE
+} ParamSpec;
+
+#define INT_PARAM(field, min, max) \
+        {#field, PARAM_INT, offsetof(GAParams, field), min, max, NULL}
+#define LONG_PARAM(field, min, max) \
+        {#field, PARAM_LONG, offsetof(GAParams, field), min, max, NULL}
+#define DOUBLE_PARAM(field, min, max) \
+        {#field, PARAM_DOUBLE, offsetof(GAParams, field), min, max, NULL}
+#define CHOICE_PARAM(field, choices) \
+        {#field, PARAM_CHOICE, offsetof(GAParams, field), 0, 0, choices}
+#define STRING_PARAM(field) \
+        {#field, PARAM_STRING, offsetof(GAParams, field), 0, \
+         sizeof(((GAParams*)0)->field), NULL}
+
+static const ParamSpec param_specs[] = {
+    DOUBLE_PARAM(crossover_prob, 0, 1),
+    DOUBLE_PARAM(mutation_prob, 0, 1),
+    DOUBLE_PARAM(puc_prob, 0, 1),
+    DOUBLE_PARAM(px_prob, 0, 1),
+    DOUBLE_PARAM(tournament_select_prob, 0, 1),
+
+    INT_PARAM(adaptive_rates, 0, 1),
+    DOUBLE_PARAM(adapt_factor, 1, 100),
+    DOUBLE_PARAM(adapt_learning_rate, 0, 1),
+    DOUBLE_PARAM(adapt_min_op_prob, 0, 0.5),
+    DOUBLE_PARAM(mutation_prob_min, 0, 1),
+    DOUBLE_PARAM(mutation_prob_max, 0, 1),
+
+    INT_PARAM(num_generations, 0, 1e9),
+    DOUBLE_PARAM(max_wall_time, 0, 1e9),
+    LONG_PARAM(max_evaluations, 0, 1e18),
+    INT_PARAM(target_fitness, -1, 1e9),
+    INT_PARAM(max_stall_generations, 0, 1e9),
+    DOUBLE_PARAM(min_diversity, 0, 1),
+
+    INT_PARAM(pop_size, 2, 1 << 16),
+    INT_PARAM(steady_state, 0, 1),
+    CHOICE_PARAM(ss_replacement, ss_replacements),
+    CHOICE_PARAM(gen_replacement, gen_replacements),
+    INT_PARAM(num_elites, 0, 1 << 16),
+
+    INT_PARAM(num_islands, 1, 1024),
+    INT_PARAM(island_processes, 0, 1),
+    INT_PARAM(num_workers, 0, 1024),
+    INT_PARAM(pipeline_evaluators, 0, 1024),
+    INT_PARAM(pipeline_batch, 0, 1e6),
+    INT_PARAM(pipeline_depth, 1, 1024),
+    INT_PARAM(migration_period, 1, 1e9),
+    INT_PARAM(num_to_migrate, 0, 1 << 15),
+    DOUBLE_PARAM(prob_island_stay, 0, 1),
+    DOUBLE_PARAM(prob_island_reward, 0, 1),
+    DOUBLE_PARAM(prob_island_penalty, 0, 1),
+    DOUBLE_PARAM(prob_island_min, 0, 1),
+    INT_PARAM(adaptive_migration, 0, 1),
+    CHOICE_PARAM(topology, topologies),
+    INT_PARAM(max_migrant_age, 0, 1e9),
+    INT_PARAM(max_migrant_versions, 0, 1e9),
+    STRING_PARAM(cluster_hosts),
+    INT_PARAM(cluster_rank, 0, 1e6),
+
+    INT_PARAM(balance_repair, 0, 1),
+    DOUBLE_PARAM(balance_tolerance, 0, 1),
+
+    CHOICE_PARAM(local_search, local_searches),
+    INT_PARAM(fm_max_moves, 0, 1e9),
+    INT_PARAM(fm_max_unimproving_moves, 1, 1e9),
+    DOUBLE_PARAM(fm_max_imbalance, 0, 1),
+
+    INT_PARAM(compact_storage, 0, 1),
+    INT_PARAM(compact_rebase_period, 1, 1e9),
+
+    INT_PARAM(diversity_period, 1, 1e9),
+
+    DOUBLE_PARAM(max_memory, 0, 1e9),
+
+    INT_PARAM(seed, 0, 2147483647),
+    STRING_PARAM(sweep_file),
+    INT_PARAM(sweep_seeds, 1, 1e6),
+    INT_PARAM(sweep_cores, 0, 1e6),
+
+    INT_PARAM(num_parts, 2, 1 << 20),
+    INT_PARAM(bisect_cores, 0, 1e6),
+    STRING_PARAM(parts_file),
+};
+
+#define NUM_PARAMS (int)(sizeof(param_specs) / sizeof(param_specs[0]))
+
+
+static const ParamSpec* _find_param(const char* name, size_t len) {
+    for (int i=0; i<NUM_PARAMS; i++) {
+        if (strlen(param_specs[i].name) == len
+            && strncmp(param_specs[i].name, name, len) == 0)
+            return &param_specs[i];
+    }
+    return NULL;
+}
+
+
+/*
+ * Sets the parameter named name (len characters, in which '-' may stand for
+ * '_') to value. Returns 1 on success, 0 on failure.
+ */
+static int _set_param(const char* name, size_t len, const char* value) {
+    char key[64];
+    char* end;
+
+    // no parameter's name is this long, and cutting it short could make it
+    // one that is
+    if (len >= sizeof(key)) {
+        fprintf(stderr, "unknown parameter '%.*s'\n", (int)len, name);
+        return 0;
+    }
+    for (size_t i=0; i<len; i++) {
+        key[i] = (name[i] == '-') ? '_' : name[i];
+    }
+    key[len] = '\0';
+
+    const ParamSpec* spec = _find_param(key, len);
+    if (!spec) {
+        fprintf(stderr, "unknown parameter '%s'\n", key);
+        return 0;
+    }
+
+    void* field = (char*)&ga_params + spec->offset;
+
+    if (spec->type == PARAM_CHOICE) {
+        for (int i=0; spec->choices[i]; i++) {
+            if (strcmp(value, spec->choices[i]) == 0) {
+                *(int*)field = i;
+                return 1;
+            }
+        }
+        fprintf(stderr, "%s must be one of:", key);
+        for (int i=0; spec->choices[i]; i++) {
+            fprintf(stderr, " %s", spec->choices[i]);
+        }
+        fprintf(stderr, "\n");
+        return 0;
+    }
+
+    if (spec->type == PARAM_STRING) {
+        if (strlen(value) >= (size_t)spec->max) {
+            fprintf(stderr, "%s must be shorter than %g characters\n",
+                    key, spec->max);
+            return 0;
+        }
+        strcpy(field, value);
+        return 1;
+    }
+
+    double x = strtod(value, &end);
+    if (end == value || *end != '\0' || x < spec->min || x > spec->max
+        || (spec->type != PARAM_DOUBLE && x != (long)x)) {
+        fprintf(stderr, "%s must be a%s number from %g to %g, not '%s'\n",
+                key, spec->type == PARAM_DOUBLE ? "" : " whole",
+                spec->min, spec->max, value);
+        return 0;
+    }
+
+    switch (spec->type) {
+        case PARAM_INT:
+            *(int*)field = (int)x;
+            break;
+        case PARAM_LONG:
+            *(long*)field = (long)x;
+            break;
+        default:
+            *(double*)field = x;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Reads parameters from a config file of lines "name = value". Everything
+ * after a '#' is a comment. Returns 1 on success, 0 on failure.
+ */
+static int _read_config_file(const char* filename) {
+    FILE* fp;
+    char line[1024];
+    int line_no = 0;
+    const char* blanks = " \t\r\n";
+
+    fp = fopen(filename, "r");
+    if (NULL == fp) {
+        perror(filename);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char* name = line + strspn(line, blanks);
+        if (*name == '\0')
+            continue;
+
+        char* equals = strchr(name, '=');
+        if (!equals) {
+            fprintf(stderr, "%s:%d: expected name = value\n",
+                    filename, line_no);
+            fclose(fp);
+            return 0;
+        }
+
+        size_t len = equals - name;
+        while (len > 0 && strchr(blanks, name[len-1]))
+            len--;
+
+        char* value = equals + 1 + strspn(equals + 1, blanks);
+        char* value_end = value + strlen(value);
+        while (value_end > value && strchr(blanks, value_end[-1]))
+            *--value_end = '\0';
+
+        if (!_set_param(name, len, value)) {
+            fprintf(stderr, "%s:%d: invalid setting\n", filename, line_no);
+            fclose(fp);
+            return 0;
+        }
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+
+/*
+ * Checks the constraints between parameters. Returns 1 if they hold.
+ */
+static int _check_params(void) {
+    if (POP_SIZE % 2) {
+        fprintf(stderr, "pop_size must be an even number\n");
+        return 0;
+    }
+    if (NUM_ELITES >= POP_SIZE) {
+        fprintf(stderr, "num_elites must be less than pop_size\n");
+        return 0;
+    }
+    if (NUM_TO_MIGRATE > POP_SIZE/2) {
+        fprintf(stderr, "num_to_migrate must be at most half of pop_size\n");
+        return 0;
+    }
+    if (NUM_WORKERS && ISLAND_PROCESSES) {
+        fprintf(stderr, "num_workers needs island_processes = 0\n");
+        return 0;
+    }
+    if (PIPELINE_EVALUATORS && (ISLAND_PROCESSES || NUM_WORKERS
+                                || STEADY_STATE)) {
+        fprintf(stderr, "pipeline_evaluators needs island_processes, "
+                        "num_workers and steady_state = 0\n");
+        return 0;
+    }
+    if (SWEEP_FILE[0] && CLUSTER_HOSTS[0]) {
+        fprintf(stderr, "sweep_file needs cluster_hosts to be empty\n");
+        return 0;
+    }
+    if (NUM_PARTS & (NUM_PARTS - 1)) {
+        fprintf(stderr, "num_parts must be a power of 2\n");
+        return 0;
+    }
+    if (NUM_PARTS > 2 && (SWEEP_FILE[0] || CLUSTER_HOSTS[0])) {
+        fprintf(stderr, "num_parts > 2 needs sweep_file and cluster_hosts "
+                        "to be empty\n");
+        return 0;
+    }
+    if (MUTATION_PROB_MIN > MUTATION_PROB_MAX) {
+        fprintf(stderr, "mutation_prob_min must not exceed "
+                        "mutation_prob_max\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Sets the parameter named name to value, as --name=value would. Returns 1
+ * on success, 0 (after printing why) on failure.
+ */
+int set_ga_param(const char* name, const char* value) {
+    return _set_param(name, strlen(name), value);
+}
+
+
+/*
+ * Checks the constraints between parameters, after set_ga_param(). Returns
+ * 1 if they hold, 0 (after printing why) if not.
+ */
+int check_ga_params(void) {
+    return _check_params();
+}
+
+
+static void _print_usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--config=<file>] [--<parameter>=<value> ...] "
+            "<graph_file>\n"
+            "Settings are applied in order, so later ones override earlier "
+            "ones.\nParameters and their defaults:\n",
+            program);
+    print_ga_params(stderr, 0);
+}
+
+
+/*
+ * Sets ga_params from the command line: any number of --config=<file> and
+ * --<parameter>=<value> arguments, applied in order over the defaults, and
+ * the graph file, which is returned in *graph_file. Returns 1 on success, 0
+ * (after printing why, and the usage) on failure.
+ */
+int parse_ga_params(int argc, char** argv, char** graph_file) {
+
+    *graph_file = NULL;
+
+    for (int i=1; i<argc; i++) {
+        char* arg = argv[i];
+
+        if (strncmp(arg, "--", 2) != 0) {
+            if (*graph_file) {
+                fprintf(stderr, "more than one graph file given\n");
+                _print_usage(argv[0]);
+                return 0;
+            }
+            *graph_file = arg;
+            continue;
+        }
+
+        arg += 2;
+        char* equals = strchr(arg, '=');
+
+        if (strcmp(arg, "help") == 0) {
+            _print_usage(argv[0]);
+            return 0;
+        }
+        if (!equals) {
+            fprintf(stderr, "expected --<parameter>=<value>, not '%s'\n",
+                    argv[i]);
+            _print_usage(argv[0]);
+            return 0;
+        }
+
+        if (strncmp(arg, "config=", 7) == 0) {
+            if (!_read_config_file(equals + 1))
+                return 0;
+        }
+        else if (!_set_param(arg, equals - arg, equals + 1)) {
+            return 0;
+        }
+    }
+
+    if (!*graph_file) {
+        _print_usage(argv[0]);
+        return 0;
+    }
+
+    return _check_params();
+}
+
+
+/*
+ * Prints each parameter as name = value, in the format of a config file;
+ * with changed_only set, only those that differ from their defaults. Returns
+ * the number printed.
+ */
+int print_ga_params(FILE* fp, int changed_only) {
+    int num_printed = 0;
+
+    for (int i=0; i<NUM_PARAMS; i++) {
+        const ParamSpec* spec = &param_specs[i];
+        const void* field = (const char*)&ga_params + spec->offset;
+        const void* dflt = (const char*)&ga_param_defaults + spec->offset;
+        size_t size = (spec->type == PARAM_LONG) ? sizeof(long)
+                      : (spec->type == PARAM_DOUBLE) ? sizeof(double)
+                      : sizeof(int);
+
+        if (changed_only
+            && (spec->type == PARAM_STRING ? strcmp(field, dflt) == 0
+                                           : memcmp(field, dflt, size) == 0))
+            continue;
+
+        switch (spec->type) {
+            case PARAM_CHOICE:
+                fprintf(fp, "\t%s = %s\n", spec->name,
+                        spec->choices[*(int*)field]);
+                break;
+            case PARAM_STRING:
+                // an empty value leaves nothing after the '='
+                fprintf(fp, "\t%s =%s%s\n", spec->name,
+                        *(const char*)field ? " " : "", (const char*)field);
+                break;
+            case PARAM_INT:
+                fprintf(fp, "\t%s = %d\n", spec->name, *(int*)field);
+                break;
+            case PARAM_LONG:
+                fprintf(fp, "\t%s = %ld\n", spec->name, *(long*)field);
+                break;
+            default:
+                fprintf(fp, "\t%s = %g\n", spec->name, *(double*)field);
+        }
+        num_printed++;
+    }
+
+    return num_printed;
+}
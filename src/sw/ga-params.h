@@ -8,41 +8,268 @@
 #ifndef _GA_PARAMS_H_
 #define _GA_PARAMS_H_
 
+#include <stdio.h>  // FILE
+
 #include "bitarray.h"
-#include "llist/llist.h"
 
-#define CROSSOVER_PROB 0.85
-#define MUTATION_PROB 0.001
-#define PUC_PROB 0.7
-#define TOURNAMENT_SELECT_PROB 0.75
+// choices of some parameters
+#define SS_REPLACE_WORST 0       // steady-state child replaces the least fit
+#define SS_REPLACE_TOURNAMENT 1  // or the loser of a binary tournament
+#define GEN_REPLACE_ELITIST 0  // children replace the parents, except for the
+                               // NUM_ELITES most fit parents
+#define GEN_REPLACE_PLUS 1     // or the POP_SIZE most fit of parents and 
+                               // children survive, (mu+lambda)
+#define LS_NONE 0   // no local search
+#define LS_ELITE 1  // refine the best child on each island every generation
+                    // (off by default, see local-search.h)
+#define LS_ALL 2    // refine every child
+#define TOPOLOGY_RING  0  // migrants go from each island to the next
+#define TOPOLOGY_TORUS 1  // islands on a wrapped 2D grid, to the 4 neighbours
+#define TOPOLOGY_FULL  2  // from every island to every other
+
+
+/*
+ * The parameters are read at startup (see parse_ga_params() in ga-params.c,
+ * where the defaults are), so one binary serves any population size, number
+ * of islands or graph. Each is known to the code by its macro below; its 
+ * name on the command line and in a config file is the field name.
+ */
+typedef struct GAParams {
+    double crossover_prob;
+    double mutation_prob;
+    double puc_prob;
+    double px_prob;  // probability of partition crossover instead of 
+                     // parameterized uniform crossover
+    double tournament_select_prob;
+
+    int adaptive_rates;          // 1 to adapt mutation_prob and px_prob per
+                                 // island
+    double adapt_factor;         // 1/5th rule mutation step factor
+    double adapt_learning_rate;  // weight of newest result in the operator
+                                 // success averages
+    double adapt_min_op_prob;    // min probability of each crossover
+    double mutation_prob_min;
+    double mutation_prob_max;
+
+    int num_generations;  // max number of generations
+
+    // further stopping criteria, checked at the start of each generation (0
+    // to disable each). The GA also stops on SIGINT or SIGTERM, and in every
+    // case reports the best individual found so far.
+    double max_wall_time;       // seconds of wall clock time since start
+    long max_evaluations;       // number of fitness evaluations
+    int target_fitness;         // stop once an individual is this fit (0 is
+                                // optimal, -1 to disable)
+    int max_stall_generations;  // generations without a new best individual
+    double min_diversity;       // stop once the diversity on every island is
+                                // below this
+
+    int pop_size;        // must be even
+    int steady_state;    // 1 to replace individuals as soon as each child is
+                         // evaluated instead of a generation at a time
+    int ss_replacement;  // SS_REPLACE_...
+    int gen_replacement; // GEN_REPLACE_...
+    int num_elites;      // must be less than pop_size
+
+    int num_islands;
+    int island_processes;  // 1 to evolve each island in a process of its own
+                           // rather than a thread
+    int num_workers;       // if not 0, the islands are evolved by this many
+                           // threads, which share their work out as tasks
+                           // by work stealing, rather than by a thread each
+
+    // pipelined generations: with pipeline_evaluators not 0, the children
+    // each island's thread makes are evaluated by one of this many threads,
+    // in batches of pipeline_batch pairs (0 to tune the size on each island)
+    // while the island makes more, with at most pipeline_depth batches of an
+    // island in the pipeline at once (see pipeline.h)
+    int pipeline_evaluators;
+    int pipeline_batch;
+    int pipeline_depth;
+    int migration_period;  // generations between sending migrants (they
+                           // are taken in every generation)
+    int num_to_migrate;  // approximately 5%, at most half of pop_size
+    double prob_island_stay;
+    double prob_island_reward;
+    double prob_island_penalty;
+    double prob_island_min;  // migration probabilities never fall below this
+    int adaptive_migration;  // 1 to send migrants by migration_probs, 0 to
+                             // send them to each neighbour in turn
+    int topology;            // TOPOLOGY_..., which islands are neighbours
+
+    // staleness limits: a migrant is discarded on arrival if it was sent
+    // more than max_migrant_age generations (of the island it arrives on)
+    // ago, or if its island has since sent more than max_migrant_versions
+    // newer versions of its elites (0 to disable each)
+    int max_migrant_age;
+    int max_migrant_versions;
+
+    // cluster mode: the GA runs on every host listed (one host:port per
+    // line) in the file cluster_hosts, cluster_rank being the line of this
+    // one (from 0), and the groups of islands on the hosts exchange migrants
+    // (see cluster.h). Empty to run alone.
+    char cluster_hosts[256];
+    int cluster_rank;
+
+    int balance_repair;        // 1 to rebalance children after mutation
+    double balance_tolerance;  // fraction of total node weight by which the
+                               // partitions of a child may differ before it
+                               // is repaired
+
+    int local_search;              // LS_...
+    int fm_max_moves;              // max node moves per refinement pass
+    int fm_max_unimproving_moves;  // end pass after this many moves without
+                                   // a new best fitness
+    double fm_max_imbalance;  // fraction of total node weight by which the
+                              // partitions may differ during refinement
+
+    int compact_storage;        // 1 to store population members as deltas
+                                // against a reference partition of their
+                                // island
+    int compact_rebase_period;  // generations between choosing a new
+                                // reference partition for each island
+
+    int diversity_period;  // print diversity every diversity_period
+                           // generations
 
-#define NUM_GENERATIONS 1000
-#define POP_SIZE 40
+    double max_memory;  // MB the GA may have allocated at once, 0 for no
+                        // limit
 
-#define NUM_ISLANDS 5
-#define MIGRATION_PERIOD 1
-#define NUM_TO_MIGRATE 2  // approximately 5%, must be less than half
-#define PROB_ISLAND_STAY 0.75
-#define PROB_ISLAND_MIGRATE (double)(1 - PROB_ISLAND_STAY)/(NUM_ISLANDS - 1)
-#define PROB_ISLAND_REWARD 0.05
-#define PROB_ISLAND_PENALTY 0.05
+    int seed;  // of the random number generator, 0 to seed it from the time
 
-#define DIVERSITY_PERIOD 25  // measure diversity every 
-                                           // DIVERSITY_PERIOD generations
+    // sweep mode: instead of a single run, run the GA for each configuration
+    // in the file sweep_file with each of sweep_seeds seeds (seed, seed+1,
+    // ..., from 1 if seed is 0), as many runs at once as fit in sweep_cores
+    // cores (0 for every online core), and print a table of the results (see
+    // sweep.h). Empty for a single run.
+    char sweep_file[256];
+    int sweep_seeds;
+    int sweep_cores;
+
+    // number of parts to partition the graph into, a power of 2. For more
+    // than 2, the graph is bisected recursively: each part of a bisection is
+    // bisected in turn, those of a level at once, in processes as many as
+    // fit in bisect_cores cores (0 for every online core). balance_tolerance
+    // and fm_max_imbalance then bound the imbalance of the final parts, and
+    // are shared out among the levels (see bisect.h).
+    int num_parts;
+    int bisect_cores;
+    char parts_file[256];  // file to write the part of each node to, one
+                           // per line in node order; empty for none
+} GAParams;
+
+extern GAParams ga_params;
+
+int  parse_ga_params(int argc, char** argv, char** graph_file);
+int  print_ga_params(FILE* fp, int changed_only);
+int  set_ga_param(const char* name, const char* value);
+int  check_ga_params(void);
+
+#define CROSSOVER_PROB         (ga_params.crossover_prob)
+#define MUTATION_PROB          (ga_params.mutation_prob)
+#define PUC_PROB               (ga_params.puc_prob)
+#define PX_PROB                (ga_params.px_prob)
+#define TOURNAMENT_SELECT_PROB (ga_params.tournament_select_prob)
+
+#define ADAPTIVE_RATES      (ga_params.adaptive_rates)
+#define ADAPT_PERIOD        POP_SIZE  // children between adaptations
+#define ADAPT_FACTOR        (ga_params.adapt_factor)
+#define ADAPT_LEARNING_RATE (ga_params.adapt_learning_rate)
+#define ADAPT_MIN_OP_PROB   (ga_params.adapt_min_op_prob)
+#define MUTATION_PROB_MIN   (ga_params.mutation_prob_min)
+#define MUTATION_PROB_MAX   (ga_params.mutation_prob_max)
+
+#define NUM_GENERATIONS       (ga_params.num_generations)
+#define MAX_WALL_TIME         (ga_params.max_wall_time)
+#define MAX_EVALUATIONS       (ga_params.max_evaluations)
+#define TARGET_FITNESS        (ga_params.target_fitness)
+#define MAX_STALL_GENERATIONS (ga_params.max_stall_generations)
+#define MIN_DIVERSITY         (ga_params.min_diversity)
+
+#define POP_SIZE        (ga_params.pop_size)
+#define STEADY_STATE    (ga_params.steady_state)
+#define SS_REPLACEMENT  (ga_params.ss_replacement)
+#define GEN_REPLACEMENT (ga_params.gen_replacement)
+#define NUM_ELITES      (ga_params.num_elites)
+
+#define NUM_ISLANDS          (ga_params.num_islands)
+#define ISLAND_PROCESSES     (ga_params.island_processes)
+#define NUM_WORKERS          (ga_params.num_workers)
+#define PIPELINE_EVALUATORS  (ga_params.pipeline_evaluators)
+#define PIPELINE_BATCH       (ga_params.pipeline_batch)
+#define PIPELINE_DEPTH       (ga_params.pipeline_depth)
+#define MIGRATION_PERIOD     (ga_params.migration_period)
+#define NUM_TO_MIGRATE       (ga_params.num_to_migrate)
+#define PROB_ISLAND_STAY     (ga_params.prob_island_stay)
+#define PROB_ISLAND_REWARD   (ga_params.prob_island_reward)
+#define PROB_ISLAND_PENALTY  (ga_params.prob_island_penalty)
+#define PROB_ISLAND_MIN      (ga_params.prob_island_min)
+#define ADAPTIVE_MIGRATION   (ga_params.adaptive_migration)
+#define TOPOLOGY             (ga_params.topology)
+#define MAX_MIGRANT_AGE      (ga_params.max_migrant_age)
+#define MAX_MIGRANT_VERSIONS (ga_params.max_migrant_versions)
+#define CLUSTER_HOSTS        (ga_params.cluster_hosts)
+#define CLUSTER_RANK         (ga_params.cluster_rank)
+
+#define BALANCE_REPAIR    (ga_params.balance_repair)
+#define BALANCE_TOLERANCE (ga_params.balance_tolerance)
+
+#define LOCAL_SEARCH             (ga_params.local_search)
+#define FM_MAX_MOVES             (ga_params.fm_max_moves)
+#define FM_MAX_UNIMPROVING_MOVES (ga_params.fm_max_unimproving_moves)
+#define FM_MAX_IMBALANCE         (ga_params.fm_max_imbalance)
+
+#define COMPACT_STORAGE       (ga_params.compact_storage)
+#define COMPACT_REBASE_PERIOD (ga_params.compact_rebase_period)
+
+#define DIVERSITY_PERIOD (ga_params.diversity_period)
+
+#define MAX_MEMORY (ga_params.max_memory)
+
+#define SEED        (ga_params.seed)
+#define SWEEP_FILE  (ga_params.sweep_file)
+#define SWEEP_SEEDS (ga_params.sweep_seeds)
+#define SWEEP_CORES (ga_params.sweep_cores)
+
+#define NUM_PARTS    (ga_params.num_parts)
+#define BISECT_CORES (ga_params.bisect_cores)
+#define PARTS_FILE   (ga_params.parts_file)
 
 
 typedef struct Individual {
     bitarray_t* partition;  // array of bits representing partition
     int fitness;            // fitness of individual's solution
+    struct PackedGenome* packed;  // with COMPACT_STORAGE, the packed 
+                                  // partition of a population member (whose
+                                  // partition is then NULL), else NULL
 } Individual;
 
+#define GENOME_ALIGN 64  // byte alignment of each genome in a GenomePool
+// number of words from one genome of a GenomePool to the next, a whole 
+// number of GENOME_ALIGN bytes
+#define GENOME_STRIDE(n) \
+        ((RESERVE_BITS(n) + GENOME_ALIGN/sizeof(bitarray_t) - 1) \
+         & ~(GENOME_ALIGN/sizeof(bitarray_t) - 1))
+
 typedef struct Island {
-    List* member_list;        // pointer to linked list containing the indices 
-                              // of all members of this island
-    int num_members;          // number of members of this island
+    Individual* population;   // array of the POP_SIZE members of this island,
+                              // whose partitions are rows of a GenomePool
     double avg_fitness;       // average fitness of the members of this island
+                              // at its last migration
     double* migration_probs;  // array containing probabilities of migration
-                              // to other islands (by index), including itself
+                              // to other islands (by index), including itself;
+                              // 0 for islands that are not neighbours
+    int* neighbours;          // islands this one sends migrants to, as set by
+                              // TOPOLOGY
+    int num_neighbours;
+    int num_migrations;       // times migrants have been sent so far
+    uint64_t* elite_hashes;   // hashes of the partitions of the
+                              // NUM_TO_MIGRATE most fit individuals when
+                              // migrants were last sent
+    uint64_t* sent_hashes;    // hashes of the last NUM_TO_MIGRATE migrants
+                              // sent to each neighbour (by index in
+                              // neighbours), NUM_TO_MIGRATE for each
+    long* num_sent;           // migrants sent to each neighbour so far
 } Island;
 
 #endif /* _GA_PARAMS_H_ */
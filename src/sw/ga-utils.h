@@ -6,9 +6,11 @@
 #ifndef _GA_UTILS_
 #define _GA_UTILS_
 
+#include <sched.h>   // sched_yield
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>    // clock_gettime, nanosleep
 #include <unistd.h>
 
 #define F_PI 3.141592653f
@@ -20,9 +22,11 @@ extern "C" {
 #ifdef __GNUC__
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
+#define always_inline   inline __attribute__((always_inline))
 #else
 #define likely(x)       (x)
 #define unlikely(x)     (x)
+#define always_inline   inline
 #endif
 
 #define MAX(a,b) \
@@ -35,6 +39,9 @@ extern "C" {
      _a < _b ? _a : _b; })
 #define MOD(a,b) ((((a)%(b))+(b))%(b))
 
+#define CACHE_LINE 64  // bytes; data written by different threads is kept
+                       // this far apart to avoid false sharing
+
 
 #define CHECK_MALLOC_ERR(ptr) \
         (unlikely(!check_malloc_err(ptr)) ? (int_exit(1)) : (1))
@@ -88,6 +95,20 @@ static inline int hamming_distance(unsigned x, unsigned y) {
 }
 
 
+/*
+ * 64 bit FNV-1a hash of num_words words, e.g. of a partition, to tell
+ * partitions apart without keeping copies of them
+ */
+static inline uint64_t hash_words(const uint32_t* words, int num_words) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int i=0; i<num_words; i++) {
+        hash ^= words[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 /* Returns an integer in the range [0, n) from a uniform distribution.
  *
  * Uses rand(), and so is affected-by/affects the same seed.
@@ -116,6 +137,104 @@ static inline int urandint(int n) {
 }
 
 
+/*
+ * xorshift32 pseudo-random number generator (Marsaglia, 2003). Much cheaper
+ * than rand() when whole words of random bits are needed. The state must be
+ * seeded with a non-zero value.
+ */
+static inline uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+/*
+ * Returns a 32 bit word in which each bit is set independently with
+ * probability prob (to within 1/256). The word is built up from the binary
+ * expansion of prob, least significant digit first: OR-ing in a random word
+ * maps p to (1+p)/2 and AND-ing maps p to p/2, so 8 random words are needed
+ * instead of 32 calls to rand().
+ */
+static inline uint32_t random_mask32(uint32_t* state, double prob) {
+    int p8 = (int)(prob*256 + 0.5);
+    uint32_t mask = 0;
+
+    if (p8 <= 0)
+        return 0;
+    if (p8 >= 256)
+        return 0xFFFFFFFF;
+
+    for (int i=0; i<8; i++) {
+        if ((p8 >> i) & 1)
+            mask |= xorshift32(state);
+        else
+            mask &= xorshift32(state);
+    }
+
+    return mask;
+}
+
+
+/*
+ * Returns an integer in the range [0, n) from a uniform distribution (to
+ * within n/2^32), by scaling a random word instead of rejecting values. Each
+ * thread keeps its own state, so unlike urandint() this can be called from
+ * several threads at once.
+ */
+static inline int xorshift_int(uint32_t* state, int n) {
+    return (int)(((uint64_t)xorshift32(state) * (uint32_t)n) >> 32);
+}
+
+
+/*
+ * Returns a double in the range (0, 1] from a uniform distribution
+ */
+static inline double xorshift_uniform(uint32_t* state) {
+    return ((xorshift32(state) >> 8) + 1) / 16777216.0;
+}
+
+
+// clock_gettime and nanosleep need _POSIX_C_SOURCE >= 199309L
+#ifdef CLOCK_MONOTONIC
+
+// how a thread with nothing to do waits (a pipeline stage, or a scheduler
+// worker that found nothing to steal): it yields the processor for the first
+// IDLE_YIELDS rounds, then sleeps IDLE_SLEEP_NS between rounds
+#define IDLE_YIELDS   16
+#define IDLE_SLEEP_NS 50000
+
+
+/*
+ * Seconds on the monotonic clock, for timing intervals
+ */
+static inline double wall_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ * Waits a little, after idle_rounds rounds in a row with nothing to do
+ */
+static inline void idle_backoff(int idle_rounds) {
+    if (idle_rounds < IDLE_YIELDS) {
+        sched_yield();
+    }
+    else {
+        struct timespec idle = {0, IDLE_SLEEP_NS};
+        nanosleep(&idle, NULL);
+    }
+}
+
+#endif
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,172 @@
+/*
+ * genome-pool.h
+ *
+ * Reference counted storage for the partitions of the individuals on an
+ * island. Partitions are rows of an arena, so an individual that is a copy
+ * of another (a surviving parent, or a child identical to its parent) can
+ * share its row instead of copying it. Shared rows are treated as read-only:
+ * an individual must get a private row before its partition is changed in
+ * place. Each island has a pool of its own, used only by the island's
+ * thread, so none of this is locked; migrants are copied between pools.
+ *
+ */
+
+#ifndef _GENOME_POOL_H_
+#define _GENOME_POOL_H_
+
+#include <stdlib.h>  // malloc
+#include <string.h>  // memcpy
+
+#include "bitarray.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "mem-track.h"
+
+
+typedef struct GenomePool {
+    int num_words;       // words in use in each row (RESERVE_BITS)
+    int stride;          // words from one row to the next (GENOME_STRIDE)
+    int capacity;        // number of rows
+    bitarray_t* arena;   // capacity rows, each aligned to GENOME_ALIGN bytes
+    int* refcount;       // number of individuals using each row
+    int* free_rows;      // stack of unused rows
+    int num_free;
+    int peak_used;       // largest number of rows in use at once
+} GenomePool;
+
+#define GENOME_POOL_PAGE 4096  // bytes each pool's arena is rounded up to
+
+
+/*
+ * Bytes of arena a pool of capacity rows for partitions of num_nodes nodes
+ * takes: whole pages, so that the pools of several islands can be cut from
+ * one arena without sharing a page
+ */
+static inline size_t genome_pool_bytes(int capacity, int num_nodes) {
+    size_t bytes = (size_t)capacity * GENOME_STRIDE(num_nodes)
+                   * sizeof(bitarray_t);
+
+    return (bytes + GENOME_POOL_PAGE-1) & ~(size_t)(GENOME_POOL_PAGE-1);
+}
+
+
+/*
+ * Sets up a pool of capacity rows for partitions of num_nodes nodes in arena,
+ * which must be page aligned and genome_pool_bytes() long. The arena is not
+ * cleared: rows are handed out from its start, so the pages of rows that are
+ * never used are never touched, and the pages that are used end up on the
+ * NUMA node of the thread that first writes them. Each island's pool is set
+ * up and used by that island's thread.
+ */
+static inline void init_genome_pool(GenomePool* pool,
+                                    int capacity,
+                                    int num_nodes,
+                                    bitarray_t* arena) {
+    pool->num_words = RESERVE_BITS(num_nodes);
+    pool->stride = GENOME_STRIDE(num_nodes);
+    pool->capacity = capacity;
+    pool->num_free = capacity;
+    pool->peak_used = 0;
+    pool->arena = arena;
+
+    pool->refcount = tracked_malloc(MEM_POPULATION, capacity * sizeof(int));
+    CHECK_MALLOC_ERR(pool->refcount);
+    pool->free_rows = tracked_malloc(MEM_POPULATION, capacity * sizeof(int));
+    CHECK_MALLOC_ERR(pool->free_rows);
+
+    for (int row=0; row<capacity; row++) {
+        pool->refcount[row] = 0;
+        pool->free_rows[row] = capacity-1 - row;  // row 0 on top
+    }
+}
+
+
+/* Frees the bookkeeping of a pool; its arena belongs to the caller */
+static inline void free_genome_pool(GenomePool* pool) {
+    tracked_free(pool->refcount);
+    tracked_free(pool->free_rows);
+}
+
+
+static inline int _genome_row(GenomePool* pool, const bitarray_t* genome) {
+    return (genome - pool->arena) / pool->stride;
+}
+
+
+/*
+ * Returns an unused row with a reference count of 1. Its contents are
+ * undefined, apart from the padding after num_words, which is zero.
+ */
+static inline bitarray_t* genome_alloc(GenomePool* pool) {
+    if (pool->num_free == 0) {
+        fprintf(stderr, "Genome pool of %d rows exhausted\n", pool->capacity);
+        exit(1);
+    }
+
+    int row = pool->free_rows[--pool->num_free];
+    bitarray_t* genome = pool->arena + (size_t)row * pool->stride;
+
+    pool->refcount[row] = 1;
+    pool->peak_used = MAX(pool->peak_used, pool->capacity - pool->num_free);
+
+    for (int i=pool->num_words; i<pool->stride; i++) {
+        genome[i] = 0;
+    }
+
+    return genome;
+}
+
+
+/* Adds a reference to a row and returns it */
+static inline bitarray_t* genome_share(GenomePool* pool, bitarray_t* genome) {
+    pool->refcount[_genome_row(pool, genome)]++;
+    return genome;
+}
+
+
+/* Drops a reference to a row, which is reused once nothing refers to it */
+static inline void genome_release(GenomePool* pool, bitarray_t* genome) {
+    int row = _genome_row(pool, genome);
+
+    if (--pool->refcount[row] == 0)
+        pool->free_rows[pool->num_free++] = row;
+}
+
+
+static inline int genome_is_shared(GenomePool* pool, const bitarray_t* genome) {
+    return pool->refcount[_genome_row(pool, genome)] > 1;
+}
+
+
+/*
+ * Copy on write: returns genome if nothing else refers to it, otherwise drops
+ * this reference to it and returns a private copy of it
+ */
+static inline bitarray_t* genome_make_unique(GenomePool* pool,
+                                             bitarray_t* genome) {
+    if (!genome_is_shared(pool, genome))
+        return genome;
+
+    bitarray_t* copy = genome_alloc(pool);
+    memcpy(copy, genome, pool->num_words * sizeof(bitarray_t));
+    genome_release(pool, genome);
+
+    return copy;
+}
+
+
+/*
+ * Like genome_make_unique, but for a row that is about to be completely
+ * overwritten, so nothing is copied
+ */
+static inline bitarray_t* genome_make_writable(GenomePool* pool,
+                                               bitarray_t* genome) {
+    if (!genome_is_shared(pool, genome))
+        return genome;
+
+    genome_release(pool, genome);
+
+    return genome_alloc(pool);
+}
+
+#endif /* _GENOME_POOL_H_ */
@@ -7,11 +7,88 @@
 
 #include <assert.h>  // assert
 #include <stdio.h>   // printf, fgets
-#include <stdlib.h>  // atoi, malloc
-#include <string.h>  // strrchr, strcmp, strtok
+#include <stdlib.h>  // atoi
+#include <string.h>  // strrchr, strcmp, strtok, memcpy
 
 #include "ga-utils.h"
 #include "graph-parser.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+
+
+/*
+ * Sets the row offsets of the adjacency index of graph, whose adj_index
+ * has been allocated, from its edge list
+ */
+static void index_adjacency(Graph* graph) {
+
+    memset(graph->adj_index, 0, (graph->v + 1) * sizeof(int));
+
+    // count the degree of each node, shifted one place up
+    for (int i=0; i<graph->e; i++) {
+        Edge* edge = (graph->edges)[i];
+        if (edge->n1 != edge->n2) {
+            graph->adj_index[edge->n1 + 1]++;
+            graph->adj_index[edge->n2 + 1]++;
+        }
+    }
+
+    // prefix sum gives the start of each node's row
+    for (int i=0; i<graph->v; i++) {
+        graph->adj_index[i+1] += graph->adj_index[i];
+    }
+}
+
+
+/*
+ * Fills in the rows of the adjacency index of graph, once index_adjacency()
+ * has set their offsets and adj_nodes and adj_weights have been allocated
+ */
+static void fill_adjacency(Graph* graph) {
+
+    int* fill = tracked_malloc(MEM_IO, MAX(graph->v, 1) * sizeof(int));
+    CHECK_MALLOC_ERR(fill);
+    memcpy(fill, graph->adj_index, graph->v * sizeof(int));
+
+    for (int i=0; i<graph->e; i++) {
+        Edge* edge = (graph->edges)[i];
+        if (edge->n1 != edge->n2) {
+            graph->adj_nodes[fill[edge->n1]] = edge->n2;
+            graph->adj_weights[fill[edge->n1]++] = edge->weight;
+            graph->adj_nodes[fill[edge->n2]] = edge->n1;
+            graph->adj_weights[fill[edge->n2]++] = edge->weight;
+        }
+    }
+
+    tracked_free(fill);
+}
+
+
+/*
+ * Builds the adjacency index of a graph whose node and edge lists have been
+ * filled in, so that the neighbours of a node can be visited in O(degree).
+ * The index is read by every island, so its pages are interleaved over the
+ * NUMA nodes.
+ */
+static void build_adjacency(Graph* graph) {
+
+    graph->adj_index = large_alloc("adjacency index",
+                                   MEM_GRAPH,
+                                   (graph->v + 1) * sizeof(int),
+                                   PLACE_INTERLEAVE);
+    index_adjacency(graph);
+
+    graph->adj_nodes = large_alloc("adjacent nodes",
+                                   MEM_GRAPH,
+                                   graph->adj_index[graph->v] * sizeof(int),
+                                   PLACE_INTERLEAVE);
+    graph->adj_weights = large_alloc("adjacent weights",
+                                     MEM_GRAPH,
+                                     graph->adj_index[graph->v] * sizeof(int),
+                                     PLACE_INTERLEAVE);
+    fill_adjacency(graph);
+}
+
 
 /*
  * Parses a graph struct from a file. Returns 1 on success, 0 on failure
@@ -68,11 +145,18 @@ int parse_graph_from_file(char* filename, Graph* graph) {
             }
 
             // allocate memory for the graphs node and edge lists:
-            graph->nodes = malloc(num_nodes * sizeof(Node*));
+            graph->nodes = tracked_malloc(MEM_GRAPH, num_nodes * sizeof(Node*));
             CHECK_MALLOC_ERR(graph->nodes);
-            graph->edges = malloc(num_edges * sizeof(Edge*));
+            graph->edges = tracked_malloc(MEM_GRAPH, num_edges * sizeof(Edge*));
             CHECK_MALLOC_ERR(graph->edges);
 
+            // the edges themselves are kept together in one array, which
+            // every island reads on each fitness evaluation
+            graph->edge_list = large_alloc("edge list",
+                                           MEM_GRAPH,
+                                           num_edges * sizeof(Edge),
+                                           PLACE_INTERLEAVE);
+
             int edge_cnt = 0;
             int node_cnt = 0;
             int left_num, right_num;
@@ -91,7 +175,7 @@ int parse_graph_from_file(char* filename, Graph* graph) {
                     assert(node_cnt < num_nodes);
 
                     // a new node we haven't seen before:
-                    Node* new_node = malloc(sizeof(Node));
+                    Node* new_node = tracked_malloc(MEM_GRAPH, sizeof(Node));
                     CHECK_MALLOC_ERR(new_node);
                     new_node->id = left_num;
                     new_node->weight = 1;
@@ -109,7 +193,7 @@ int parse_graph_from_file(char* filename, Graph* graph) {
                     assert(node_cnt < num_nodes);
 
                     // a new node we haven't seen before:
-                    Node* new_node = malloc(sizeof(Node));
+                    Node* new_node = tracked_malloc(MEM_GRAPH, sizeof(Node));
                     CHECK_MALLOC_ERR(new_node);
                     new_node->id = right_num;
                     new_node->weight = 1;
@@ -123,8 +207,7 @@ int parse_graph_from_file(char* filename, Graph* graph) {
                 // new edge:
                 assert(edge_cnt < num_edges);
 
-                Edge* new_edge = malloc(sizeof(Edge));
-                CHECK_MALLOC_ERR(new_edge);
+                Edge* new_edge = &(graph->edge_list)[edge_cnt];
 
                 new_edge->n1 = left_num;
                 new_edge->n2 = right_num;
@@ -149,6 +232,9 @@ int parse_graph_from_file(char* filename, Graph* graph) {
     // close file
     fclose(fp);
 
+    build_adjacency(graph);
+    graph->storage = NULL;
+
 
     // print graph
     /*
@@ -170,3 +256,112 @@ int parse_graph_from_file(char* filename, Graph* graph) {
     return 1;
 }
 
+
+/*
+ * Fills in sub with the subgraph of graph induced by the nodes on side side
+ * of partition: those nodes, renumbered from 0 in the order they have in
+ * graph, with their weights, and the edges between them. The node of graph
+ * that each node of sub is is written to node_map, which must have room for
+ * all of them. The subgraph is built straight from graph's lists, without
+ * the graph being read again, and is compact: its nodes, edges and
+ * adjacency index are all in a single block (sub->storage), so the parts of
+ * a partition can be partitioned in turn at little cost.
+ */
+void induced_subgraph(const Graph* graph,
+                      const bitarray_t* partition,
+                      int side,
+                      Graph* sub,
+                      int* node_map) {
+
+    // the node of sub of each node of graph on the side, -1 for the others
+    int* sub_node = tracked_malloc(MEM_IO, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(sub_node);
+
+    sub->v = 0;
+    for (int i=0; i<graph->v; i++) {
+        if (getbit(partition, i) == side) {
+            node_map[sub->v] = i;
+            sub_node[i] = sub->v++;
+        }
+        else {
+            sub_node[i] = -1;
+        }
+    }
+
+    sub->e = 0;
+    int num_adjacent = 0;  // entries of the adjacency index
+    for (int i=0; i<graph->e; i++) {
+        Edge* edge = (graph->edges)[i];
+        if (sub_node[edge->n1] >= 0 && sub_node[edge->n2] >= 0) {
+            sub->e++;
+            if (edge->n1 != edge->n2)
+                num_adjacent += 2;
+        }
+    }
+
+    // pointers first, then the structs and ints, so each is aligned
+    size_t bytes = sub->v * sizeof(Node*) + sub->e * sizeof(Edge*)
+                   + sub->v * sizeof(Node) + sub->e * sizeof(Edge)
+                   + (sub->v + 1 + 2*num_adjacent) * sizeof(int);
+    char* block = tracked_malloc(MEM_GRAPH, bytes);
+    CHECK_MALLOC_ERR(block);
+    sub->storage = block;
+
+    sub->nodes = (Node**)block;
+    block += sub->v * sizeof(Node*);
+    sub->edges = (Edge**)block;
+    block += sub->e * sizeof(Edge*);
+    Node* node_list = (Node*)block;
+    block += sub->v * sizeof(Node);
+    sub->edge_list = (Edge*)block;
+    block += sub->e * sizeof(Edge);
+    sub->adj_index = (int*)block;
+    sub->adj_nodes = sub->adj_index + sub->v + 1;
+    sub->adj_weights = sub->adj_nodes + num_adjacent;
+
+    for (int i=0; i<sub->v; i++) {
+        node_list[i].id = i;
+        node_list[i].weight = (graph->nodes)[node_map[i]]->weight;
+        (sub->nodes)[i] = &node_list[i];
+    }
+
+    int edge_cnt = 0;
+    for (int i=0; i<graph->e; i++) {
+        Edge* edge = (graph->edges)[i];
+        if (sub_node[edge->n1] < 0 || sub_node[edge->n2] < 0)
+            continue;
+
+        Edge* new_edge = &(sub->edge_list)[edge_cnt];
+        new_edge->n1 = sub_node[edge->n1];
+        new_edge->n2 = sub_node[edge->n2];
+        new_edge->weight = edge->weight;
+        (sub->edges)[edge_cnt++] = new_edge;
+    }
+
+    tracked_free(sub_node);
+
+    index_adjacency(sub);
+    fill_adjacency(sub);
+}
+
+
+/*
+ * Frees what parse_graph_from_file() or induced_subgraph() allocated for
+ * graph (but not graph itself)
+ */
+void free_graph(Graph* graph) {
+    if (graph->storage) {
+        tracked_free(graph->storage);
+        return;
+    }
+
+    for (int i=0; i<graph->v; i++) {
+        tracked_free((graph->nodes)[i]);
+    }
+    tracked_free(graph->nodes);
+    tracked_free(graph->edges);
+    large_free(graph->edge_list);
+    large_free(graph->adj_index);
+    large_free(graph->adj_nodes);
+    large_free(graph->adj_weights);
+}
@@ -8,6 +8,7 @@
 #ifndef _GRAPH_PARSER_H_
 #define _GRAPH_PARSER_H_
 
+#include "bitarray.h"
 #include "graph.h"
 
 // filetype macros
@@ -17,7 +18,9 @@
 #define GV    3
 #define GRAPH 4
 
-int parse_graph_from_file(char*, Graph*);
+int  parse_graph_from_file(char*, Graph*);
+void induced_subgraph     (const Graph*, const bitarray_t*, int, Graph*, int*);
+void free_graph           (Graph*);
 
 #endif  /* _GRAPH_PARSER_ */
 
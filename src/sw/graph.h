@@ -25,6 +25,19 @@ typedef struct Graph {
     int e;         // number of edges
     Node** nodes;  // array of pointers to nodes
     Edge** edges;  // array of pointers to edges
+    Edge* edge_list;  // storage of the edges, which edges points into
+
+    // adjacency index (compressed sparse rows): the neighbours of node i are
+    // adj_nodes[adj_index[i]] .. adj_nodes[adj_index[i+1]-1], joined to i by
+    // edges of weight adj_weights[...]. Every edge appears once in the row
+    // of each of its end nodes; self loops are left out.
+    int* adj_index;    // v+1 row offsets
+    int* adj_nodes;    // neighbour ids
+    int* adj_weights;  // weights of the edges to those neighbours
+
+    void* storage;  // of a subgraph (see induced_subgraph()), the one block
+                    // all of the above is in; NULL for a graph read from a
+                    // file
 } Graph;
 
 #endif /* _GRAPH_H_ */
@@ -0,0 +1,165 @@
+/*
+ * job-pool.c
+ *
+ * Jobs run as processes on a pool of cores (see job-pool.h)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L  // sysconf
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <errno.h>   // errno, EINTR
+#include <fcntl.h>   // open, O_WRONLY
+#include <signal.h>  // kill, sigaction, signal
+#include <stdio.h>   // fflush, perror
+#include <stdlib.h>  // exit
+#include <string.h>  // memset, strerror
+#include <unistd.h>  // fork, dup2, setpgid, sysconf, _exit
+
+#include <sys/wait.h>  // waitpid
+
+#include "ga-utils.h"
+#include "job-pool.h"
+#include "mem-track.h"
+
+// set by _handle_stop_signal() once no more jobs are to start
+static volatile sig_atomic_t _stop_signal = 0;
+
+static void _handle_stop_signal(int sig) {
+    _stop_signal = sig;
+    signal(sig, SIG_DFL);
+}
+
+
+/*
+ * Sets up pool for num_jobs jobs, which run calls with arg, on cores cores
+ * (all those online if 0), and catches the stop signals
+ */
+void init_job_pool(JobPool* pool,
+                   int cores,
+                   int num_jobs,
+                   JobFunction run,
+                   void* arg) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    pool->num_cores = cores ? cores : (int)MAX(online, 1L);
+    pool->cores_free = pool->num_cores;
+    pool->num_running = 0;
+    pool->num_jobs = num_jobs;
+    pool->run = run;
+    pool->arg = arg;
+    pool->signalled = 0;
+
+    pool->pids = tracked_malloc(MEM_IO, MAX(num_jobs, 1) * sizeof(pid_t));
+    pool->cores = tracked_malloc(MEM_IO, MAX(num_jobs, 1) * sizeof(int));
+    CHECK_MALLOC_ERR(pool->pids);
+    CHECK_MALLOC_ERR(pool->cores);
+    memset(pool->pids, 0, num_jobs * sizeof(pid_t));
+    memset(pool->cores, 0, num_jobs * sizeof(int));
+
+    struct sigaction stop_action;
+    memset(&stop_action, 0, sizeof(struct sigaction));
+    stop_action.sa_handler = _handle_stop_signal;
+    sigemptyset(&stop_action.sa_mask);
+    sigaction(SIGINT, &stop_action, NULL);
+    sigaction(SIGTERM, &stop_action, NULL);
+}
+
+
+/*
+ * Returns 1 if a job that needs cores cores can start now: the pool has not
+ * been stopped, and the cores are free or nothing else is running
+ */
+int job_fits(const JobPool* pool, int cores) {
+    return !_stop_signal
+           && (cores <= pool->cores_free || pool->num_running == 0);
+}
+
+
+/*
+ * Starts job, which needs cores cores, in a process of its own, which runs
+ * it with its report discarded and exits with the status it returns
+ */
+void start_job(JobPool* pool, int job, int cores) {
+
+    // or what is buffered would be printed by the job's process as well
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+
+        _exit(pool->run(pool->arg, job));
+    }
+    if (pid < 0) {
+        fprintf(stderr, "Cannot start process for a job: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    setpgid(pid, pid);  // as well, whichever of the two is first
+    pool->pids[job] = pid;
+    pool->cores[job] = cores;
+    pool->cores_free -= cores;
+    pool->num_running++;
+}
+
+
+/*
+ * Waits for a job to finish, passing the stop signal on to the jobs running
+ * once it has come, and frees its cores. Returns the job, with *failed set
+ * to 1 if its process did not exit with status 0, or -1 if no job is
+ * running.
+ */
+int wait_job(JobPool* pool, int* failed) {
+
+    while (pool->num_running > 0) {
+        if (_stop_signal && !pool->signalled) {
+            for (int job=0; job<pool->num_jobs; job++) {
+                if (pool->pids[job])
+                    kill(pool->pids[job], _stop_signal);
+            }
+            pool->signalled = 1;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("waitpid");
+            exit(1);
+        }
+
+        for (int job=0; job<pool->num_jobs; job++) {
+            if (pool->pids[job] != pid)
+                continue;
+
+            pool->pids[job] = 0;
+            pool->cores_free += pool->cores[job];
+            pool->num_running--;
+            *failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            return job;
+        }
+    }
+
+    return -1;
+}
+
+
+/* The stop signal that has come, or 0 */
+int jobs_stopped(void) {
+    return _stop_signal;
+}
+
+
+void free_job_pool(JobPool* pool) {
+    tracked_free(pool->pids);
+    tracked_free(pool->cores);
+}
@@ -0,0 +1,51 @@
+/*
+ * job-pool.h
+ *
+ * header file for job-pool.c
+ *
+ * A pool of cores on which jobs run as processes, for sweeps (sweep.c) and
+ * recursive bisection (bisect.c). Each job is forked from the caller, so it
+ * shares the pages of what the caller has built (the graph) and leaves its
+ * results in shared memory, with its report discarded. A job needs a number
+ * of cores, and is started only while they are free, or alone if it needs
+ * more than there are, so the machine is kept busy without being
+ * oversubscribed.
+ *
+ * A job is an int, which the caller's run function maps to its work. SIGINT
+ * and SIGTERM to the caller are passed on to the jobs running, which stop
+ * early, and job_fits() starts no more. Each job is a process group of its
+ * own, so that a signal from the terminal reaches it once, passed on by the
+ * pool, and not twice.
+ *
+ */
+
+#ifndef _JOB_POOL_H_
+#define _JOB_POOL_H_
+
+#include <sys/types.h>  // pid_t
+
+// runs job in the job's process, returning the process's exit status
+typedef int (*JobFunction)(void* arg, int job);
+
+
+typedef struct JobPool {
+    int num_cores;
+    int cores_free;
+    int num_running;
+    int num_jobs;          // jobs are 0 ... num_jobs-1
+    pid_t* pids;           // of each job's process while it runs, else 0
+    int* cores;            // each job needs, while it runs
+    JobFunction run;
+    void* arg;
+    int signalled;         // 1 once the stop signal has been passed on
+} JobPool;
+
+
+void init_job_pool(JobPool*, int, int, JobFunction, void*);
+int  job_fits     (const JobPool*, int);
+void start_job    (JobPool*, int, int);
+int  wait_job     (JobPool*, int*);
+int  jobs_stopped (void);
+void free_job_pool(JobPool*);
+
+#endif /* _JOB_POOL_H_ */
@@ -0,0 +1,413 @@
+/*
+ * large-alloc.c
+ *
+ * Huge page backed, NUMA placed allocation of large arrays, and the reports
+ * of where their pages ended up and how many TLB misses the run took
+ *
+ */
+
+#define _GNU_SOURCE  // MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE, syscall
+
+#include <assert.h>    // assert (in ga-utils.h)
+#include <stdio.h>     // printf, fopen
+#include <stdlib.h>    // exit, posix_memalign
+#include <string.h>    // memset, strncmp
+#include <sys/mman.h>  // mmap, madvise
+
+#ifdef __linux__
+#include <linux/mempolicy.h>   // MPOL_INTERLEAVE
+#include <linux/perf_event.h>  // perf_event_attr
+#include <sys/syscall.h>       // SYS_mbind, SYS_move_pages, ...
+#include <unistd.h>            // syscall, read, close
+#endif
+
+#include "ga-utils.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+
+#define SMALL_PAGE_SIZE 4096UL
+#define HUGE_PAGE_SIZE  (2UL << 20)
+#define MAX_NODES       (8 * (int)sizeof(unsigned long))
+
+// pages looked up per allocation when reporting placement
+#define PLACEMENT_SAMPLES 1024
+
+
+typedef struct LargeAlloc {
+    const char* name;
+    void* addr;
+    int category;   // MEM_ category it is counted in
+    size_t size;    // bytes mapped
+    int huge;       // HUGEPAGES_ mode actually in use
+    int placement;  // PLACE_ policy actually in use
+    int shared;     // 1 if shared with processes forked after it was made
+} LargeAlloc;
+
+static LargeAlloc allocs[MAX_LARGE_ALLOCS];
+static int num_allocs = 0;
+
+static unsigned long node_mask = 0;  // online NUMA nodes, read on first use
+static int num_nodes = 0;
+
+
+/*
+ * Reads the online NUMA nodes from sysfs, a list of ranges such as "0-3,8".
+ * Without it (or NUMA) there is a single node 0.
+ */
+static void _read_online_nodes(void) {
+    FILE* fp;
+    int first, last, sep;
+
+    if (num_nodes)
+        return;
+
+    fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp) {
+        while (fscanf(fp, "%d", &first) == 1) {
+            last = first;
+            sep = fgetc(fp);
+            if (sep == '-') {
+                if (fscanf(fp, "%d", &last) != 1)
+                    break;
+                sep = fgetc(fp);
+            }
+            for (int node=first; node<=last && node<MAX_NODES; node++) {
+                node_mask |= 1UL << node;
+                num_nodes++;
+            }
+            if (sep != ',')
+                break;
+        }
+        fclose(fp);
+    }
+
+    if (!num_nodes) {
+        node_mask = 1;
+        num_nodes = 1;
+    }
+}
+
+
+#ifdef __linux__
+/*
+ * Maps size bytes (a multiple of HUGE_PAGE_SIZE) starting on a huge page
+ * boundary, so that all of it can be backed by transparent huge pages
+ */
+static void* _map_huge_aligned(size_t size, int share) {
+    char* addr = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                      share | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    size_t head = (HUGE_PAGE_SIZE - (unsigned long)addr % HUGE_PAGE_SIZE)
+                  % HUGE_PAGE_SIZE;
+    if (head)
+        munmap(addr, head);
+    munmap(addr + head + size, HUGE_PAGE_SIZE - head);
+
+    return addr + head;
+}
+#endif
+
+
+/*
+ * Does the work of large_alloc and large_alloc_shared: the pages are shared
+ * with processes forked later if shared is set, copied on write otherwise
+ */
+static void* _large_alloc(const char* name,
+                          int category,
+                          size_t size,
+                          int placement,
+                          int shared) {
+    void* addr = NULL;
+    int huge = HUGEPAGES;
+    int share = shared ? MAP_SHARED : MAP_PRIVATE;
+
+    if (num_allocs == MAX_LARGE_ALLOCS) {
+        fprintf(stderr, "More than %d large allocations\n", MAX_LARGE_ALLOCS);
+        exit(1);
+    }
+
+    _read_online_nodes();
+    if (num_nodes == 1)
+        placement = PLACE_LOCAL;
+
+    size = MAX(size, 1);
+
+#ifdef __linux__
+    size_t huge_size = (size + HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+
+    if (huge == HUGEPAGES_EXPLICIT) {
+        addr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                    share | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr == MAP_FAILED)
+            addr = NULL;
+        else
+            size = huge_size;
+        if (!addr)
+            huge = HUGEPAGES_THP;
+    }
+
+    // huge pages only pay off for arrays of at least one huge page
+    if (!addr && huge == HUGEPAGES_THP && size >= HUGE_PAGE_SIZE) {
+        addr = _map_huge_aligned(huge_size, share);
+        if (addr) {
+            size = huge_size;
+            if (madvise(addr, size, MADV_HUGEPAGE) != 0)
+                huge = HUGEPAGES_NONE;
+        }
+    }
+
+    if (!addr) {
+        huge = HUGEPAGES_NONE;
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    share | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            addr = NULL;
+    }
+    CHECK_MALLOC_ERR(addr);
+
+    // no page has been touched yet, so the policy applies to all of them
+    if (placement == PLACE_INTERLEAVE
+        && syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE,
+                   &node_mask, MAX_NODES + 1, 0) != 0)
+        placement = PLACE_LOCAL;
+#else
+    huge = HUGEPAGES_NONE;
+    placement = PLACE_LOCAL;
+    if (shared) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    share | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            addr = NULL;
+    }
+    else if (posix_memalign(&addr, SMALL_PAGE_SIZE, size)) {
+        addr = NULL;
+    }
+    CHECK_MALLOC_ERR(addr);
+#endif
+
+    track_memory(category, size);
+
+    allocs[num_allocs].name = name;
+    allocs[num_allocs].addr = addr;
+    allocs[num_allocs].size = size;
+    allocs[num_allocs].category = category;
+    allocs[num_allocs].huge = huge;
+    allocs[num_allocs].placement = placement;
+    allocs[num_allocs].shared = shared;
+    num_allocs++;
+
+    return addr;
+}
+
+
+/*
+ * Allocates size bytes for an array named name (used in the report), counted
+ * as memory of category (see mem-track.h), backed by huge pages as set by
+ * HUGEPAGES and placed on NUMA nodes according to placement. The memory is
+ * page aligned and not cleared. Falls back to normal pages, and to first
+ * touch placement, where those are not available.
+ */
+void* large_alloc(const char* name, int category, size_t size, int placement) {
+    return _large_alloc(name, category, size, placement, 0);
+}
+
+
+/*
+ * Allocates size bytes like large_alloc (with first touch placement), but
+ * shared with the processes forked after this: whatever any of them writes
+ * to it, all of them see. The memory is cleared.
+ */
+void* large_alloc_shared(const char* name, int category, size_t size) {
+    return _large_alloc(name, category, size, PLACE_LOCAL, 1);
+}
+
+
+/*
+ * Frees memory from large_alloc or large_alloc_shared
+ */
+void large_free(void* ptr) {
+    int i;
+
+    if (!ptr)
+        return;
+
+    for (i=0; i<num_allocs && allocs[i].addr != ptr; i++)
+        ;
+    if (i == num_allocs) {
+        fprintf(stderr, "large_free of memory not from large_alloc\n");
+        exit(1);
+    }
+
+    track_memory(allocs[i].category, -(long)allocs[i].size);
+
+#ifdef __linux__
+    munmap(allocs[i].addr, allocs[i].size);
+#else
+    if (allocs[i].shared)
+        munmap(allocs[i].addr, allocs[i].size);
+    else
+        free(allocs[i].addr);
+#endif
+
+    allocs[i] = allocs[--num_allocs];
+}
+
+
+#ifdef __linux__
+/*
+ * Returns how many kB of the mapping that contains addr are backed by
+ * transparent huge pages, or -1 if /proc does not say
+ */
+static long _anon_huge_kb(const void* addr) {
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    char line[256];
+    unsigned long start, end;
+    int found = 0;
+    long kb = -1;
+
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            if (found)
+                break;
+            found = (start <= (unsigned long)addr && (unsigned long)addr < end);
+        }
+        else if (found && strncmp(line, "AnonHugePages:", 14) == 0) {
+            sscanf(line + 14, "%ld", &kb);
+            break;
+        }
+    }
+
+    fclose(fp);
+    return kb;
+}
+#endif
+
+
+/*
+ * Prints each live large allocation: its size, the pages backing it, and on
+ * which NUMA nodes a sample of its pages lie (untouched pages are not on any)
+ */
+void print_large_allocs(void) {
+
+    _read_online_nodes();
+    printf("Large allocations (%d NUMA node%s online):\n",
+           num_nodes, num_nodes > 1 ? "s" : "");
+
+    for (int i=0; i<num_allocs; i++) {
+        LargeAlloc* a = &allocs[i];
+        char backing[64];
+
+        switch (a->huge) {
+            case HUGEPAGES_EXPLICIT:
+                snprintf(backing, sizeof(backing), "hugetlb");
+                break;
+#ifdef __linux__
+            case HUGEPAGES_THP: {
+                long kb = _anon_huge_kb(a->addr);
+                if (kb < 0)
+                    snprintf(backing, sizeof(backing), "THP");
+                else
+                    snprintf(backing, sizeof(backing), "THP %ld%%",
+                             MIN(kb * 1024 * 100 / (long)a->size, 100L));
+                break;
+            }
+#endif
+            default:
+                snprintf(backing, sizeof(backing), "small pages");
+        }
+
+        printf("\t%-18s %8.2f MB  %-11s %-11s",
+               a->name,
+               (double)a->size / (1 << 20),
+               backing,
+               a->shared ? "shared"
+               : a->placement == PLACE_INTERLEAVE ? "interleaved"
+               : "first touch"
+              );
+
+#ifdef __linux__
+        size_t num_pages = (a->size + SMALL_PAGE_SIZE-1) / SMALL_PAGE_SIZE;
+        int num_samples = MIN(num_pages, (size_t)PLACEMENT_SAMPLES);
+        void* pages[PLACEMENT_SAMPLES];
+        int status[PLACEMENT_SAMPLES];
+        int pages_on[MAX_NODES];
+        int untouched = 0;
+
+        for (int s=0; s<num_samples; s++) {
+            pages[s] = (char*)a->addr
+                       + (num_pages * s / num_samples) * SMALL_PAGE_SIZE;
+        }
+        memset(pages_on, 0, sizeof(pages_on));
+
+        // with no target nodes, move_pages only reports where pages are
+        if (syscall(SYS_move_pages, 0, num_samples, pages, NULL, status, 0)
+            == 0) {
+            printf("  sampled pages on node");
+            for (int s=0; s<num_samples; s++) {
+                if (status[s] >= 0 && status[s] < MAX_NODES)
+                    pages_on[status[s]]++;
+                else
+                    untouched++;
+            }
+            for (int node=0; node<MAX_NODES; node++) {
+                if (node_mask & (1UL << node))
+                    printf(" %d: %d", node, pages_on[node]);
+            }
+            if (untouched)
+                printf(", untouched: %d", untouched);
+        }
+#endif
+        printf("\n");
+    }
+}
+
+
+/*
+ * Starts counting data TLB load misses of this process (and threads it
+ * starts from now on) in user space. Returns a handle for stop_tlb_counter,
+ * or -1 if the counter is not available.
+ */
+int start_tlb_counter(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+
+/*
+ * Returns the number of TLB misses counted since start_tlb_counter, or -1 if
+ * they were not counted
+ */
+long long stop_tlb_counter(int fd) {
+    long long count = -1;
+
+    if (fd < 0)
+        return -1;
+
+#ifdef __linux__
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        count = -1;
+    close(fd);
+#endif
+
+    return count;
+}
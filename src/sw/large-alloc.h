@@ -0,0 +1,45 @@
+/*
+ * large-alloc.h
+ *
+ * header file for large-alloc.c
+ *
+ * Allocation of the big long-lived arrays (the graph's edge list and
+ * adjacency index, the genome pool arena) straight from the kernel, so they
+ * can be backed by huge pages and placed on particular NUMA nodes without
+ * libnuma. On systems other than Linux these fall back to aligned malloc.
+ * Those from large_alloc_shared are shared with the processes forked after
+ * them, which is how island processes see each other's progress and
+ * migrants.
+ *
+ */
+
+#ifndef _LARGE_ALLOC_H_
+#define _LARGE_ALLOC_H_
+
+#include <stddef.h>  // size_t
+
+// huge page modes
+#define HUGEPAGES_NONE     0  // normal pages
+#define HUGEPAGES_THP      1  // ask for transparent huge pages (madvise)
+#define HUGEPAGES_EXPLICIT 2  // reserved hugetlbfs pages (MAP_HUGETLB) if
+                              // there are enough free, otherwise as THP
+
+#define HUGEPAGES HUGEPAGES_THP
+
+// page placement
+#define PLACE_LOCAL      0  // first touch: each page goes on the node of the
+                            // thread that first writes it
+#define PLACE_INTERLEAVE 1  // pages spread round robin over all online nodes,
+                            // for read-mostly data every thread uses
+
+#define MAX_LARGE_ALLOCS 64  // live large allocations tracked for reporting
+
+
+void* large_alloc(const char* name, int category, size_t size, int placement);
+void* large_alloc_shared(const char* name, int category, size_t size);
+void  large_free(void* ptr);
+void  print_large_allocs(void);
+int   start_tlb_counter(void);
+long long stop_tlb_counter(int fd);
+
+#endif /* _LARGE_ALLOC_H_ */
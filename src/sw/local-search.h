@@ -0,0 +1,467 @@
+/*
+ * local-search.h
+ *
+ * Local search operators used to refine individuals produced by the genetic
+ * operators in GAA-sw.c. These work on the graph's adjacency index, so moving
+ * a node costs O(degree) rather than a full fitness evaluation.
+ *
+ * LS_ELITE reduces the diversity of the islands, and is off by default.
+ *
+ */
+
+#ifndef _LOCAL_SEARCH_H_
+#define _LOCAL_SEARCH_H_
+
+#include <stdlib.h>  // malloc, abs
+
+#include "bitarray.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "graph.h"
+#include "mem-track.h"
+
+
+/*
+ * Working memory for local search on one graph. Every node not yet moved in
+ * the current pass sits in the gain bucket of its side: a doubly linked list
+ * (through next/prev) of all nodes whose cut gain is the bucket's index minus
+ * max_gain. top[] tracks the highest bucket of each side that may be
+ * non-empty.
+ */
+typedef struct LocalSearch {
+    int num_nodes;
+    int max_gain;       // largest weighted degree: gains lie in
+                        // [-max_gain, max_gain]
+    int total_weight;   // sum of all node weights
+    int unit_weights;   // 1 if every node has weight 1
+    int* node_weight;   // weight of each node, copied out of graph->nodes
+    int* gain;          // decrease in cut weight if the node is moved
+    int* next;          // next node in the same bucket, or -1
+    int* prev;          // previous node in the same bucket, or -1
+    int* buckets[2];    // head of each bucket (2*max_gain+1) for each side
+    int top[2];         // index of highest possibly non-empty bucket per side
+    char* locked;       // 1 if the node has been moved in this pass
+    int* moves;         // nodes in the order they were moved in this pass
+} LocalSearch;
+
+
+/*
+ * Allocates the working memory for local search on graph
+ */
+static inline void init_local_search(Graph* graph, LocalSearch* ls) {
+
+    ls->num_nodes = graph->v;
+    ls->max_gain = 0;
+    ls->total_weight = 0;
+    ls->unit_weights = 1;
+
+    ls->node_weight = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(ls->node_weight);
+
+    for (int i=0; i<graph->v; i++) {
+        int degree = 0;
+        for (int j=graph->adj_index[i]; j<graph->adj_index[i+1]; j++) {
+            degree += abs(graph->adj_weights[j]);
+        }
+        ls->max_gain = MAX(ls->max_gain, degree);
+
+        ls->node_weight[i] = (graph->nodes)[i]->weight;
+        ls->total_weight += ls->node_weight[i];
+        if (ls->node_weight[i] != 1)
+            ls->unit_weights = 0;
+    }
+
+    ls->gain = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(ls->gain);
+    ls->next = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(ls->next);
+    ls->prev = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(ls->prev);
+    ls->locked = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(char));
+    CHECK_MALLOC_ERR(ls->locked);
+    ls->moves = tracked_malloc(MEM_SCRATCH, graph->v * sizeof(int));
+    CHECK_MALLOC_ERR(ls->moves);
+
+    for (int side=0; side<2; side++) {
+        ls->buckets[side] = tracked_malloc(MEM_SCRATCH,
+                                           (2*ls->max_gain + 1) * sizeof(int));
+        CHECK_MALLOC_ERR(ls->buckets[side]);
+    }
+}
+
+
+static inline void free_local_search(LocalSearch* ls) {
+    tracked_free(ls->node_weight);
+    tracked_free(ls->gain);
+    tracked_free(ls->next);
+    tracked_free(ls->prev);
+    tracked_free(ls->locked);
+    tracked_free(ls->moves);
+    tracked_free(ls->buckets[0]);
+    tracked_free(ls->buckets[1]);
+}
+
+
+static inline void _bucket_insert(LocalSearch* ls, int side, int node) {
+    int b = ls->gain[node] + ls->max_gain;
+
+    ls->prev[node] = -1;
+    ls->next[node] = ls->buckets[side][b];
+    if (ls->next[node] != -1)
+        ls->prev[ls->next[node]] = node;
+    ls->buckets[side][b] = node;
+
+    if (b > ls->top[side])
+        ls->top[side] = b;
+}
+
+
+static inline void _bucket_remove(LocalSearch* ls, int side, int node) {
+    if (ls->prev[node] != -1)
+        ls->next[ls->prev[node]] = ls->next[node];
+    else
+        ls->buckets[side][ls->gain[node] + ls->max_gain] = ls->next[node];
+
+    if (ls->next[node] != -1)
+        ls->prev[ls->next[node]] = ls->prev[node];
+}
+
+
+/* Returns the unlocked node with the highest gain on a side, or -1 */
+static inline int _bucket_max(LocalSearch* ls, int side) {
+    while (ls->top[side] >= 0 && ls->buckets[side][ls->top[side]] == -1)
+        ls->top[side]--;
+
+    return (ls->top[side] >= 0) ? ls->buckets[side][ls->top[side]] : -1;
+}
+
+
+/*
+ * Computes the gain of every node of partition and fills the buckets. Returns
+ * the weight of the cut edges and sets *imbalance to
+ * (weight of partition 1) - (weight of partition 0).
+ */
+static inline int _init_gains(Graph* graph,
+                              LocalSearch* ls,
+                              bitarray_t* partition,
+                              int* imbalance) {
+    int cut = 0;
+
+    *imbalance = 0;
+
+    for (int side=0; side<2; side++) {
+        for (int b=0; b<2*ls->max_gain+1; b++) {
+            ls->buckets[side][b] = -1;
+        }
+        ls->top[side] = -1;
+    }
+
+    for (int i=0; i<graph->v; i++) {
+        int side = getbit(partition, i);
+        int gain = 0;
+
+        for (int j=graph->adj_index[i]; j<graph->adj_index[i+1]; j++) {
+            if (getbit(partition, graph->adj_nodes[j]) != side) {
+                gain += graph->adj_weights[j];
+                cut += graph->adj_weights[j];
+            }
+            else {
+                gain -= graph->adj_weights[j];
+            }
+        }
+
+        ls->gain[i] = gain;
+        ls->locked[i] = 0;
+        _bucket_insert(ls, side, i);
+
+        *imbalance += side ? ls->node_weight[i] : -ls->node_weight[i];
+    }
+
+    // every cut edge was counted from both ends
+    return cut/2;
+}
+
+
+/*
+ * Moves a node to the other side of partition, locks it, and updates the
+ * gains of its unlocked neighbours. Returns the decrease in cut weight.
+ */
+static inline int _move_node(Graph* graph,
+                             LocalSearch* ls,
+                             bitarray_t* partition,
+                             int node) {
+    int side = getbit(partition, node);
+    int gain = ls->gain[node];
+
+    _bucket_remove(ls, side, node);
+    ls->locked[node] = 1;
+    ls->gain[node] = -gain;
+    putbit(partition, node, !side);
+
+    for (int j=graph->adj_index[node]; j<graph->adj_index[node+1]; j++) {
+        int nbr = graph->adj_nodes[j];
+        int nbr_side;
+
+        if (ls->locked[nbr])
+            continue;
+
+        // an edge to a node on the old side is now cut, so moving that
+        // neighbour gains more; an edge to the other side is now uncut
+        nbr_side = getbit(partition, nbr);
+        _bucket_remove(ls, nbr_side, nbr);
+        if (nbr_side == side)
+            ls->gain[nbr] += 2*graph->adj_weights[j];
+        else
+            ls->gain[nbr] -= 2*graph->adj_weights[j];
+        _bucket_insert(ls, nbr_side, nbr);
+    }
+
+    return gain;
+}
+
+
+/*
+ * Fiduccia-Mattheyses Refinement: makes up to FM_MAX_MOVES single node moves,
+ * each time moving the unlocked node that most reduces the fitness of the
+ * individual (cut weight plus the imbalance penalty of calc_fitness). Moves
+ * that would leave the partitions more than FM_MAX_IMBALANCE (as a fraction
+ * of the total node weight) apart are only allowed if they reduce the
+ * imbalance. Moves that make the fitness worse are allowed too, so the pass
+ * can climb out of local minima; once it ends, every move after the best
+ * fitness seen is undone. The pass also ends after FM_MAX_UNIMPROVING_MOVES
+ * moves in a row without a new best.
+ *
+ * The refined partition is written back to the individual and its fitness is
+ * set; no separate call to calc_fitness is needed. Returns the number of
+ * moves kept.
+ */
+static inline int fm_refinement(Graph* graph, 
+                                LocalSearch* ls, 
+                                Individual* idv) {
+
+    int imbalance;
+    int cut = _init_gains(graph, ls, idv->partition, &imbalance);
+    int max_imbalance = MAX(1, (int)(FM_MAX_IMBALANCE * ls->total_weight));
+
+    int fitness = cut + abs(imbalance);
+    int best_fitness = fitness;
+    int num_moves = 0;
+    int best_moves = 0;
+
+    while (num_moves < FM_MAX_MOVES
+           && num_moves - best_moves < FM_MAX_UNIMPROVING_MOVES) {
+
+        int best_node = -1;
+        int best_delta = 0;
+        int best_imbalance = 0;
+
+        // the best candidate on each side is the top of its gain buckets
+        for (int side=0; side<2; side++) {
+            int node = _bucket_max(ls, side);
+            if (node == -1)
+                continue;
+
+            int new_imbalance = imbalance 
+                                + (side ? -2 : 2)*ls->node_weight[node];
+            if (abs(new_imbalance) > max_imbalance
+                && abs(new_imbalance) >= abs(imbalance))
+                continue;
+
+            int delta = ls->gain[node] + abs(imbalance) - abs(new_imbalance);
+            if (best_node == -1 || delta > best_delta) {
+                best_node = node;
+                best_delta = delta;
+                best_imbalance = new_imbalance;
+            }
+        }
+
+        if (best_node == -1)
+            break;
+
+        cut -= _move_node(graph, ls, idv->partition, best_node);
+        imbalance = best_imbalance;
+        ls->moves[num_moves++] = best_node;
+
+        fitness = cut + abs(imbalance);
+        if (fitness < best_fitness) {
+            best_fitness = fitness;
+            best_moves = num_moves;
+        }
+    }
+
+    // roll back to the best prefix of moves
+    for (int i=num_moves-1; i>=best_moves; i--) {
+        int node = ls->moves[i];
+        putbit(idv->partition, node, !getbit(idv->partition, node));
+    }
+
+    idv->fitness = best_fitness;
+
+    return best_moves;
+}
+
+/*
+ * Returns (weight of partition 1) - (weight of partition 0). With unit node
+ * weights this is just a popcount of the partition.
+ */
+static inline int partition_imbalance(LocalSearch* ls, bitarray_t* partition) {
+    int weight1 = 0;
+
+    if (ls->unit_weights) {
+        for (int i=0; i<RESERVE_BITS(ls->num_nodes); i++) {
+            weight1 += hamming_distance(partition[i], 0);
+        }
+    }
+    else {
+        for (int i=0; i<ls->num_nodes; i++) {
+            if (getbit(partition, i))
+                weight1 += ls->node_weight[i];
+        }
+    }
+
+    return 2*weight1 - ls->total_weight;
+}
+
+
+/*
+ * Fills the buckets of heavy_side with the nodes on that side of partition
+ * that have a neighbour on the other side (the boundary nodes), each with its
+ * gain, and marks every other node on that side as locked. Returns the
+ * weight of the cut edges, which each have one end on heavy_side, so only
+ * that side's adjacency lists are read.
+ */
+static inline int _init_repair_gains(Graph* graph,
+                                     LocalSearch* ls,
+                                     bitarray_t* partition,
+                                     int heavy_side) {
+    int cut = 0;
+
+    for (int b=0; b<2*ls->max_gain+1; b++) {
+        ls->buckets[heavy_side][b] = -1;
+    }
+    ls->top[heavy_side] = -1;
+
+    for (int w=0; w<RESERVE_BITS(graph->v); w++) {
+        bitarray_t nodes = heavy_side ? partition[w] : ~partition[w];
+
+        if (w == RESERVE_BITS(graph->v) - 1 && BIT_INDEX(graph->v))
+            nodes &= ((bitarray_t)1 << BIT_INDEX(graph->v)) - 1;
+
+        while (nodes) {
+            int i = (w << 5) + __builtin_ctz(nodes);
+            int external = 0;
+            int internal = 0;
+
+            nodes &= nodes - 1;
+            for (int j=graph->adj_index[i]; j<graph->adj_index[i+1]; j++) {
+                if (getbit(partition, graph->adj_nodes[j]) != heavy_side)
+                    external += graph->adj_weights[j];
+                else
+                    internal += graph->adj_weights[j];
+            }
+
+            cut += external;
+            ls->locked[i] = (external == 0);
+            if (external) {
+                ls->gain[i] = external - internal;
+                _bucket_insert(ls, heavy_side, i);
+            }
+        }
+    }
+
+    return cut;
+}
+
+
+/*
+ * Moves a boundary node off heavy_side for balance_repair and updates the
+ * gains of its neighbours on heavy_side: each edge to one of them is now cut,
+ * and a neighbour that was not on the boundary joins it. Returns the
+ * decrease in cut weight.
+ */
+static inline int _repair_move(Graph* graph,
+                               LocalSearch* ls,
+                               bitarray_t* partition,
+                               int heavy_side,
+                               int node) {
+    int gain = ls->gain[node];
+
+    _bucket_remove(ls, heavy_side, node);
+    ls->locked[node] = 1;
+    putbit(partition, node, !heavy_side);
+
+    for (int j=graph->adj_index[node]; j<graph->adj_index[node+1]; j++) {
+        int nbr = graph->adj_nodes[j];
+
+        if (getbit(partition, nbr) != heavy_side)
+            continue;
+
+        if (ls->locked[nbr]) {
+            // every edge of an interior node was uncut until now
+            int weighted_degree = 0;
+            for (int k=graph->adj_index[nbr]; k<graph->adj_index[nbr+1]; k++) {
+                weighted_degree += graph->adj_weights[k];
+            }
+            ls->locked[nbr] = 0;
+            ls->gain[nbr] = 2*graph->adj_weights[j] - weighted_degree;
+        }
+        else {
+            _bucket_remove(ls, heavy_side, nbr);
+            ls->gain[nbr] += 2*graph->adj_weights[j];
+        }
+        _bucket_insert(ls, heavy_side, nbr);
+    }
+
+    return gain;
+}
+
+
+/*
+ * Balance Repair: if the weights of an individual's two partitions differ by
+ * more than BALANCE_TOLERANCE (as a fraction of the total node weight), moves
+ * nodes from the heavier side to the lighter one until they do not, always
+ * choosing the boundary node whose move increases the cut the least. A move
+ * that would not reduce the imbalance (a node heavier than the imbalance
+ * itself) ends the repair, as does one that leaves the other side the
+ * heavier.
+ *
+ * The imbalance is checked first by a popcount (for unit weights), and an
+ * individual that is already balanced is left untouched and 0 is returned.
+ * Otherwise one pass over the heavy side's nodes finds the cut and the gains
+ * of its boundary nodes, which stands in for the child's evaluation; each
+ * move then updates only its neighbours' gains and the cut. The individual's
+ * fitness is set and 1 is returned.
+ */
+static inline int balance_repair(Graph* graph, 
+                                 LocalSearch* ls, 
+                                 Individual* idv) {
+
+    int tolerance = MAX(1, (int)(BALANCE_TOLERANCE * ls->total_weight));
+    int imbalance = partition_imbalance(ls, idv->partition);
+
+    if (abs(imbalance) <= tolerance)
+        return 0;
+
+    int heavy_side = (imbalance > 0);
+    int cut = _init_repair_gains(graph, ls, idv->partition, heavy_side);
+
+    while (abs(imbalance) > tolerance && (imbalance > 0) == heavy_side) {
+        int node = _bucket_max(ls, heavy_side);
+        if (node == -1)
+            break;
+
+        int new_imbalance = imbalance 
+                            + (heavy_side ? -2 : 2)*ls->node_weight[node];
+        if (abs(new_imbalance) >= abs(imbalance))
+            break;
+
+        cut -= _repair_move(graph, ls, idv->partition, heavy_side, node);
+        imbalance = new_imbalance;
+    }
+
+    idv->fitness = cut + abs(imbalance);
+
+    return 1;
+}
+
+#endif /* _LOCAL_SEARCH_H_ */
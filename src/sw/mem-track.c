@@ -0,0 +1,160 @@
+/*
+ * mem-track.c
+ *
+ * Memory accounting: allocations made through tracked_malloc (or reported
+ * with track_memory) are counted against their category, and the process
+ * exits with a clear message as soon as the total would pass the limit set
+ * with set_memory_limit. The counters are updated atomically, so the islands'
+ * threads can allocate at the same time.
+ *
+ */
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <stdio.h>   // fprintf
+#include <stdlib.h>  // malloc, free, exit
+
+#include "ga-utils.h"
+#include "mem-track.h"
+
+
+// each tracked block starts with a header giving its size and category,
+// padded to keep the block as aligned as malloc's
+typedef union BlockHeader {
+    struct {
+        size_t size;
+        int category;
+    } info;
+    long double align;
+} BlockHeader;
+
+static const char* const category_names[NUM_MEM_CATEGORIES] = {
+    "graph", "population", "scratch", "I/O"
+};
+
+static MemStats mem_stats[NUM_MEM_CATEGORIES];
+static MemStats mem_total;
+static long memory_limit = 0;  // bytes, 0 for no limit
+
+
+/*
+ * Sets the largest total number of bytes that may be allocated at once, or 0
+ * for no limit
+ */
+void set_memory_limit(long bytes) {
+    memory_limit = bytes;
+}
+
+
+/* Raises *peak to value if it is lower */
+static void _raise_peak(long* peak, long value) {
+    long old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (old < value
+           && !__atomic_compare_exchange_n(peak, &old, value, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+
+/*
+ * Accounts for bytes (negative when freed) of memory in category. An
+ * allocation that would take the total over the memory limit ends the
+ * program.
+ */
+void track_memory(int category, long bytes) {
+    MemStats* stats = &mem_stats[category];
+    long total = __atomic_add_fetch(&mem_total.bytes, bytes, __ATOMIC_RELAXED);
+
+    if (bytes > 0 && memory_limit && total > memory_limit) {
+        // the allocation is not made, so the report leaves it out
+        __atomic_sub_fetch(&mem_total.bytes, bytes, __ATOMIC_RELAXED);
+        fflush(stdout);
+        fprintf(stderr,
+                "Memory limit exceeded: %.2f MB more %s memory would bring "
+                "the total to %.2f MB, over the limit of %.2f MB\n",
+                (double)bytes / (1 << 20),
+                category_names[category],
+                (double)total / (1 << 20),
+                (double)memory_limit / (1 << 20));
+        print_memory_stats(stderr);
+        exit(1);
+    }
+
+    _raise_peak(&mem_total.peak_bytes, total);
+    _raise_peak(&stats->peak_bytes,
+                __atomic_add_fetch(&stats->bytes, bytes, __ATOMIC_RELAXED));
+
+    if (bytes > 0) {
+        __atomic_add_fetch(&stats->num_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->bytes_allocated, bytes, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mem_total.num_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mem_total.bytes_allocated, bytes,
+                           __ATOMIC_RELAXED);
+    }
+}
+
+
+/*
+ * malloc, counting the memory against category. Returns NULL if malloc
+ * fails, like malloc.
+ */
+void* tracked_malloc(int category, size_t size) {
+    BlockHeader* header;
+
+    track_memory(category, size);
+
+    header = malloc(sizeof(BlockHeader) + size);
+    if (!header) {
+        track_memory(category, -(long)size);
+        return NULL;
+    }
+
+    header->info.size = size;
+    header->info.category = category;
+
+    return header + 1;
+}
+
+
+/*
+ * Frees memory from tracked_malloc
+ */
+void tracked_free(void* ptr) {
+    BlockHeader* header;
+
+    if (!ptr)
+        return;
+
+    header = (BlockHeader*)ptr - 1;
+    track_memory(header->info.category, -(long)header->info.size);
+    free(header);
+}
+
+
+/* Sets *total to the statistics of all categories together */
+void get_memory_totals(MemStats* total) {
+    *total = mem_total;
+}
+
+
+/*
+ * Prints the current and peak memory of each category and how many
+ * allocations have been made
+ */
+void print_memory_stats(FILE* fp) {
+    fprintf(fp, "\tCategory      Current (MB)  Peak (MB)  Allocations\n");
+    for (int cat=0; cat<NUM_MEM_CATEGORIES; cat++) {
+        fprintf(fp, "\t%-12s  %12.2f  %9.2f  %11ld\n",
+                category_names[cat],
+                (double)mem_stats[cat].bytes / (1 << 20),
+                (double)mem_stats[cat].peak_bytes / (1 << 20),
+                mem_stats[cat].num_allocs
+               );
+    }
+    fprintf(fp, "\t%-12s  %12.2f  %9.2f  %11ld\n",
+            "total",
+            (double)mem_total.bytes / (1 << 20),
+            (double)mem_total.peak_bytes / (1 << 20),
+            mem_total.num_allocs
+           );
+}
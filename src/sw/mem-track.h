@@ -0,0 +1,41 @@
+/*
+ * mem-track.h
+ *
+ * header file for mem-track.c
+ *
+ * Accounting of the memory the GA allocates, by what it is used for, with an
+ * optional limit on the total
+ *
+ */
+
+#ifndef _MEM_TRACK_H_
+#define _MEM_TRACK_H_
+
+#include <stddef.h>  // size_t
+#include <stdio.h>   // FILE
+
+// what allocations are used for
+#define MEM_GRAPH      0  // the graph and its adjacency index
+#define MEM_POPULATION 1  // partitions and the structures holding them
+#define MEM_SCRATCH    2  // working memory of the genetic operators, local
+                          // search and sorts
+#define MEM_IO         3  // buffers for reading the graph and reporting
+#define NUM_MEM_CATEGORIES 4
+
+
+typedef struct MemStats {
+    long bytes;            // currently allocated
+    long peak_bytes;
+    long num_allocs;       // allocations so far
+    long bytes_allocated;  // total size of those allocations
+} MemStats;
+
+
+void* tracked_malloc(int category, size_t size);
+void  tracked_free(void* ptr);
+void  track_memory(int category, long bytes);
+void  set_memory_limit(long bytes);
+void  get_memory_totals(MemStats* total);
+void  print_memory_stats(FILE* fp);
+
+#endif /* _MEM_TRACK_H_ */
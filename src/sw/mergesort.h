@@ -5,118 +5,160 @@
 #ifndef _MERGESORT_H_
 #define _MERGESORT_H_
 
-#define INSERTION_SORT_THRESHOLD 7  // max number of individuals to insertion
-                                    // sort instead of mergesort
+#include <assert.h>  // assert
 
 #include "ga-params.h"
 #include "ga-utils.h"
 
 
-static inline void _merge_idv(int* arr, int l, int m, int r, Individual* pop) {
-    
-    int i, j, k;
-    int n1, n2;
-    int *left, *right;
-
-    n1 = m-l+1;
-    n2 = r-m;
-
-    // temp arrays:
-    left = malloc(n1 * sizeof(int));
-    CHECK_MALLOC_ERR(left);
-    right = malloc(n2 * sizeof(int));
-    CHECK_MALLOC_ERR(right);
-
-    // copy data into temp arrays
-    for (i=0; i<n1; i++) {
-        left[i] = arr[l + i];
-    }
-    for (j=0; j<n2; j++) {
-        right[j] = arr[m + 1 + j];
-    }
-
-    // merge temp arrays back into main arrays
-    i = 0;
-    j = 0;
-    k = l;
-    while (i < n1 && j < n2) {
-        if (pop[left[i]].fitness <= pop[right[j]].fitness) {
-            arr[k] = left[i];
-            i++;
-        }
-        else {
-            arr[k] = right[j];
-            j++;
+/*
+ * Finds the k most fit and k least fit individuals of pop (of size n) in a
+ * single pass, without sorting and without allocating: each candidate is
+ * insertion-sorted into one of two buffers of length k, which is cheap since
+ * k is small (NUM_TO_MIGRATE). On return best[0..k-1] holds indices from most
+ * fit to less fit and worst[0..k-1] from least fit to more fit, with ties
+ * broken the same way as a stable sort (earlier index ranks as more fit), so
+ * best[i] and worst[i] match arr[i] and arr[n-1-i] of a sorted index array.
+ */
+static inline void select_best_worst_idv(Individual* pop,
+                                         int n,
+                                         int k,
+                                         int* best,
+                                         int* worst) {
+
+    int num_best = 0;
+    int num_worst = 0;
+
+    assert(k <= n/2);
+
+    for (int i=0; i<n; i++) {
+        int fitness = pop[i].fitness;
+        int j;
+
+        // insert into best buffer if fitter than its current last entry
+        if (num_best < k || fitness < pop[best[num_best-1]].fitness) {
+            j = (num_best < k) ? num_best++ : k-1;
+            while (j > 0 && pop[best[j-1]].fitness > fitness) {
+                best[j] = best[j-1];
+                j--;
+            }
+            best[j] = i;
         }
-        k++;
-    }
-
-    // copy anything remaining in left array
-    while (i < n1) {
-        arr[k] = left[i];
-        i++;
-        k++;
-    }
 
-    // copy anything remaining in right array
-    while (j < n2) {
-        arr[k] = right[j];
-        j++;
-        k++;
+        // insert into worst buffer if no fitter than its current last entry
+        if (num_worst < k || fitness >= pop[worst[num_worst-1]].fitness) {
+            j = (num_worst < k) ? num_worst++ : k-1;
+            while (j > 0 && pop[worst[j-1]].fitness <= fitness) {
+                worst[j] = worst[j-1];
+                j--;
+            }
+            worst[j] = i;
+        }
     }
-
-    // free temp arrays
-    free(left);
-    free(right);
 }
 
 
 /*
- * Sort an array of integers according to their corresponding fitness values
- * using insertion sort.
+ * Sort an array of n integers according to the corresponding fitnesses of the
+ * passed array of Individuals using an LSD radix sort on the (non-negative)
+ * integer fitness, one byte per pass. The sort is stable (most fit first,
+ * ties in their order in arr), runs in O(n) and allocates nothing: scratch
+ * must point to space for n integers. Passes over bytes that are 
+ * zero for every key are skipped.
  */
-static inline void insertionsort_idv(int* arr, int l, int r, Individual* pop) {
+static inline void radixsort_idv(int* arr, 
+                                 int n, 
+                                 Individual* pop, 
+                                 int* scratch) {
+
+    unsigned max_key = 0;
+    int* src = arr;
+    int* dst = scratch;
+
+    for (int i=0; i<n; i++) {
+        assert(pop[arr[i]].fitness >= 0);
+        if ((unsigned)pop[arr[i]].fitness > max_key)
+            max_key = pop[arr[i]].fitness;
+    }
 
-    int i, j, temp;
-    double key;
+    for (int shift=0; shift<32 && (max_key >> shift); shift+=8) {
+        int count[257] = {0};
 
-    for (i=l+1; i<r; i++) {
-        temp = arr[i];
-        key = pop[arr[i]].fitness;
-        j = i-1;
+        for (int i=0; i<n; i++) {
+            count[((pop[src[i]].fitness >> shift) & 0xFF) + 1]++;
+        }
+        for (int b=0; b<256; b++) {
+            count[b+1] += count[b];
+        }
+        for (int i=0; i<n; i++) {
+            dst[count[(pop[src[i]].fitness >> shift) & 0xFF]++] = src[i];
+        }
 
-        while (j >= l && pop[arr[j]].fitness  > key) {
-            arr[j+1] = arr[j];
-            j--;
+        int* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != arr) {
+        for (int i=0; i<n; i++) {
+            arr[i] = src[i];
         }
-        arr[j+1] = temp;
     }
 }
 
 
-/* 
- * Sort an array of integers according to the corresponding fitnesses of the
- * passed array of Individuals. Result is an array of indexes from most fit
- * (lowest fitness value) to least fit (highest fitness value) individual.
+/*
+ * Partially sort an array of n integers according to the corresponding 
+ * fitnesses of the passed array of Individuals, so that arr[0..k-1] holds the
+ * k most fit individuals from most to least fit. The rest of the array is 
+ * left in no particular order. A quickselect (median of three pivot) puts 
+ * the k most fit first in O(n), then only those k are sorted, by
+ * radixsort_idv with scratch, space for k integers, so nothing is allocated.
+ * Unlike radixsort_idv this is not stable.
  */
-static inline void mergesort_idv(int* arr, int l, int r, Individual* pop) {
-
-    int mid;
-    
-    if (l < r) {
-        if ((r - l + 1) <= INSERTION_SORT_THRESHOLD) {
-            insertionsort_idv(arr, l, r+1, pop);
-            return;
+static inline void partialsort_idv(int* arr, 
+                                   int n, 
+                                   int k, 
+                                   Individual* pop, 
+                                   int* scratch) {
+
+    int l = 0;
+    int r = n-1;
+
+    if (k <= 0)
+        return;
+
+    while (l < r) {
+        int mid = l + (r-l)/2;
+        int a = pop[arr[l]].fitness;
+        int b = pop[arr[mid]].fitness;
+        int c = pop[arr[r]].fitness;
+        int pivot = MAX(MIN(a, b), MIN(MAX(a, b), c));
+        int i = l;
+        int j = r;
+
+        while (i <= j) {
+            while (pop[arr[i]].fitness < pivot)
+                i++;
+            while (pop[arr[j]].fitness > pivot)
+                j--;
+            if (i <= j) {
+                int tmp = arr[i];
+                arr[i++] = arr[j];
+                arr[j--] = tmp;
+            }
         }
-        mid = (l+r)/2;  // not overflow safe (TODO)
 
-        // recursively sort
-        mergesort_idv(arr, l, mid, pop);
-        mergesort_idv(arr, mid+1, r, pop);
-
-        // merge
-        _merge_idv(arr, l, mid, r, pop);
+        // [l..j] are no less fit than the pivot, [i..r] no more fit
+        if (k-1 <= j)
+            r = j;
+        else if (k-1 >= i)
+            l = i;
+        else
+            break;
     }
+
+    radixsort_idv(arr, k, pop, scratch);
 }
 
 #endif /* _MERGESORT_H_ */
@@ -0,0 +1,157 @@
+/*
+ * migrant-ring.h
+ *
+ * Single-producer/single-consumer ring buffers that carry migrants (a
+ * partition, its fitness, and when it was sent) from one island's thread to
+ * another's. There is one ring for each route of the migration topology, so
+ * every ring has exactly one sender and one receiver and needs no lock: the
+ * sender only writes the tail, the receiver only writes the head, and each
+ * publishes its index with a release store once the slot it covers has been
+ * written or read. All slots are in memory given to the ring up front, so
+ * sending a migrant is a copy into a slot and nothing is allocated while the
+ * GA runs. When the rings and their slots are in shared memory, the islands
+ * may as well be processes: the atomics work the same across them.
+ *
+ */
+
+#ifndef _MIGRANT_RING_H_
+#define _MIGRANT_RING_H_
+
+#include <stddef.h>  // size_t
+
+#include "bitarray.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+
+
+/*
+ * What travels with a migrant's partition
+ */
+typedef struct MigrantStamp {
+    int fitness;
+    int gen;       // generations its island had completed when it was sent
+    long version;  // version of its island's elites it was one of
+} MigrantStamp;
+
+
+typedef struct MigrantRing {
+    int from;              // island that sends on this ring (-1 for the
+                           // main thread, in a cluster)
+    int to;                // island that receives (likewise)
+    int capacity;          // number of slots, a power of 2
+    int stride;            // words from one slot's partition to the next
+    bitarray_t* genomes;   // partition of each slot
+    MigrantStamp* stamps;  // the rest of each slot
+    long num_dropped;      // migrants not sent because the ring was full
+                           // (written by the sender only)
+
+    // the indices only ever increase; slot i is i & (capacity-1). Each is on
+    // a cache line of its own, so the sender and receiver do not contend for
+    // one line each time either moves.
+    char pad0[CACHE_LINE];
+    unsigned long head;    // next slot to receive, written by the receiver
+    char pad1[CACHE_LINE];
+    unsigned long tail;    // next slot to send, written by the sender
+    char pad2[CACHE_LINE];
+} MigrantRing;
+
+
+/* Number of slots of a ring of at least min_capacity */
+static inline int migrant_ring_capacity(int min_capacity) {
+    int capacity = 1;
+
+    while (capacity < min_capacity)
+        capacity *= 2;
+    return capacity;
+}
+
+
+/*
+ * Bytes of memory the slots of a ring of at least min_capacity slots for
+ * partitions of num_nodes nodes take, a whole number of CACHE_LINEs
+ */
+static inline size_t migrant_ring_bytes(int min_capacity, int num_nodes) {
+    size_t capacity = migrant_ring_capacity(min_capacity);
+    size_t bytes = capacity * GENOME_STRIDE(num_nodes) * sizeof(bitarray_t)
+                   + capacity * sizeof(MigrantStamp);
+
+    return (bytes + CACHE_LINE-1) & ~(size_t)(CACHE_LINE-1);
+}
+
+
+/*
+ * Initializes a ring from island from to island to, of at least
+ * min_capacity slots for partitions of num_nodes nodes, which are kept in
+ * slots: migrant_ring_bytes() of memory aligned to GENOME_ALIGN, which the
+ * caller owns
+ */
+static inline void init_migrant_ring(MigrantRing* ring,
+                                     int from,
+                                     int to,
+                                     int min_capacity,
+                                     int num_nodes,
+                                     void* slots) {
+    ring->from = from;
+    ring->to = to;
+    ring->capacity = migrant_ring_capacity(min_capacity);
+    ring->stride = GENOME_STRIDE(num_nodes);
+
+    ring->genomes = slots;
+    ring->stamps = (MigrantStamp*)(ring->genomes
+                                   + (size_t)ring->capacity * ring->stride);
+
+    ring->num_dropped = 0;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+
+/*
+ * Sender: returns the partition of the next free slot, to be written and
+ * then sent with ring_send, or NULL if the ring is full
+ */
+static inline bitarray_t* ring_send_slot(MigrantRing* ring) {
+    unsigned long tail = ring->tail;  // only the sender writes it
+
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+        == (unsigned long)ring->capacity)
+        return NULL;
+
+    return ring->genomes
+           + (size_t)(tail & (ring->capacity-1)) * ring->stride;
+}
+
+
+/* Sender: sends the slot from ring_send_slot, whose partition is written */
+static inline void ring_send(MigrantRing* ring, const MigrantStamp* stamp) {
+    unsigned long tail = ring->tail;
+
+    ring->stamps[tail & (ring->capacity-1)] = *stamp;
+    __atomic_store_n(&ring->tail, tail+1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Receiver: returns the partition of the oldest migrant in the ring, and
+ * sets *stamp to the rest of it, or returns NULL if the ring is empty. The
+ * slot stays the receiver's until ring_receive is called.
+ */
+static inline const bitarray_t* ring_receive_slot(MigrantRing* ring,
+                                                  MigrantStamp* stamp) {
+    unsigned long head = ring->head;  // only the receiver writes it
+
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    *stamp = ring->stamps[head & (ring->capacity-1)];
+    return ring->genomes
+           + (size_t)(head & (ring->capacity-1)) * ring->stride;
+}
+
+
+/* Receiver: hands the slot from ring_receive_slot back to the sender */
+static inline void ring_receive(MigrantRing* ring) {
+    __atomic_store_n(&ring->head, ring->head+1, __ATOMIC_RELEASE);
+}
+
+#endif /* _MIGRANT_RING_H_ */
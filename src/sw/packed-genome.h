@@ -0,0 +1,180 @@
+/*
+ * packed-genome.h
+ *
+ * Compact storage of partitions for COMPACT_STORAGE mode. A partition is kept
+ * either whole, or as a sparse XOR delta against a base partition: just the
+ * words in which the two differ. The members of a converged island differ
+ * from a reference partition in few words, so they take little space.
+ *
+ */
+
+#ifndef _PACKED_GENOME_H_
+#define _PACKED_GENOME_H_
+
+#include <stdlib.h>  // malloc
+
+#include "bitarray.h"
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "mem-track.h"
+
+
+typedef struct PackedGenome {
+    int refcount;               // individuals sharing this genome, plus
+                                // genomes stored as deltas against it
+    struct PackedGenome* base;  // genome this is a delta against, or NULL if
+                                // words holds the whole partition
+    int num_stored;             // number of words stored
+    bitarray_t* words;          // stored words (of a delta: XOR with base)
+    int* idxs;                  // index of each stored word of a delta, in
+                                // ascending order
+} PackedGenome;
+
+
+/*
+ * Size of every partition and the memory taken by all packed genomes
+ */
+typedef struct PackedStore {
+    int num_words;     // words in a whole partition (RESERVE_BITS)
+    long bytes;        // bytes currently allocated for packed genomes
+    long peak_bytes;
+} PackedStore;
+
+
+static inline void init_packed_store(PackedStore* store, int num_nodes) {
+    store->num_words = RESERVE_BITS(num_nodes);
+    store->bytes = 0;
+    store->peak_bytes = 0;
+}
+
+
+static inline long _packed_size(const PackedGenome* g) {
+    return sizeof(PackedGenome) + g->num_stored*sizeof(bitarray_t)
+           + (g->base ? g->num_stored*sizeof(int) : 0);
+}
+
+
+/*
+ * Packs a partition, as a delta against base if that is smaller than storing
+ * it whole. base must itself be stored whole, or NULL. The new genome has a
+ * reference count of 1.
+ */
+static inline PackedGenome* pack_genome(PackedStore* store,
+                                        const bitarray_t* partition,
+                                        PackedGenome* base) {
+    int num_diff = 0;
+
+    if (base) {
+        for (int k=0; k<store->num_words; k++) {
+            num_diff += (partition[k] != base->words[k]);
+        }
+        // a stored word of a delta also costs its index
+        if (2*num_diff >= store->num_words)
+            base = NULL;
+    }
+
+    int num_stored = base ? num_diff : store->num_words;
+    PackedGenome* g = tracked_malloc(MEM_POPULATION,
+                                     sizeof(PackedGenome)
+                                     + num_stored*sizeof(bitarray_t)
+                                     + (base ? num_stored*sizeof(int) : 0));
+    CHECK_MALLOC_ERR(g);
+
+    g->refcount = 1;
+    g->base = base;
+    g->num_stored = num_stored;
+    g->words = (bitarray_t*)(g + 1);
+    g->idxs = base ? (int*)(g->words + num_stored) : NULL;
+
+    if (base) {
+        base->refcount++;
+        int n = 0;
+        for (int k=0; k<store->num_words; k++) {
+            if (partition[k] != base->words[k]) {
+                g->words[n] = partition[k] ^ base->words[k];
+                g->idxs[n++] = k;
+            }
+        }
+    }
+    else {
+        for (int k=0; k<store->num_words; k++) {
+            g->words[k] = partition[k];
+        }
+    }
+
+    store->bytes += _packed_size(g);
+    store->peak_bytes = MAX(store->peak_bytes, store->bytes);
+
+    return g;
+}
+
+
+/* Writes the whole partition of a packed genome to partition */
+static inline void unpack_genome(PackedStore* store,
+                                 const PackedGenome* g,
+                                 bitarray_t* partition) {
+    if (!g->base) {
+        for (int k=0; k<store->num_words; k++) {
+            partition[k] = g->words[k];
+        }
+        return;
+    }
+
+    for (int k=0; k<store->num_words; k++) {
+        partition[k] = g->base->words[k];
+    }
+    for (int n=0; n<g->num_stored; n++) {
+        partition[g->idxs[n]] ^= g->words[n];
+    }
+}
+
+
+/* Adds a reference to a packed genome and returns it */
+static inline PackedGenome* packed_share(PackedGenome* g) {
+    g->refcount++;
+    return g;
+}
+
+
+/* Drops a reference to a packed genome, freeing it once nothing refers to it */
+static inline void packed_release(PackedStore* store, PackedGenome* g) {
+    if (--g->refcount > 0)
+        return;
+
+    if (g->base)
+        packed_release(store, g->base);
+    store->bytes -= _packed_size(g);
+    tracked_free(g);
+}
+
+
+/*
+ * Reads the words of a packed genome one at a time, in order, without
+ * unpacking it
+ */
+typedef struct PackedReader {
+    const PackedGenome* g;
+    int next;  // next stored word of a delta
+} PackedReader;
+
+
+static inline void init_packed_reader(PackedReader* r, const PackedGenome* g) {
+    r->g = g;
+    r->next = 0;
+}
+
+
+/* Returns word k; k must be one more than on the previous call (from 0) */
+static inline bitarray_t packed_read_word(PackedReader* r, int k) {
+    const PackedGenome* g = r->g;
+
+    if (!g->base)
+        return g->words[k];
+
+    if (r->next < g->num_stored && g->idxs[r->next] == k)
+        return g->base->words[k] ^ g->words[r->next++];
+
+    return g->base->words[k];
+}
+
+#endif /* _PACKED_GENOME_H_ */
@@ -0,0 +1,242 @@
+/*
+ * pipeline.h
+ *
+ * Pipelined generations (PIPELINE_EVALUATORS). An island's children go
+ * through three stages in batches of pairs: the island's thread selects the
+ * parents and makes the children by crossover and mutation (variation), an
+ * evaluation thread evaluates them, repairing and refining them as set
+ * (evaluation), and the island's thread settles them into the island, whose
+ * population they replace once the generation is complete (replacement).
+ * The island makes the next batch while the last is being evaluated, and
+ * one evaluation thread serves several islands, so it is kept busy by
+ * whichever has work.
+ *
+ * The stages are connected by a StageRing of batch slots, which pass through
+ * the stages in order. Each stage advances an index of its own, and only
+ * reads the index of the stage before it (with an acquire load, the writer
+ * storing with release once it is done with the slot), so the ring is two
+ * bounded single-producer/single-consumer queues that share their slots and
+ * need no lock. The island cannot make a batch while every slot is in use,
+ * which holds it back (back-pressure) when evaluation is the slower stage.
+ *
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "GAA-sw.h"
+#include "ga-utils.h"
+#include "mem-track.h"
+
+
+typedef struct ChildBatch {
+    int num_pairs;
+    Individual* children;  // the batch's 2*num_pairs children, among those
+                           // of the island's generation
+    ChildPair* made;       // what variation left for each pair
+    bitarray_t* rows;      // with COMPACT_STORAGE, the rows the children are
+                           // made in, until they are packed
+    GAStats stats;         // of the evaluation, for the island to add up
+} ChildBatch;
+
+
+typedef struct StageRing {
+    int capacity;          // number of slots, a power of 2
+    ChildBatch* batches;
+
+    // the indices only ever increase; slot i is i & (capacity-1). The
+    // evaluator's is on a cache line of its own.
+    char pad0[CACHE_LINE];
+    unsigned long made;       // batches made, written by the island
+    unsigned long settled;    // batches settled, likewise
+
+    // statistics of the island's thread
+    int batch_pairs;       // pairs in the batches it makes now
+    long num_batches;
+    long total_depth;      // sum of the batches waiting for evaluation just
+                           // after each was made
+    int max_depth;
+    long num_full_stalls;  // waits for a free slot to make a batch in
+    double full_stall_time;
+    long num_drain_stalls; // waits for children to be evaluated with no
+                           // more to make
+    double drain_stall_time;
+
+    char pad1[CACHE_LINE];
+    unsigned long evaluated;  // batches evaluated, written by the evaluator
+    char pad2[CACHE_LINE];
+} StageRing;
+
+
+/*
+ * An evaluation thread, which evaluates the batches of islands index,
+ * index + num_evaluators, ...
+ */
+typedef struct PipelineEvaluator {
+    int index;
+    int num_evaluators;
+    IslandWorker* workers;
+    TaskContext scratch;
+    pthread_t thread;
+    int stop;              // set by the main thread once the islands stop
+    long num_batches;
+    double busy_time;      // seconds spent evaluating
+    double wall_time;      // seconds from its start to its end
+} PipelineEvaluator;
+
+
+/* Number of slots of a ring of at least depth slots */
+static inline int stage_ring_capacity(int depth) {
+    int capacity = 1;
+    while (capacity < depth)
+        capacity <<= 1;
+
+    return capacity;
+}
+
+
+/*
+ * Sets up a ring of at least depth slots, each with room for max_pairs
+ * pairs. With COMPACT_STORAGE, rows are 2*max_pairs rows of stride words for
+ * each slot, stage_ring_capacity(depth) slots in all; otherwise rows is
+ * NULL, as the children are made in rows of the island's genome pool.
+ */
+static inline void init_stage_ring(StageRing* ring,
+                                   int depth,
+                                   int max_pairs,
+                                   bitarray_t* rows,
+                                   int stride) {
+    ring->capacity = stage_ring_capacity(depth);
+
+    ring->batches = tracked_malloc(MEM_SCRATCH,
+                                   ring->capacity * sizeof(ChildBatch));
+    CHECK_MALLOC_ERR(ring->batches);
+    for (int i=0; i<ring->capacity; i++) {
+        ring->batches[i].num_pairs = 0;
+        ring->batches[i].rows = rows
+                                ? rows + (size_t)i * 2*max_pairs * stride
+                                : NULL;
+        ring->batches[i].made = tracked_malloc(MEM_SCRATCH,
+                                               max_pairs * sizeof(ChildPair));
+        CHECK_MALLOC_ERR(ring->batches[i].made);
+    }
+
+    ring->batch_pairs = max_pairs;
+    ring->num_batches = 0;
+    ring->total_depth = 0;
+    ring->max_depth = 0;
+    ring->num_full_stalls = 0;
+    ring->full_stall_time = 0;
+    ring->num_drain_stalls = 0;
+    ring->drain_stall_time = 0;
+    ring->made = 0;
+    ring->settled = 0;
+    ring->evaluated = 0;
+}
+
+
+static inline void free_stage_ring(StageRing* ring) {
+    for (int i=0; i<ring->capacity; i++) {
+        tracked_free(ring->batches[i].made);
+    }
+    tracked_free(ring->batches);
+}
+
+
+/*
+ * Variation (the island): the slot to make the next batch in, or NULL if
+ * every slot is still in use
+ */
+static inline ChildBatch* batch_to_make(StageRing* ring) {
+    if (ring->made - ring->settled == (unsigned long)ring->capacity)
+        return NULL;
+
+    return &ring->batches[ring->made & (ring->capacity-1)];
+}
+
+
+/* Passes the batch made in the slot batch_to_make() gave on to evaluation */
+static inline void batch_made(StageRing* ring) {
+    int depth = ring->made + 1
+                - __atomic_load_n(&ring->evaluated, __ATOMIC_RELAXED);
+
+    ring->num_batches++;
+    ring->total_depth += depth;
+    ring->max_depth = MAX(ring->max_depth, depth);
+
+    __atomic_store_n(&ring->made, ring->made + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Evaluation: the next batch to evaluate, or NULL if there is none yet */
+static inline ChildBatch* batch_to_evaluate(StageRing* ring) {
+    unsigned long evaluated = ring->evaluated;
+
+    if (evaluated == __atomic_load_n(&ring->made, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return &ring->batches[evaluated & (ring->capacity-1)];
+}
+
+
+/* Passes the batch batch_to_evaluate() gave on to replacement */
+static inline void batch_evaluated(StageRing* ring) {
+    __atomic_store_n(&ring->evaluated, ring->evaluated + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Replacement (the island): the next batch to settle, or NULL if it has not
+ * been evaluated yet
+ */
+static inline ChildBatch* batch_to_settle(StageRing* ring) {
+    if (ring->settled == __atomic_load_n(&ring->evaluated, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return &ring->batches[ring->settled & (ring->capacity-1)];
+}
+
+
+/* Frees the slot of the batch batch_to_settle() gave for another */
+static inline void batch_settled(StageRing* ring) {
+    ring->settled++;
+}
+
+
+/*
+ * Prints the queue depths and stalls of the islands' pipelines, and how
+ * busy the evaluators were
+ */
+static inline void print_pipeline_stats(const IslandWorker* workers,
+                                        const PipelineEvaluator* evaluators,
+                                        int num_evaluators) {
+    printf("Pipeline (%d evaluation threads):\n", num_evaluators);
+    printf("\tIsland  Batch  Avg depth  Max depth        Full stalls"
+           "       Drain stalls\n");
+    for (int isl=0; isl<NUM_ISLANDS; isl++) {
+        const StageRing* ring = workers[isl].stages;
+        printf("\t%6d  %5d  %9.2f  %9d  %7ld (%6.2fs)  %7ld (%6.2fs)\n",
+               isl,
+               ring->batch_pairs,
+               ring->num_batches
+               ? (double)ring->total_depth / ring->num_batches
+               : 0,
+               ring->max_depth,
+               ring->num_full_stalls,
+               ring->full_stall_time,
+               ring->num_drain_stalls,
+               ring->drain_stall_time
+              );
+    }
+    printf("\tEvaluator     Busy    Batches\n");
+    for (int i=0; i<num_evaluators; i++) {
+        const PipelineEvaluator* e = &evaluators[i];
+        printf("\t%9d  %6.1f%%  %9ld\n",
+               i,
+               e->wall_time > 0 ? 100 * e->busy_time / e->wall_time : 0,
+               e->num_batches
+              );
+    }
+}
+
+#endif /* _PIPELINE_H_ */
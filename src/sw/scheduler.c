@@ -0,0 +1,235 @@
+/*
+ * scheduler.c
+ *
+ * Work-stealing scheduler (see scheduler.h)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L  // nanosleep (in ga-utils.h)
+
+#include <assert.h>   // assert (in ga-utils.h)
+#include <pthread.h>  // pthread_create, pthread_join
+#include <stdio.h>    // printf
+#include <stdlib.h>   // malloc
+#include <string.h>   // strerror
+
+#include "mem-track.h"
+#include "scheduler.h"
+
+
+
+/*
+ * The owner's end of a deque. The slot is written before bottom is
+ * published with a release store, so a thief that sees the new bottom sees
+ * the task.
+ */
+static void _push(TaskDeque* d, int task) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+    if (b - t > d->mask) {
+        fprintf(stderr, "Task deque of %ld tasks overflowed\n", d->mask + 1);
+        exit(1);
+    }
+
+    __atomic_store_n(&d->tasks[b & d->mask], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Takes the newest task of the owner's deque. bottom is lowered before top
+ * is read (both sequentially consistent), so a thief either sees the lower
+ * bottom or has already moved top; for the last task, the owner and the
+ * thieves race to move top with a CAS. Returns 1 if *task was taken.
+ */
+static int _pop(TaskDeque* d, int* task) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+
+    if (t > b) {
+        // empty
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    *task = __atomic_load_n(&d->tasks[b & d->mask], __ATOMIC_RELAXED);
+    if (t < b)
+        return 1;
+
+    int won = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+
+/*
+ * Takes the oldest task of another worker's deque. Returns 1 if *task was
+ * taken, 0 if the deque was empty or another worker took the task first.
+ */
+static int _steal(TaskDeque* d, int* task) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+
+    if (t >= b)
+        return 0;
+
+    *task = __atomic_load_n(&d->tasks[t & d->mask], __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+
+static void _run(SchedulerWorker* sw, int task) {
+    Scheduler* s = sw->scheduler;
+    double start = wall_seconds();
+
+    s->run(s->arg, task, sw->index);
+    sw->stats.busy_time += wall_seconds() - start;
+    sw->stats.num_tasks++;
+
+    __atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+}
+
+
+/*
+ * Thread of a worker: runs the tasks of its own deque, steals when that is
+ * empty, and stops once no task is pending anywhere
+ */
+static void* _work(void* arg) {
+    SchedulerWorker* sw = arg;
+    Scheduler* s = sw->scheduler;
+    double start = wall_seconds();
+    int idle_rounds = 0;
+    int task;
+
+    while (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) > 0) {
+
+        if (_pop(&sw->deque, &task)) {
+            _run(sw, task);
+            idle_rounds = 0;
+            continue;
+        }
+
+        // try every other worker once, starting from a random one
+        int stolen = 0;
+        int first = xorshift_int(&sw->rng, s->num_workers);
+        for (int i=0; i<s->num_workers && !stolen; i++) {
+            int victim = (first + i) % s->num_workers;
+            if (victim != sw->index)
+                stolen = _steal(&s->workers[victim].deque, &task);
+        }
+
+        if (stolen) {
+            sw->stats.num_steals++;
+            _run(sw, task);
+            idle_rounds = 0;
+            continue;
+        }
+
+        sw->stats.num_failed_steals++;
+        idle_backoff(++idle_rounds);
+    }
+
+    sw->stats.wall_time = wall_seconds() - start;
+    return NULL;
+}
+
+
+/*
+ * Sets up a scheduler of num_workers workers, whose deques each have room
+ * for at least capacity tasks, that runs each task by calling run(arg, task,
+ * worker)
+ */
+void init_scheduler(Scheduler* s,
+                    int num_workers,
+                    int capacity,
+                    TaskFunction run,
+                    void* arg) {
+    long slots = 1;
+    while (slots < capacity)
+        slots <<= 1;
+
+    s->num_workers = num_workers;
+    s->run = run;
+    s->arg = arg;
+    s->pending = 0;
+    s->workers = tracked_malloc(MEM_SCRATCH,
+                                num_workers * sizeof(SchedulerWorker));
+    CHECK_MALLOC_ERR(s->workers);
+
+    for (int i=0; i<num_workers; i++) {
+        SchedulerWorker* sw = &s->workers[i];
+
+        sw->scheduler = s;
+        sw->index = i;
+        sw->rng = (uint32_t)rand() | 1;  // xorshift state must be non-zero
+        sw->deque.tasks = tracked_malloc(MEM_SCRATCH, slots * sizeof(int));
+        CHECK_MALLOC_ERR(sw->deque.tasks);
+        sw->deque.mask = slots - 1;
+        sw->deque.top = 0;
+        sw->deque.bottom = 0;
+        memset(&sw->stats, 0, sizeof(WorkerStats));
+    }
+}
+
+
+/*
+ * Adds task to the deque of worker, which must be the worker calling this,
+ * or (before start_scheduler) any worker
+ */
+void spawn_task(Scheduler* s, int worker, int task) {
+    __atomic_add_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+    _push(&s->workers[worker].deque, task);
+}
+
+
+/* Starts the workers, which run until no task is left */
+void start_scheduler(Scheduler* s) {
+    for (int i=0; i<s->num_workers; i++) {
+        int err = pthread_create(&s->workers[i].thread,
+                                 NULL,
+                                 _work,
+                                 &s->workers[i]
+                                );
+        if (err) {
+            fprintf(stderr, "Cannot start worker thread %d: %s\n",
+                    i, strerror(err));
+            exit(1);
+        }
+    }
+}
+
+
+/* Waits for the workers to stop */
+void wait_scheduler(Scheduler* s) {
+    for (int i=0; i<s->num_workers; i++) {
+        pthread_join(s->workers[i].thread, NULL);
+    }
+}
+
+
+void free_scheduler(Scheduler* s) {
+    for (int i=0; i<s->num_workers; i++) {
+        tracked_free(s->workers[i].deque.tasks);
+    }
+    tracked_free(s->workers);
+}
+
+
+void print_scheduler_stats(const Scheduler* s) {
+    printf("Work stealing (%d workers):\n", s->num_workers);
+    printf("\tWorker      Busy      Tasks     Stolen  Failed steals\n");
+    for (int i=0; i<s->num_workers; i++) {
+        const WorkerStats* ws = &s->workers[i].stats;
+        printf("\t%6d  %7.1f%%  %9ld  %9ld  %13ld\n",
+               i,
+               ws->wall_time > 0 ? 100 * ws->busy_time / ws->wall_time : 0,
+               ws->num_tasks,
+               ws->num_steals,
+               ws->num_failed_steals
+              );
+    }
+}
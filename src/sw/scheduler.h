@@ -0,0 +1,79 @@
+/*
+ * scheduler.h
+ *
+ * header file for scheduler.c
+ *
+ * A work-stealing scheduler for tasks of uneven cost. Each worker thread has
+ * a deque of tasks: it pushes the tasks it spawns onto the bottom of its own
+ * deque and pops from there (newest first, while their data is still in its
+ * cache), and when its deque is empty it steals the oldest task from the top
+ * of another worker's. The deques are Chase-Lev deques in a fixed array, so
+ * only a steal, or a pop racing one for the last task, needs a CAS.
+ *
+ * A task is an int, which the caller's run function maps to its work. Tasks
+ * may spawn more tasks; the workers stop once no task is left anywhere.
+ *
+ */
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <pthread.h>  // pthread_t
+
+#include "ga-utils.h"
+
+// runs task on worker (the index of the worker thread running it)
+typedef void (*TaskFunction)(void* arg, int task, int worker);
+
+
+typedef struct TaskDeque {
+    int* tasks;            // capacity slots; task i is at i & mask
+    long mask;             // capacity-1, capacity a power of 2
+
+    // top is taken from by thieves, bottom pushed to and popped from by the
+    // owner; each is on a cache line of its own
+    char pad0[CACHE_LINE];
+    long top;
+    char pad1[CACHE_LINE];
+    long bottom;
+    char pad2[CACHE_LINE];
+} TaskDeque;
+
+
+typedef struct WorkerStats {
+    long num_tasks;        // tasks run
+    long num_steals;       // ... of which were stolen from other workers
+    long num_failed_steals;  // attempts that found nothing to take
+    double busy_time;      // seconds spent running tasks
+    double wall_time;      // seconds from the start of the worker to its end
+} WorkerStats;
+
+
+typedef struct SchedulerWorker {
+    struct Scheduler* scheduler;
+    int index;
+    pthread_t thread;
+    uint32_t rng;          // picks the workers to steal from
+    TaskDeque deque;
+    WorkerStats stats;
+} SchedulerWorker;
+
+
+typedef struct Scheduler {
+    int num_workers;
+    SchedulerWorker* workers;
+    TaskFunction run;
+    void* arg;
+    long pending __attribute__((aligned(CACHE_LINE)));  // tasks spawned and
+                                                        // not yet finished
+} Scheduler;
+
+
+void init_scheduler       (Scheduler*, int, int, TaskFunction, void*);
+void spawn_task           (Scheduler*, int, int);
+void start_scheduler      (Scheduler*);
+void wait_scheduler       (Scheduler*);
+void free_scheduler       (Scheduler*);
+void print_scheduler_stats(const Scheduler*);
+
+#endif /* _SCHEDULER_H_ */
@@ -8,7 +8,10 @@
 #ifndef _SELECTION_H_
 #define _SELECTION_H_
 
+#include <stdint.h>  // uint32_t
+
 #include "ga-params.h"
+#include "ga-utils.h"
 
 
 /*
@@ -51,18 +54,18 @@ static inline void roulette_wheel_selection(Individual* pop,
  * (where k is a parameter, for example 0.75), the fitter of the two 
  * individuals is selected to be a parent; otherwise the less fit individual 
  * is selected. The two are then returned to the original population and can 
- * be selected again.
+ * be selected again. rng is the xorshift state of the caller's island.
  */
-static inline int tournament_selection(Individual* pop) {
+static inline int tournament_selection(Individual* pop, uint32_t* rng) {
     
-    int parent1_idx = urandint(POP_SIZE);
+    int parent1_idx = xorshift_int(rng, POP_SIZE);
     int parent2_idx = -1;
     do {
-        parent2_idx = urandint(POP_SIZE);
+        parent2_idx = xorshift_int(rng, POP_SIZE);
     } while (parent2_idx == parent1_idx);  // ensures the parents are diffent
                                            // individuals
                                            
-    double r = (double)rand()/RAND_MAX;
+    double r = xorshift_uniform(rng);
     if (r < TOURNAMENT_SELECT_PROB) {
         // select fitter individual (individual with lower fitness score)
         if (pop[parent1_idx].fitness < pop[parent2_idx].fitness)
@@ -79,5 +82,38 @@ static inline int tournament_selection(Individual* pop) {
     }
 }
 
+/*
+ * Worst Replacement: returns the index of the least fit individual (the one
+ * with the highest fitness score) in the population
+ */
+static inline int worst_replacement(Individual* pop) {
+
+    int worst_idx = 0;
+    for (int i=1; i<POP_SIZE; i++) {
+        if (pop[i].fitness >= pop[worst_idx].fitness)
+            worst_idx = i;
+    }
+
+    return worst_idx;
+}
+
+/*
+ * Tournament Replacement: two different individuals are chosen at random 
+ * from the population and the index of the less fit of the two is returned
+ */
+static inline int tournament_replacement(Individual* pop, uint32_t* rng) {
+
+    int idx1 = xorshift_int(rng, POP_SIZE);
+    int idx2 = -1;
+    do {
+        idx2 = xorshift_int(rng, POP_SIZE);
+    } while (idx2 == idx1);
+
+    if (pop[idx1].fitness > pop[idx2].fitness)
+        return idx1;
+    else
+        return idx2;
+}
+
 #endif /* _SELECTION_H_ */
 
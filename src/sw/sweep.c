@@ -0,0 +1,391 @@
+/*
+ * sweep.c
+ *
+ * Runs of the GA for every configuration and seed of a sweep, as processes
+ * on a pool of cores (see sweep.h)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L  // strtok_r
+
+#include <assert.h>  // assert (in ga-utils.h)
+#include <stdio.h>   // printf, fopen, fgets
+#include <string.h>  // memcpy, strchr, strcspn, strtok_r
+
+#include "ga-params.h"
+#include "ga-utils.h"
+#include "job-pool.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+#include "sweep.h"
+
+
+// what the runs' processes are started from
+typedef struct Sweep {
+    Graph* graph;
+    SweepRun* runs;
+    const SweepConfig* configs;
+} Sweep;
+
+
+/*
+ * Applies the settings of a configuration to ga_params. Returns 1 on
+ * success, 0 (after printing why) on failure.
+ */
+static int _apply_settings(const char* settings) {
+    char buf[SWEEP_MAX_LINE];
+    char* save;
+    const char* blanks = " \t";
+
+    if (strlen(settings) >= sizeof(buf)) {
+        fprintf(stderr, "configuration longer than %d characters\n",
+                SWEEP_MAX_LINE);
+        return 0;
+    }
+    strcpy(buf, settings);
+
+    for (char* setting = strtok_r(buf, blanks, &save);
+         setting;
+         setting = strtok_r(NULL, blanks, &save)) {
+        char* equals = strchr(setting, '=');
+
+        *equals = '\0';
+        if (strncmp(setting, "sweep_", 6) == 0
+            || strncmp(setting, "sweep-", 6) == 0) {
+            fprintf(stderr, "%s cannot be set for a run of a sweep\n",
+                    setting);
+            return 0;
+        }
+        if (!set_ga_param(setting, equals + 1))
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Adds the configuration settings to *configs, of which there are
+ * *num_configs in room for *capacity, after checking that the parameters
+ * they make are valid. Returns 1 on success, 0 (after printing why) on
+ * failure.
+ */
+static int _add_config(SweepConfig** configs,
+                       int* num_configs,
+                       int* capacity,
+                       const char* settings,
+                       const char* filename,
+                       int line_no) {
+    GAParams saved = ga_params;
+    int valid = _apply_settings(settings) && check_ga_params();
+    int cores = ga_threads();
+
+    ga_params = saved;
+    if (!valid) {
+        fprintf(stderr, "%s:%d: invalid configuration '%s'\n",
+                filename, line_no, settings);
+        return 0;
+    }
+
+    if (*num_configs == *capacity) {
+        int new_capacity = MAX(2 * *capacity, 16);
+        SweepConfig* grown = tracked_malloc(MEM_IO,
+                                            new_capacity * sizeof(SweepConfig));
+        CHECK_MALLOC_ERR(grown);
+        if (*configs) {
+            memcpy(grown, *configs, *num_configs * sizeof(SweepConfig));
+            tracked_free(*configs);
+        }
+        *configs = grown;
+        *capacity = new_capacity;
+    }
+
+    SweepConfig* config = &(*configs)[(*num_configs)++];
+    config->settings = tracked_malloc(MEM_IO, strlen(settings) + 1);
+    CHECK_MALLOC_ERR(config->settings);
+    strcpy(config->settings, settings);
+    config->cores = cores;
+
+    return 1;
+}
+
+
+/*
+ * Reads the configurations of a sweep file, expanding the lists of values
+ * of each line into every combination of them. Returns the configurations,
+ * *num_configs of them, or NULL (after printing why) on failure.
+ */
+static SweepConfig* _read_sweep_file(const char* filename, int* num_configs) {
+    FILE* fp;
+    char line[SWEEP_MAX_LINE];
+    int line_no = 0;
+    const char* blanks = " \t\r\n";
+    SweepConfig* configs = NULL;
+    int capacity = 0;
+
+    *num_configs = 0;
+
+    fp = fopen(filename, "r");
+    if (NULL == fp) {
+        perror(filename);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char* settings[SWEEP_MAX_SETTINGS];
+        int num_values[SWEEP_MAX_SETTINGS];
+        int value_idx[SWEEP_MAX_SETTINGS];
+        int num_settings = 0;
+        char* save;
+
+        line_no++;
+
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        for (char* setting = strtok_r(line, blanks, &save);
+             setting;
+             setting = strtok_r(NULL, blanks, &save)) {
+            char* equals = strchr(setting, '=');
+
+            if (!equals || equals == setting || equals[1] == '\0') {
+                fprintf(stderr, "%s:%d: expected name=value[,value...], "
+                                "not '%s'\n",
+                        filename, line_no, setting);
+                fclose(fp);
+                return NULL;
+            }
+            if (num_settings == SWEEP_MAX_SETTINGS) {
+                fprintf(stderr, "%s:%d: more than %d settings\n",
+                        filename, line_no, SWEEP_MAX_SETTINGS);
+                fclose(fp);
+                return NULL;
+            }
+
+            settings[num_settings] = setting;
+            num_values[num_settings] = 1;
+            for (char* c=equals+1; *c; c++) {
+                if (*c == ',')
+                    num_values[num_settings]++;
+            }
+            value_idx[num_settings] = 0;
+            num_settings++;
+        }
+        if (num_settings == 0)
+            continue;
+
+        // every combination of the values, the last setting's varying
+        // fastest
+        for (;;) {
+            char config[SWEEP_MAX_LINE];
+            size_t len = 0;
+
+            for (int i=0; i<num_settings; i++) {
+                char* value = strchr(settings[i], '=') + 1;
+                for (int k=0; k<value_idx[i]; k++) {
+                    value = strchr(value, ',') + 1;
+                }
+                size_t value_len = strcspn(value, ",");
+
+                len += snprintf(config + len, sizeof(config) - len,
+                                "%s%.*s=%.*s",
+                                i ? " " : "",
+                                (int)(strchr(settings[i], '=') - settings[i]),
+                                settings[i],
+                                (int)value_len,
+                                value);
+                assert(len < sizeof(config));
+            }
+
+            if (!_add_config(&configs, num_configs, &capacity,
+                             config, filename, line_no)) {
+                fclose(fp);
+                return NULL;
+            }
+
+            int i = num_settings - 1;
+            while (i >= 0 && ++value_idx[i] == num_values[i]) {
+                value_idx[i--] = 0;
+            }
+            if (i < 0)
+                break;
+        }
+    }
+
+    fclose(fp);
+
+    if (*num_configs == 0) {
+        fprintf(stderr, "%s: no configurations\n", filename);
+        return NULL;
+    }
+
+    return configs;
+}
+
+
+/*
+ * Runs the GA, in the process of run r of sweep, with the settings of its
+ * configuration and its seed, and leaves its result in the run (which is in
+ * shared memory). Returns the process's exit status.
+ */
+static int _run(void* arg, int r) {
+    Sweep* sweep = arg;
+    SweepRun* run = &sweep->runs[r];
+
+    if (!_apply_settings(sweep->configs[run->config].settings))
+        return 1;
+    ga_params.seed = run->seed;
+    set_memory_limit((long)(MAX_MEMORY * (1 << 20)));
+
+    run_ga(sweep->graph, &run->result, NULL);
+    return 0;
+}
+
+
+/*
+ * Prints the result of every run, and the best and mean of each
+ * configuration over its seeds
+ */
+static void _print_sweep(const SweepConfig* configs,
+                         int num_configs,
+                         const SweepRun* runs) {
+    printf("Runs:\n");
+    printf("\t   Run  Config        Seed  Best fitness  Generations"
+           "  Evaluations  Time (s)\n");
+    for (int r=0; r<num_configs*SWEEP_SEEDS; r++) {
+        const SweepRun* run = &runs[r];
+
+        printf("\t%6d  %6d  %10d  ", r, run->config, run->seed);
+        if (!run->done)
+            printf("%12s\n", "not run");
+        else if (run->failed)
+            printf("%12s\n", "failed");
+        else
+            printf("%12d  %11d  %11ld  %8.2f\n",
+                   run->result.best_fitness,
+                   run->result.generations,
+                   run->result.num_evaluations,
+                   run->result.wall_time
+                  );
+    }
+    printf("\n");
+
+    printf("Configurations (over the seeds of each):\n");
+    printf("\tConfig  Runs  Best fitness  Mean fitness  Mean time (s)"
+           "  Settings\n");
+    for (int c=0; c<num_configs; c++) {
+        int num_runs = 0;
+        int best_fitness = 0;
+        double total_fitness = 0;
+        double total_time = 0;
+
+        for (int s=0; s<SWEEP_SEEDS; s++) {
+            const SweepRun* run = &runs[c*SWEEP_SEEDS + s];
+            if (!run->done || run->failed)
+                continue;
+            if (num_runs == 0 || run->result.best_fitness < best_fitness)
+                best_fitness = run->result.best_fitness;
+            total_fitness += run->result.best_fitness;
+            total_time += run->result.wall_time;
+            num_runs++;
+        }
+
+        if (num_runs)
+            printf("\t%6d  %4d  %12d  %12.1f  %13.2f  %s\n",
+                   c,
+                   num_runs,
+                   best_fitness,
+                   total_fitness / num_runs,
+                   total_time / num_runs,
+                   configs[c].settings
+                  );
+        else
+            printf("\t%6d  %4d  %12s  %12s  %13s  %s\n",
+                   c, 0, "-", "-", "-", configs[c].settings);
+    }
+}
+
+
+/*
+ * Runs the GA on graph for every configuration of the sweep file filename
+ * and each seed, SWEEP_CORES cores' worth of runs at a time, and prints
+ * the results. A stop signal is passed on to the runs in progress, which
+ * stop early (each with the best it has found), and no more are started.
+ * Returns 1 on success, 0 (after printing why) if the sweep file is
+ * invalid.
+ */
+int run_sweep(Graph* graph, const char* filename) {
+
+    int num_configs;
+    SweepConfig* configs = _read_sweep_file(filename, &num_configs);
+    if (!configs)
+        return 0;
+
+    int num_runs = num_configs * SWEEP_SEEDS;
+
+    // written by the runs' processes
+    SweepRun* runs = large_alloc_shared("sweep runs",
+                                        MEM_IO,
+                                        num_runs * sizeof(SweepRun));
+    for (int r=0; r<num_runs; r++) {
+        SweepRun* run = &runs[r];
+
+        run->config = r / SWEEP_SEEDS;
+        run->seed = (SEED ? SEED : 1) + r % SWEEP_SEEDS;
+        run->cores = configs[run->config].cores;
+        run->done = 0;
+        run->failed = 0;
+        memset(&run->result, 0, sizeof(GAResult));
+    }
+
+    Sweep sweep = {graph, runs, configs};
+    JobPool pool;
+    init_job_pool(&pool, SWEEP_CORES, num_runs, _run, &sweep);
+
+    printf("Sweeping %d configuration%s with %d seed%s each (%d run%s) on "
+           "%d core%s...\n",
+           num_configs, num_configs == 1 ? "" : "s",
+           SWEEP_SEEDS, SWEEP_SEEDS == 1 ? "" : "s",
+           num_runs, num_runs == 1 ? "" : "s",
+           pool.num_cores, pool.num_cores == 1 ? "" : "s"
+          );
+
+    int next_run = 0;
+    int num_done = 0;
+
+    for (;;) {
+        // start the next runs while their cores are free
+        while (next_run < num_runs && job_fits(&pool, runs[next_run].cores)) {
+            start_job(&pool, next_run, runs[next_run].cores);
+            next_run++;
+        }
+
+        int failed;
+        int r = wait_job(&pool, &failed);
+        if (r < 0)
+            break;
+
+        runs[r].done = 1;
+        runs[r].failed = failed;
+        num_done++;
+
+        printf("\r%d of %d runs complete...", num_done, num_runs);
+        fflush(stdout);
+    }
+    printf("\n");
+    if (jobs_stopped())
+        printf("Stopped: signal %d\n", jobs_stopped());
+    printf("\n");
+
+    _print_sweep(configs, num_configs, runs);
+
+    free_job_pool(&pool);
+    large_free(runs);
+    for (int c=0; c<num_configs; c++) {
+        tracked_free(configs[c].settings);
+    }
+    tracked_free(configs);
+
+    return 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * sweep.h
+ *
+ * header file for sweep.c
+ *
+ * Sweep mode (SWEEP_FILE): the GA is run for each of a list of
+ * configurations, with each of SWEEP_SEEDS seeds, and the results are
+ * printed as one table. Each line of the sweep file is a configuration: any
+ * number of name=value settings, separated by blanks, which apply over the
+ * parameters of the command line; everything after a '#' is a comment. A
+ * value may be a list, a,b,c, which makes the line a configuration for each
+ * of its values, and a line with several lists one for every combination of
+ * them (a grid):
+ *
+ *     pop_size=40,80,160 mutation_prob=0.001,0.005
+ *     steady_state=1 ss_replacement=worst,tournament
+ *
+ * Each run is a process forked once the graph has been read, so the runs
+ * share its pages (which nothing writes) and each has parameters of its own.
+ * A run needs a core for each thread that evolves islands or evaluates
+ * children, and runs are started, in order, as long as the cores they need
+ * are free, so the machine is kept busy without being oversubscribed.
+ *
+ */
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#include "GAA-sw.h"
+#include "graph.h"
+
+#define SWEEP_MAX_LINE     1024  // characters of a line of a sweep file
+#define SWEEP_MAX_SETTINGS 64    // settings on a line
+
+
+typedef struct SweepConfig {
+    char* settings;        // name=value ..., each value a single one
+    int cores;             // a run of it needs
+} SweepConfig;
+
+
+typedef struct SweepRun {
+    int config;            // index of its configuration
+    int seed;
+    int cores;             // it needs
+    int done;
+    int failed;            // 1 if its process did not finish the GA
+    GAResult result;       // written by its process
+} SweepRun;
+
+
+int run_sweep(Graph*, const char*);
+
+#endif /* _SWEEP_H_ */
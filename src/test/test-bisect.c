@@ -0,0 +1,170 @@
+/*
+ * test-bisect.c
+ *
+ * tests of recursive bisection (bisect.c): the subgraphs each level is
+ * bisected in, and the parts GAA-sw writes for num_parts > 2, which must
+ * cover the graph, keep to the balance tolerance, and cut the edges it
+ * reports
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mkstemp, fdopen
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "ga-params.h"
+#include "graph-parser.h"
+#include "mem-track.h"
+
+#define GAA_SW     "../sw/GAA-sw"
+#define SMALL_FILE "../../res/edgelist/test.edgelist"
+#define GRAPH_FILE "../../res/edgelist/as20000102.edgelist"
+#define PARTS      8    // num_parts of the run
+#define PARTS_ARG  "8"
+
+
+/* The subgraph of one side of a partition has its nodes and edges only */
+static void test_induced_subgraph(void) {
+    Graph graph, sub;
+    int node_map[5];
+    bitarray_t partition[1] = {0};
+
+    // nodes 1, 2 and 3 on side 1; of the edges 0-1 0-2 2-3 2-1 4-3, 2-3
+    // and 2-1 join two of them
+    assert(parse_graph_from_file(SMALL_FILE, &graph));
+    assert(graph.v == 5 && graph.e == 5);
+    putbit(partition, 1, 1);
+    putbit(partition, 2, 1);
+    putbit(partition, 3, 1);
+
+    induced_subgraph(&graph, partition, 1, &sub, node_map);
+    assert(sub.v == 3 && sub.e == 2);
+    for (int i=0; i<sub.v; i++) {
+        assert(node_map[i] == i+1);
+        assert(sub.nodes[i]->id == i);
+        assert(sub.nodes[i]->weight == graph.nodes[i+1]->weight);
+    }
+    for (int i=0; i<sub.e; i++) {
+        int n1 = node_map[sub.edges[i]->n1];
+        int n2 = node_map[sub.edges[i]->n2];
+        assert((n1 == 2 && n2 == 3) || (n1 == 2 && n2 == 1));
+    }
+
+    // sub node 1 (node 2) is next to the other two, which are next to it
+    assert(sub.adj_index[0] == 0 && sub.adj_index[sub.v] == 2*sub.e);
+    assert(sub.adj_index[2] - sub.adj_index[1] == 2);
+    assert(sub.adj_index[1] - sub.adj_index[0] == 1);
+    assert(sub.adj_nodes[sub.adj_index[0]] == 1);
+    free_graph(&sub);
+
+    // the other side, with no edges at all
+    induced_subgraph(&graph, partition, 0, &sub, node_map);
+    assert(sub.v == 2 && sub.e == 0);
+    assert(node_map[0] == 0 && node_map[1] == 4);
+    free_graph(&sub);
+
+    free_graph(&graph);
+}
+
+
+/*
+ * Runs GAA-sw on GRAPH_FILE for PARTS parts, which it writes to
+ * parts_file, and sets *cut and *heaviest to the edge cut and the weight of
+ * the heaviest part it reports
+ */
+static void run_gaa_sw(const char* parts_file, long* cut, long* heaviest) {
+    char report[] = "/tmp/test-bisect-report-XXXXXX";
+    char parts_arg[64];
+    char line[256];
+
+    int fd = mkstemp(report);
+    assert(fd >= 0);
+    snprintf(parts_arg, sizeof(parts_arg), "--parts_file=%s", parts_file);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fd, STDOUT_FILENO);
+        execl(GAA_SW, GAA_SW, "--num_parts=" PARTS_ARG, parts_arg,
+              "--num_generations=10", "--pop_size=10", "--seed=1",
+              GRAPH_FILE, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    *cut = *heaviest = -1;
+    FILE* fp = fdopen(fd, "r");
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, " Edge cut: %ld", cut);
+        sscanf(line, " Heaviest part: %ld", heaviest);
+    }
+    fclose(fp);
+    unlink(report);
+}
+
+
+/* Every node is in a part, no part is too heavy, and the cut is as said */
+static void test_parts(void) {
+    Graph graph;
+    char parts_file[] = "/tmp/test-bisect-parts-XXXXXX";
+    long cut, heaviest;
+
+    int fd = mkstemp(parts_file);
+    assert(fd >= 0);
+    close(fd);
+
+    run_gaa_sw(parts_file, &cut, &heaviest);
+    assert(cut >= 0 && heaviest >= 0);
+    assert(parse_graph_from_file(GRAPH_FILE, &graph));
+
+    int* parts = malloc(graph.v * sizeof(int));
+    FILE* fp = fopen(parts_file, "r");
+    for (int i=0; i<graph.v; i++) {
+        assert(fscanf(fp, "%d", &parts[i]) == 1);
+        assert(parts[i] >= 0 && parts[i] < PARTS);
+    }
+    int extra;
+    assert(fscanf(fp, "%d", &extra) == EOF);
+    fclose(fp);
+    unlink(parts_file);
+
+    long weights[PARTS] = {0};
+    long total = 0;
+    for (int i=0; i<graph.v; i++) {
+        weights[parts[i]] += graph.nodes[i]->weight;
+        total += graph.nodes[i]->weight;
+    }
+    long max_weight = 0;
+    for (int part=0; part<PARTS; part++) {
+        assert(weights[part] > 0);
+        max_weight = weights[part] > max_weight ? weights[part] : max_weight;
+    }
+    assert(max_weight == heaviest);
+    assert(max_weight <= (1 + BALANCE_TOLERANCE) * total / PARTS + 1);
+
+    long edge_cut = 0;
+    for (int i=0; i<graph.e; i++) {
+        if (parts[graph.edges[i]->n1] != parts[graph.edges[i]->n2])
+            edge_cut += graph.edges[i]->weight;
+    }
+    assert(edge_cut == cut);
+
+    free(parts);
+    free_graph(&graph);
+}
+
+
+int main() {
+    test_induced_subgraph();
+    test_parts();
+
+    printf("bisection: ok\n");
+    return 0;
+}
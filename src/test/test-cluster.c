@@ -0,0 +1,156 @@
+/*
+ * test-cluster.c
+ *
+ * tests of the encoding of migrants between the hosts of a cluster
+ * (cluster.c): two hosts are connected by a socket pair, and what one
+ * exports arrives at the other as it was sent
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mkstemp, fdopen
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include "cluster.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+
+#define NUM_NODES 1000  // 32 words
+#define NUM_WORDS RESERVE_BITS(NUM_NODES)
+#define CAPACITY  8
+
+
+static void random_partition(bitarray_t* partition, uint32_t* rng) {
+    for (int k=0; k<NUM_WORDS; k++) {
+        partition[k] = xorshift32(rng);
+    }
+    partition[NUM_WORDS-1] &= (1u << (NUM_NODES % 32)) - 1;
+}
+
+
+/* Exports a migrant from the sender's gateway island */
+static void export(MigrantRing* ring,
+                   const bitarray_t* partition,
+                   int fitness) {
+    MigrantStamp stamp = {fitness, 0, 1};
+    bitarray_t* slot = ring_send_slot(ring);
+
+    assert(slot);
+    memcpy(slot, partition, NUM_WORDS * sizeof(bitarray_t));
+    ring_send(ring, &stamp);
+}
+
+
+/* The next migrant the receiver's gateway island takes in */
+static void check_import(MigrantRing* ring,
+                         const bitarray_t* partition,
+                         int fitness,
+                         int gen) {
+    MigrantStamp stamp;
+    const bitarray_t* slot = ring_receive_slot(ring, &stamp);
+
+    assert(slot);
+    assert(memcmp(slot, partition, NUM_WORDS * sizeof(bitarray_t)) == 0);
+    assert(stamp.fitness == fitness);
+    assert(stamp.gen == gen);
+    ring_receive(ring);
+}
+
+
+int main() {
+    Cluster sender, receiver;
+    MigrantRing exports, imports;
+    bitarray_t a[NUM_WORDS], b[NUM_WORDS], c[NUM_WORDS];
+    uint32_t rng = 4242;
+    int fds[2];
+
+    // a host file of one host, so that neither connects by itself
+    char host_file[] = "/tmp/test-cluster-XXXXXX";
+    int fd = mkstemp(host_file);
+    assert(fd >= 0);
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "127.0.0.1:47000\n");
+    fclose(fp);
+
+    assert(init_cluster(&sender, host_file, 0, NUM_NODES, 1));
+    assert(init_cluster(&receiver, host_file, 0, NUM_NODES, 1));
+    unlink(host_file);
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    sender.next_fd = fds[0];
+    receiver.prev_fd = fds[1];
+    receiver.hello_received = 1;
+
+    size_t bytes = migrant_ring_bytes(CAPACITY, NUM_NODES);
+    init_migrant_ring(&exports, 0, -1, CAPACITY, NUM_NODES,
+                      large_alloc("exports", MEM_IO, bytes, PLACE_LOCAL));
+    init_migrant_ring(&imports, -1, 0, CAPACITY, NUM_NODES,
+                      large_alloc("imports", MEM_IO, bytes, PLACE_LOCAL));
+    sender.exports = &exports;
+    receiver.imports = &imports;
+
+    // the first genome is sent against all zeros, so whole
+    random_partition(a, &rng);
+    export(&exports, a, 500);
+    cluster_exchange(&sender, 3);
+    assert(sender.stats.genome_bytes >= 1 + 4*NUM_WORDS);
+    cluster_exchange(&receiver, 7);
+    check_import(&imports, a, 500, 7);
+
+    // one close to it as the words in which the two differ; the best
+    // partition, which it now is, follows as a delta of no words
+    memcpy(b, a, sizeof(a));
+    b[0] ^= 1;
+    b[17] ^= 0x80000000u;
+    b[NUM_WORDS-1] ^= 2;
+    long genome_bytes = sender.stats.genome_bytes;
+    export(&exports, b, 490);
+    cluster_exchange(&sender, 4);
+    assert(sender.stats.genome_bytes - genome_bytes < 4*NUM_WORDS / 2);
+    cluster_exchange(&receiver, 8);
+    check_import(&imports, b, 490, 8);
+
+    // several at once, the same one twice, and one unlike the last
+    random_partition(c, &rng);
+    export(&exports, a, 500);
+    export(&exports, a, 500);
+    export(&exports, c, 510);
+    export(&exports, b, 490);
+    cluster_exchange(&sender, 5);
+    cluster_exchange(&receiver, 9);
+    check_import(&imports, a, 500, 9);
+    check_import(&imports, a, 500, 9);
+    check_import(&imports, c, 510, 9);
+    check_import(&imports, b, 490, 9);
+
+    MigrantStamp stamp;
+    assert(ring_receive_slot(&imports, &stamp) == NULL);
+    assert(sender.stats.migrants_sent == 6);
+    assert(receiver.stats.migrants_received == 6);
+    assert(sender.stats.bests_sent == 2);
+    assert(sender.stats.raw_genome_bytes == (6 + 2) * (1 + 4*NUM_WORDS));
+    assert(sender.stats.genome_bytes < sender.stats.raw_genome_bytes);
+    assert(receiver.stats.bytes_received == sender.stats.bytes_sent);
+
+    // the best partition found by the sender goes along too
+    assert(sender.best_fitness == 490 && sender.best_rank == 0);
+    assert(receiver.best_fitness == 490);
+    assert(memcmp(receiver.best, b, sizeof(b)) == 0);
+
+    close_cluster(&sender);
+    close_cluster(&receiver);
+    free_cluster(&sender);
+    free_cluster(&receiver);
+    large_free(exports.genomes);
+    large_free(imports.genomes);
+
+    printf("cluster: ok\n");
+    return 0;
+}
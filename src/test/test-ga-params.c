@@ -0,0 +1,182 @@
+/*
+ * test-ga-params.c
+ *
+ * tests of the parameter parser of ga-params.c: the command line, config
+ * files, and the printing of what has changed
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mkstemp, fdopen
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ga-params.h"
+
+static GAParams defaults;  // ga_params as the program starts
+
+
+static int parse(int argc, char** argv) {
+    char* graph_file;
+
+    ga_params = defaults;
+    return parse_ga_params(argc, argv, &graph_file);
+}
+
+
+/* Settings on the command line, with '-' or '_' in their names */
+static void test_command_line(void) {
+    char* graph_file;
+    char* argv[] = {"GAA-sw",
+                    "--pop_size=80",
+                    "--mutation-prob=0.25",
+                    "--max_evaluations=1e12",
+                    "--topology=ring",
+                    "--parts_file=parts.txt",
+                    "graph.edgelist"};
+
+    ga_params = defaults;
+    assert(parse_ga_params(7, argv, &graph_file));
+    assert(strcmp(graph_file, "graph.edgelist") == 0);
+    assert(POP_SIZE == 80);
+    assert(MUTATION_PROB == 0.25);
+    assert(MAX_EVALUATIONS == 1000000000000L);
+    assert(TOPOLOGY == TOPOLOGY_RING);
+    assert(strcmp(PARTS_FILE, "parts.txt") == 0);
+    assert(NUM_ISLANDS == defaults.num_islands);
+}
+
+
+/* What is not a valid setting, or breaks a constraint, is rejected */
+static void test_invalid(void) {
+    char long_name[100];
+
+    memset(long_name, 'x', sizeof(long_name));
+    memcpy(long_name, "--", 2);
+    strcpy(long_name + sizeof(long_name) - 3, "=1");
+
+    char* cases[][3] = {
+        {"GAA-sw", "--no_such_param=1", "g"},
+        {"GAA-sw", "--pop_size=41", "g"},          // odd
+        {"GAA-sw", "--pop_size=1e9", "g"},         // out of range
+        {"GAA-sw", "--pop_size=4.5", "g"},         // not whole
+        {"GAA-sw", "--pop_size=", "g"},
+        {"GAA-sw", "--pop_size=40x", "g"},
+        {"GAA-sw", "--topology=star", "g"},
+        {"GAA-sw", "--num_parts=6", "g"},          // not a power of 2
+        {"GAA-sw", "--pop_size", "g"},             // no value
+        {"GAA-sw", "--pop_size=40", "--seed=1"},   // no graph file
+        {"GAA-sw", long_name, "g"},
+    };
+
+    for (size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+        assert(!parse(3, cases[i]));
+    }
+
+    // a name of the longest allowed length that is not a parameter
+    char name[64];
+    memset(name, 'y', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    assert(!set_ga_param(name, "1"));
+
+    // one character too long for the field
+    char value[sizeof(ga_params.parts_file) + 1];
+    memset(value, 'z', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    assert(!set_ga_param("parts_file", value));
+    value[sizeof(value) - 2] = '\0';
+    assert(set_ga_param("parts_file", value));
+
+    ga_params = defaults;
+    assert(set_ga_param("num_elites", "40"));
+    assert(!check_ga_params());  // as many elites as the population
+    ga_params = defaults;
+}
+
+
+/* A config file, with comments and blanks, and the command line after it */
+static void test_config_file(void) {
+    char filename[] = "/tmp/test-ga-params-XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd >= 0);
+
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "# settings\n"
+                "\n"
+                "  pop_size = 60   # even\n"
+                "num-islands=3\n"
+                "local_search = elite\t\n"
+                "cluster_hosts = hosts.txt\n");
+    fclose(fp);
+
+    char config[64];
+    snprintf(config, sizeof(config), "--config=%s", filename);
+    char* argv[] = {"GAA-sw", config, "--num_islands=7", "g"};
+
+    assert(parse(4, argv));
+    assert(POP_SIZE == 60);
+    assert(NUM_ISLANDS == 7);
+    assert(LOCAL_SEARCH == LS_ELITE);
+    assert(strcmp(CLUSTER_HOSTS, "hosts.txt") == 0);
+
+    // a line that is not a setting is an error
+    fp = fopen(filename, "a");
+    fprintf(fp, "pop_size 80\n");
+    fclose(fp);
+    assert(!parse(4, argv));
+
+    unlink(filename);
+}
+
+
+/* Only what has changed is printed, strings with nothing empty after '=' */
+static void test_print(void) {
+    char out[8192];
+    FILE* fp = tmpfile();
+
+    ga_params = defaults;
+    assert(print_ga_params(fp, 1) == 0);
+    assert(print_ga_params(fp, 0) > 0);
+    fclose(fp);
+
+    fp = tmpfile();
+    assert(set_ga_param("pop_size", "50"));
+    assert(set_ga_param("cluster_hosts", "hosts.txt"));
+    assert(print_ga_params(fp, 1) == 2);
+    rewind(fp);
+    size_t n = fread(out, 1, sizeof(out) - 1, fp);
+    out[n] = '\0';
+    fclose(fp);
+    assert(strcmp(out, "\tpop_size = 50\n"
+                       "\tcluster_hosts = hosts.txt\n") == 0);
+
+    fp = tmpfile();
+    ga_params = defaults;
+    assert(print_ga_params(fp, 0) > 0);
+    rewind(fp);
+    n = fread(out, 1, sizeof(out) - 1, fp);
+    out[n] = '\0';
+    fclose(fp);
+    assert(strstr(out, "\tcluster_hosts =\n"));
+    assert(strstr(out, "\tparts_file =\n"));
+
+    ga_params = defaults;
+}
+
+
+int main() {
+    defaults = ga_params;
+
+    // the rejected settings say why on stderr, which is not of interest here
+    assert(freopen("/dev/null", "w", stderr));
+
+    test_command_line();
+    test_invalid();
+    test_config_file();
+    test_print();
+
+    printf("GA parameters: ok\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * test-genome-pool.c
+ *
+ * tests of the reference counted partition rows of genome-pool.h
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "genome-pool.h"
+#include "large-alloc.h"
+#include "mem-track.h"
+
+#define NUM_NODES 100  // 4 words of a 16 word row
+#define CAPACITY  8
+
+
+/* Rows are handed out from the start of the arena and padded with zeros */
+static void test_alloc(GenomePool* pool) {
+    bitarray_t* a = genome_alloc(pool);
+    bitarray_t* b = genome_alloc(pool);
+
+    assert(a == pool->arena);
+    assert(b == pool->arena + pool->stride);
+    assert((size_t)a % GENOME_ALIGN == 0);
+    assert((size_t)b % GENOME_ALIGN == 0);
+    for (int i=pool->num_words; i<pool->stride; i++) {
+        assert(a[i] == 0 && b[i] == 0);
+    }
+    assert(pool->num_free == CAPACITY - 2);
+    assert(pool->peak_used == 2);
+
+    genome_release(pool, b);
+    genome_release(pool, a);
+    assert(pool->num_free == CAPACITY);
+    assert(pool->peak_used == 2);
+
+    // the last row released is the first reused
+    assert(genome_alloc(pool) == a);
+    genome_release(pool, a);
+}
+
+
+/* A shared row is not reused until every reference to it is released */
+static void test_share(GenomePool* pool) {
+    bitarray_t* a = genome_alloc(pool);
+
+    assert(!genome_is_shared(pool, a));
+    assert(genome_share(pool, a) == a);
+    assert(genome_is_shared(pool, a));
+
+    genome_release(pool, a);
+    assert(!genome_is_shared(pool, a));
+    assert(pool->num_free == CAPACITY - 1);
+
+    genome_release(pool, a);
+    assert(pool->num_free == CAPACITY);
+}
+
+
+/* Copy on write copies a shared row, and leaves a private one in place */
+static void test_make_unique(GenomePool* pool) {
+    bitarray_t* a = genome_alloc(pool);
+    for (int i=0; i<pool->num_words; i++) {
+        a[i] = 0x01010101u * (i+1);
+    }
+
+    assert(genome_make_unique(pool, a) == a);
+
+    bitarray_t* b = genome_share(pool, a);
+    b = genome_make_unique(pool, b);
+    assert(b != a);
+    assert(memcmp(a, b, pool->num_words * sizeof(bitarray_t)) == 0);
+    assert(!genome_is_shared(pool, a));
+
+    // what is written to the copy leaves the original alone
+    putbit(b, 3, !getbit(a, 3));
+    assert(getbit(a, 3) != getbit(b, 3));
+
+    // a row about to be overwritten is not copied, but is still private
+    bitarray_t* c = genome_share(pool, a);
+    c = genome_make_writable(pool, c);
+    assert(c != a && c != b);
+    assert(!genome_is_shared(pool, a));
+    assert(genome_make_writable(pool, c) == c);
+
+    genome_release(pool, a);
+    genome_release(pool, b);
+    genome_release(pool, c);
+    assert(pool->num_free == CAPACITY);
+}
+
+
+int main() {
+    GenomePool pool;
+    size_t bytes = genome_pool_bytes(CAPACITY, NUM_NODES);
+    bitarray_t* arena = large_alloc("test arena",
+                                    MEM_POPULATION,
+                                    bytes,
+                                    PLACE_LOCAL
+                                   );
+
+    assert(bytes % GENOME_POOL_PAGE == 0);
+    assert(bytes >= CAPACITY * GENOME_STRIDE(NUM_NODES) * sizeof(bitarray_t));
+
+    init_genome_pool(&pool, CAPACITY, NUM_NODES, arena);
+    test_alloc(&pool);
+    test_share(&pool);
+    test_make_unique(&pool);
+    free_genome_pool(&pool);
+    large_free(arena);
+
+    printf("genome pool: ok\n");
+    return 0;
+}
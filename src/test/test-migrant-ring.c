@@ -0,0 +1,134 @@
+/*
+ * test-migrant-ring.c
+ *
+ * tests of the single-producer/single-consumer rings of migrant-ring.h
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "large-alloc.h"
+#include "mem-track.h"
+#include "migrant-ring.h"
+
+#define NUM_NODES    100
+#define MIN_CAPACITY 3       // rounded up to 4 slots
+#define NUM_SENT     20000   // migrants the sender thread sends
+
+
+/* The migrant numbered i: its fitness is i, and every word of it i too */
+static void send_migrant(MigrantRing* ring, bitarray_t* slot, int i) {
+    MigrantStamp stamp = {i, i / 10, i};
+
+    for (int k=0; k<RESERVE_BITS(NUM_NODES); k++) {
+        slot[k] = i;
+    }
+    ring_send(ring, &stamp);
+}
+
+
+static void check_migrant(const bitarray_t* slot,
+                          const MigrantStamp* stamp,
+                          int i) {
+    assert(stamp->fitness == i);
+    assert(stamp->gen == i / 10);
+    assert(stamp->version == i);
+    for (int k=0; k<RESERVE_BITS(NUM_NODES); k++) {
+        assert(slot[k] == (bitarray_t)i);
+    }
+}
+
+
+/* Migrants come out in the order they went in, until the ring is full */
+static void test_fifo(MigrantRing* ring) {
+    MigrantStamp stamp;
+    bitarray_t* slot;
+
+    assert(ring->capacity == 4);
+    assert(ring_receive_slot(ring, &stamp) == NULL);
+
+    for (int i=0; i<4; i++) {
+        slot = ring_send_slot(ring);
+        assert(slot);
+        send_migrant(ring, slot, i);
+    }
+    assert(ring_send_slot(ring) == NULL);
+
+    for (int i=0; i<4; i++) {
+        const bitarray_t* received = ring_receive_slot(ring, &stamp);
+        assert(received);
+        check_migrant(received, &stamp, i);
+
+        // the slot is the receiver's until it is handed back
+        if (i == 0)
+            assert(ring_send_slot(ring) == NULL);
+        ring_receive(ring);
+        assert(ring_send_slot(ring) != NULL);
+    }
+    assert(ring_receive_slot(ring, &stamp) == NULL);
+
+    // a slot written but not sent is not received, and is the next sent
+    slot = ring_send_slot(ring);
+    slot[0] = 99;
+    assert(ring_receive_slot(ring, &stamp) == NULL);
+    assert(ring_send_slot(ring) == slot);
+}
+
+
+/* Sends NUM_SENT migrants, retrying on a full ring */
+static void* sender(void* arg) {
+    MigrantRing* ring = arg;
+
+    for (int i=0; i<NUM_SENT; i++) {
+        bitarray_t* slot;
+        while ((slot = ring_send_slot(ring)) == NULL)
+            sched_yield();
+        send_migrant(ring, slot, i);
+    }
+    return NULL;
+}
+
+
+/* With the sender on another thread, no migrant is lost or torn */
+static void test_threads(MigrantRing* ring) {
+    pthread_t thread;
+    MigrantStamp stamp;
+
+    pthread_create(&thread, NULL, sender, ring);
+    for (int i=0; i<NUM_SENT; i++) {
+        const bitarray_t* slot;
+        while ((slot = ring_receive_slot(ring, &stamp)) == NULL)
+            sched_yield();
+        check_migrant(slot, &stamp, i);
+        ring_receive(ring);
+    }
+    pthread_join(thread, NULL);
+
+    assert(ring_receive_slot(ring, &stamp) == NULL);
+}
+
+
+int main() {
+    MigrantRing ring;
+    size_t bytes = migrant_ring_bytes(MIN_CAPACITY, NUM_NODES);
+    void* slots = large_alloc("test ring", MEM_POPULATION, bytes, PLACE_LOCAL);
+
+    assert(migrant_ring_capacity(1) == 1);
+    assert(migrant_ring_capacity(4) == 4);
+    assert(migrant_ring_capacity(5) == 8);
+    assert(bytes % CACHE_LINE == 0);
+
+    init_migrant_ring(&ring, 0, 1, MIN_CAPACITY, NUM_NODES, slots);
+    assert(ring.from == 0 && ring.to == 1);
+    test_fifo(&ring);
+
+    init_migrant_ring(&ring, 0, 1, MIN_CAPACITY, NUM_NODES, slots);
+    test_threads(&ring);
+
+    large_free(slots);
+
+    printf("migrant ring: ok\n");
+    return 0;
+}
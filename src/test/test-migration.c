@@ -0,0 +1,122 @@
+/*
+ * test-migration.c
+ *
+ * tests of the adaptive migration probabilities (adaptive-migration.h): a
+ * reward raises a route and a penalty lowers it, while every route keeps the
+ * floor and together they keep 1 - PROB_ISLAND_STAY
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "adaptive-migration.h"
+
+#define MAX_ISLANDS 64
+#define EPSILON     1e-9
+
+
+/* Sets the probabilities of an island with neighbours 1..num_neighbours */
+static void init_probs(double* probs, int* neighbours, int num_neighbours) {
+    probs[0] = PROB_ISLAND_STAY;
+    for (int i=0; i<num_neighbours; i++) {
+        neighbours[i] = i+1;
+        probs[i+1] = (1 - PROB_ISLAND_STAY) / num_neighbours;
+    }
+}
+
+
+/* Every route is at or above floor, and the routes sum to what is shared */
+static void check_probs(const double* probs,
+                        const int* neighbours,
+                        int num_neighbours,
+                        double floor) {
+    double total = 0;
+
+    assert(probs[0] == PROB_ISLAND_STAY);
+    for (int i=0; i<num_neighbours; i++) {
+        assert(probs[neighbours[i]] >= floor - EPSILON);
+        total += probs[neighbours[i]];
+    }
+    assert(fabs(total - (1 - PROB_ISLAND_STAY)) < EPSILON);
+}
+
+
+/* A reward raises its route and a penalty lowers it */
+static void test_reward_penalty(void) {
+    double probs[MAX_ISLANDS];
+    int neighbours[MAX_ISLANDS];
+
+    init_probs(probs, neighbours, 4);
+    double before = probs[2];
+    adapt_migration_probs(probs, neighbours, 4, 2, 1);
+    assert(probs[2] > before);
+    assert(probs[1] < before && probs[3] < before && probs[4] < before);
+    check_probs(probs, neighbours, 4, PROB_ISLAND_MIN);
+
+    before = probs[3];
+    adapt_migration_probs(probs, neighbours, 4, 3, 0);
+    assert(probs[3] < before);
+    check_probs(probs, neighbours, 4, PROB_ISLAND_MIN);
+}
+
+
+/* However often a route is penalized, it keeps PROB_ISLAND_MIN */
+static void test_floor(void) {
+    double probs[MAX_ISLANDS];
+    int neighbours[MAX_ISLANDS];
+
+    init_probs(probs, neighbours, 4);
+    for (int i=0; i<1000; i++) {
+        adapt_migration_probs(probs, neighbours, 4, 1, 0);
+        adapt_migration_probs(probs, neighbours, 4, 2, i % 3 == 0);
+        check_probs(probs, neighbours, 4, PROB_ISLAND_MIN);
+    }
+    assert(probs[1] < 2*PROB_ISLAND_MIN && probs[1] < probs[3]);
+}
+
+
+/*
+ * With more routes than PROB_ISLAND_MIN leaves room for, the floor is an
+ * equal share of 1 - PROB_ISLAND_STAY instead, so no route goes negative
+ */
+static void test_many_neighbours(void) {
+    double probs[MAX_ISLANDS];
+    int neighbours[MAX_ISLANDS];
+    int num_neighbours = MAX_ISLANDS - 1;
+
+    assert(num_neighbours * PROB_ISLAND_MIN > 1 - PROB_ISLAND_STAY);
+    init_probs(probs, neighbours, num_neighbours);
+    for (int i=0; i<100; i++) {
+        adapt_migration_probs(probs, neighbours, num_neighbours,
+                              1 + i % num_neighbours, i % 2);
+        check_probs(probs, neighbours, num_neighbours, 0);
+    }
+}
+
+
+/* With no floor, a lone route penalized to nothing takes it all again */
+static void test_no_floor(void) {
+    double probs[MAX_ISLANDS];
+    int neighbours[MAX_ISLANDS];
+    GAParams defaults = ga_params;
+
+    ga_params.prob_island_min = 0;
+    init_probs(probs, neighbours, 1);
+    for (int i=0; i<100; i++) {
+        adapt_migration_probs(probs, neighbours, 1, 1, 0);
+        check_probs(probs, neighbours, 1, 0);
+    }
+    ga_params = defaults;
+}
+
+
+int main() {
+    test_reward_penalty();
+    test_floor();
+    test_many_neighbours();
+    test_no_floor();
+
+    printf("adaptive migration: ok\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * test-packed-genome.c
+ *
+ * tests of the sparse XOR deltas of packed-genome.h
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "packed-genome.h"
+
+#define NUM_NODES 320  // 10 words
+#define NUM_WORDS RESERVE_BITS(NUM_NODES)
+
+
+static void random_partition(bitarray_t* partition, uint32_t* rng) {
+    for (int k=0; k<NUM_WORDS; k++) {
+        partition[k] = xorshift32(rng);
+    }
+}
+
+
+/* Reads a packed genome word by word, as the fitness evaluation does */
+static void check_reader(const PackedGenome* g, const bitarray_t* partition) {
+    PackedReader r;
+
+    init_packed_reader(&r, g);
+    for (int k=0; k<NUM_WORDS; k++) {
+        assert(packed_read_word(&r, k) == partition[k]);
+    }
+}
+
+
+/* Without a base, or far from it, a partition is stored whole */
+static void test_whole(PackedStore* store, uint32_t* rng) {
+    bitarray_t partition[NUM_WORDS], other[NUM_WORDS], unpacked[NUM_WORDS];
+
+    random_partition(partition, rng);
+    PackedGenome* g = pack_genome(store, partition, NULL);
+    assert(!g->base);
+    assert(g->num_stored == NUM_WORDS);
+    unpack_genome(store, g, unpacked);
+    assert(memcmp(unpacked, partition, sizeof(partition)) == 0);
+    check_reader(g, partition);
+
+    // half the words differ: a delta would be no smaller
+    memcpy(other, partition, sizeof(partition));
+    for (int k=0; k<NUM_WORDS; k+=2) {
+        other[k] = ~other[k];
+    }
+    PackedGenome* h = pack_genome(store, other, g);
+    assert(!h->base);
+    assert(g->refcount == 1);
+    unpack_genome(store, h, unpacked);
+    assert(memcmp(unpacked, other, sizeof(other)) == 0);
+
+    packed_release(store, h);
+    packed_release(store, g);
+    assert(store->bytes == 0);
+}
+
+
+/* Close to its base, a partition is stored as the words that differ */
+static void test_delta(PackedStore* store, uint32_t* rng) {
+    bitarray_t base[NUM_WORDS], partition[NUM_WORDS], unpacked[NUM_WORDS];
+
+    random_partition(base, rng);
+    PackedGenome* b = pack_genome(store, base, NULL);
+    long whole_bytes = store->bytes;
+
+    memcpy(partition, base, sizeof(base));
+    putbit(partition, 5, !getbit(partition, 5));      // word 0
+    putbit(partition, 200, !getbit(partition, 200));  // word 6
+    putbit(partition, 210, !getbit(partition, 210));  // word 6 again
+
+    PackedGenome* g = pack_genome(store, partition, b);
+    assert(g->base == b);
+    assert(b->refcount == 2);
+    assert(g->num_stored == 2);
+    assert(g->idxs[0] == 0 && g->idxs[1] == 6);
+    assert(store->bytes - whole_bytes < whole_bytes);
+
+    unpack_genome(store, g, unpacked);
+    assert(memcmp(unpacked, partition, sizeof(partition)) == 0);
+    check_reader(g, partition);
+
+    // the same partition as its base is a delta of no words
+    PackedGenome* same = pack_genome(store, base, b);
+    assert(same->base == b && same->num_stored == 0);
+    unpack_genome(store, same, unpacked);
+    assert(memcmp(unpacked, base, sizeof(base)) == 0);
+    check_reader(same, base);
+    packed_release(store, same);
+
+    // the base is kept while a delta refers to it
+    assert(packed_share(g) == g);
+    packed_release(store, b);
+    packed_release(store, g);
+    assert(b->refcount == 1);
+    unpack_genome(store, g, unpacked);
+    assert(memcmp(unpacked, partition, sizeof(partition)) == 0);
+
+    assert(store->peak_bytes >= store->bytes);
+    packed_release(store, g);
+    assert(store->bytes == 0);
+}
+
+
+int main() {
+    PackedStore store;
+    uint32_t rng = 12345;
+
+    init_packed_store(&store, NUM_NODES);
+    assert(store.num_words == NUM_WORDS);
+
+    test_whole(&store, &rng);
+    test_delta(&store, &rng);
+
+    printf("packed genome: ok\n");
+    return 0;
+}
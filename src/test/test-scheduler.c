@@ -0,0 +1,112 @@
+/*
+ * test-scheduler.c
+ *
+ * tests of the work-stealing scheduler of scheduler.c
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#define NUM_WORKERS 4
+#define NUM_TASKS   4095  // a full binary tree of them
+
+
+typedef struct TestRun {
+    Scheduler* scheduler;
+    int spawns;            // 1 if task t spawns tasks 2t+1 and 2t+2
+    int runs[NUM_TASKS];   // times each task has run
+    int worker_ok;         // 0 once a task ran on an invalid worker
+} TestRun;
+
+
+/* Runs a task of uneven cost, and spawns its children in the tree */
+static void run_task(void* arg, int task, int worker) {
+    TestRun* run = arg;
+    volatile long work = 0;
+
+    if (worker < 0 || worker >= NUM_WORKERS)
+        run->worker_ok = 0;
+    __atomic_add_fetch(&run->runs[task], 1, __ATOMIC_RELAXED);
+
+    for (int i=0; i<(task % 7) * 1000; i++) {
+        work += i;
+    }
+
+    for (int child=2*task+1; run->spawns && child<=2*task+2; child++) {
+        if (child < NUM_TASKS)
+            spawn_task(run->scheduler, worker, child);
+    }
+}
+
+
+/* Each task runs once, on a worker, and the workers count every one */
+static void check_run(Scheduler* s, TestRun* run) {
+    long num_tasks = 0;
+    long num_steals = 0;
+
+    assert(run->worker_ok);
+    for (int task=0; task<NUM_TASKS; task++) {
+        assert(run->runs[task] == 1);
+    }
+    for (int i=0; i<s->num_workers; i++) {
+        num_tasks += s->workers[i].stats.num_tasks;
+        num_steals += s->workers[i].stats.num_steals;
+    }
+    assert(num_tasks == NUM_TASKS);
+    assert(num_steals <= num_tasks);
+    assert(s->pending == 0);
+}
+
+
+/* Tasks spawned by the tasks themselves, from a single root */
+static void test_tree(void) {
+    Scheduler s;
+    static TestRun run;
+
+    memset(&run, 0, sizeof(TestRun));
+    run.scheduler = &s;
+    run.spawns = 1;
+    run.worker_ok = 1;
+
+    init_scheduler(&s, NUM_WORKERS, NUM_TASKS, run_task, &run);
+    spawn_task(&s, 0, 0);
+    start_scheduler(&s);
+    wait_scheduler(&s);
+
+    check_run(&s, &run);
+    free_scheduler(&s);
+}
+
+
+/* Every task spawned up front on one worker, for the others to steal */
+static void test_flat(void) {
+    Scheduler s;
+    static TestRun run;
+
+    memset(&run, 0, sizeof(TestRun));
+    run.scheduler = &s;
+    run.spawns = 0;
+    run.worker_ok = 1;
+
+    init_scheduler(&s, NUM_WORKERS, NUM_TASKS, run_task, &run);
+    for (int task=0; task<NUM_TASKS; task++) {
+        spawn_task(&s, 0, task);
+    }
+    start_scheduler(&s);
+    wait_scheduler(&s);
+
+    check_run(&s, &run);
+    free_scheduler(&s);
+}
+
+
+int main() {
+    test_tree();
+    test_flat();
+
+    printf("scheduler: ok\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * test-stage-ring.c
+ *
+ * tests of the ring of batch slots that connects the stages of a pipelined
+ * generation (pipeline.h)
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "pipeline.h"
+
+#define DEPTH       3     // rounded up to 4 slots
+#define MAX_PAIRS   5
+#define NUM_BATCHES 5000  // batches the island makes
+
+
+/* Each stage takes the slots in turn, after the stage before it */
+static void test_stages(StageRing* ring) {
+    assert(ring->capacity == 4);
+    assert(batch_to_evaluate(ring) == NULL);
+    assert(batch_to_settle(ring) == NULL);
+
+    for (int i=0; i<4; i++) {
+        ChildBatch* batch = batch_to_make(ring);
+        assert(batch == &ring->batches[i]);
+        batch->num_pairs = i+1;
+        batch_made(ring);
+    }
+    // every slot is in use: the island is held back
+    assert(batch_to_make(ring) == NULL);
+    assert(ring->max_depth == 4);
+    assert(ring->num_batches == 4);
+
+    // replacement waits for evaluation
+    assert(batch_to_settle(ring) == NULL);
+    ChildBatch* batch = batch_to_evaluate(ring);
+    assert(batch == &ring->batches[0] && batch->num_pairs == 1);
+    batch_evaluated(ring);
+    assert(batch_to_settle(ring) == &ring->batches[0]);
+    assert(batch_to_make(ring) == NULL);
+
+    // a settled slot is free to make a batch in again
+    batch_settled(ring);
+    assert(batch_to_make(ring) == &ring->batches[0]);
+    assert(batch_to_settle(ring) == NULL);
+
+    for (int i=1; i<4; i++) {
+        batch = batch_to_evaluate(ring);
+        assert(batch->num_pairs == i+1);
+        batch_evaluated(ring);
+    }
+    assert(batch_to_evaluate(ring) == NULL);
+    for (int i=1; i<4; i++) {
+        assert(batch_to_settle(ring) == &ring->batches[i]);
+        batch_settled(ring);
+    }
+    assert(batch_to_settle(ring) == NULL);
+}
+
+
+/* Evaluates NUM_BATCHES batches as they come */
+static void* evaluator(void* arg) {
+    StageRing* ring = arg;
+
+    for (int i=0; i<NUM_BATCHES; i++) {
+        ChildBatch* batch;
+        while ((batch = batch_to_evaluate(ring)) == NULL)
+            sched_yield();
+        assert(batch->num_pairs == i % MAX_PAIRS + 1);
+        batch->stats.num_evaluations = 2*batch->num_pairs;
+        batch_evaluated(ring);
+    }
+    return NULL;
+}
+
+
+/*
+ * With the evaluator on another thread, every batch is evaluated once, and
+ * settled in the order made
+ */
+static void test_threads(StageRing* ring) {
+    pthread_t thread;
+    int made = 0;
+    int settled = 0;
+
+    pthread_create(&thread, NULL, evaluator, ring);
+    while (settled < NUM_BATCHES) {
+        ChildBatch* batch;
+        if (made < NUM_BATCHES && (batch = batch_to_make(ring)) != NULL) {
+            batch->num_pairs = made % MAX_PAIRS + 1;
+            batch->stats.num_evaluations = 0;
+            batch_made(ring);
+            made++;
+        }
+        else if ((batch = batch_to_settle(ring)) != NULL) {
+            assert(batch->num_pairs == settled % MAX_PAIRS + 1);
+            assert(batch->stats.num_evaluations == 2*batch->num_pairs);
+            batch_settled(ring);
+            settled++;
+        }
+        else {
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+
+    assert(ring->max_depth <= ring->capacity);
+    assert(batch_to_evaluate(ring) == NULL);
+    assert(batch_to_settle(ring) == NULL);
+}
+
+
+int main() {
+    StageRing ring;
+
+    assert(stage_ring_capacity(1) == 1);
+    assert(stage_ring_capacity(4) == 4);
+    assert(stage_ring_capacity(5) == 8);
+
+    init_stage_ring(&ring, DEPTH, MAX_PAIRS, NULL, 0);
+    assert(ring.batch_pairs == MAX_PAIRS);
+    test_stages(&ring);
+    free_stage_ring(&ring);
+
+    init_stage_ring(&ring, DEPTH, MAX_PAIRS, NULL, 0);
+    test_threads(&ring);
+    free_stage_ring(&ring);
+
+    printf("stage ring: ok\n");
+    return 0;
+}